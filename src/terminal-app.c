@@ -22,9 +22,11 @@
 #include <config.h>
 
 #include <errno.h>
+#include <signal.h>
 
 #include <glib.h>
 #include <dconf.h>
+#include <libnotify/notify.h>
 
 #include "terminal-intl.h"
 
@@ -37,6 +39,7 @@
 #include "terminal-util.h"
 #include "profile-editor.h"
 #include "terminal-encoding.h"
+#include "terminal-logger.h"
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
@@ -79,6 +82,11 @@ struct _TerminalAppClass
 	void (* encoding_list_changed) (TerminalApp *app);
 };
 
+/* Upper bounds of the spawn latency histogram buckets, in ms; the last
+ * bucket has none.
+ */
+static const gint64 spawn_latency_bounds[] = { 1, 5, 10, 25, 50, 100, 250, 1000, -1 };
+
 struct _TerminalApp
 {
 	GObject parent_instance;
@@ -103,8 +111,47 @@ struct _TerminalApp
 	gboolean encodings_locked;
 
 	PangoFontDescription *system_font_desc;
+	GHashTable *font_cache; /* ScaledFontKey -> PangoFontDescription */
+	guint font_cache_hits;
+	guint font_cache_misses;
 	gboolean enable_mnemonics;
 	gboolean enable_menu_accels;
+
+	gboolean enable_notifications;
+	gboolean notify_initialised;
+	gint64 last_notification_time;
+	guint notifications_shown;
+	guint notifications_suppressed;
+
+	/* Number of child launches per spawn_latency_bounds bucket */
+	guint spawn_latency_counts[G_N_ELEMENTS (spawn_latency_bounds)];
+
+	/* Child environment template */
+	GHashTable *base_env;
+	GHashTable *proxy_env;
+	GSettings *settings_proxy;
+	GSettings *settings_proxy_http;
+	GSettings *settings_proxy_https;
+	GSettings *settings_proxy_ftp;
+	GSettings *settings_proxy_socks;
+	guint env_template_hits;
+	guint env_template_misses;
+
+	/* Pre-spawned shells */
+	GHashTable *shell_pools; /* TerminalProfile -> ShellPool */
+	guint shell_pool_hits;
+	guint shell_pool_misses;
+	guint shell_pool_refills;
+
+	/* Foreground processes */
+	GHashTable *foregrounds; /* TerminalScreen -> ForegroundInfo */
+	guint foreground_activity_source_id;
+	guint foreground_poll_source_id;
+
+	/* Scrollback memory budget */
+	guint64 scrollback_budget; /* bytes, 0 for none */
+	guint scrollback_budget_source_id;
+	guint scrollback_budget_trims;
 };
 
 enum
@@ -155,6 +202,74 @@ static TerminalApp *global_app = NULL;
 
 #define ENCODING_LIST_KEY "active-encodings"
 
+#define ENABLE_NOTIFICATIONS_KEY "notifications"
+
+#define LAZY_RESTORE_KEY "lazy-restore"
+#define RESTORE_SPAWN_INTERVAL_KEY "restore-spawn-interval"
+
+#define SCROLLBACK_BUDGET_KEY "scrollback-budget"
+
+/* Interval between checks of the total scrollback against the budget */
+#define SCROLLBACK_BUDGET_INTERVAL (10) /* s */
+
+/* Scrollback kept in background tabs however far over budget we are */
+#define SCROLLBACK_MIN_LINES (1000)
+
+/* Rough memory cost of one character cell of scrollback */
+#define SCROLLBACK_BYTES_PER_CELL (8)
+
+/* How long to let output settle before looking at the foreground process */
+#define FOREGROUND_ACTIVITY_DELAY (250) /* ms */
+
+/* Interval between passes over all terminals, to catch silent changes */
+#define FOREGROUND_POLL_INTERVAL (5) /* s */
+
+/* Minimum time between two desktop notifications, across all terminals */
+#define NOTIFICATION_MIN_INTERVAL (5 * G_USEC_PER_SEC)
+
+/* Scaled fonts kept before the cache starts over */
+#define FONT_CACHE_MAX_SIZE (32)
+
+typedef struct
+{
+	PangoFontDescription *desc;
+	double scale;
+} ScaledFontKey;
+
+static guint
+scaled_font_key_hash (gconstpointer v)
+{
+	const ScaledFontKey *key = v;
+
+	return pango_font_description_hash (key->desc) ^ g_double_hash (&key->scale);
+}
+
+static gboolean
+scaled_font_key_equal (gconstpointer a,
+                       gconstpointer b)
+{
+	const ScaledFontKey *ka = a;
+	const ScaledFontKey *kb = b;
+
+	return ka->scale == kb->scale &&
+	       pango_font_description_equal (ka->desc, kb->desc);
+}
+
+static void
+scaled_font_key_free (ScaledFontKey *key)
+{
+	pango_font_description_free (key->desc);
+	g_slice_free (ScaledFontKey, key);
+}
+
+typedef struct _ShellPool ShellPool;
+
+static void shell_pool_free (ShellPool *pool);
+
+typedef struct _ForegroundInfo ForegroundInfo;
+
+static void foreground_info_free (ForegroundInfo *info);
+
 
 /* two following functions were copied from libcafe-desktop to get rid
  * of dependency on it
@@ -806,6 +921,10 @@ terminal_app_profile_list_notify_cb (GSettings   *settings,
 	gboolean need_new_default;
 	TerminalProfile *fallback;
 	guint count;
+#ifdef CAFE_ENABLE_DEBUG
+	guint n_created = 0;
+	gint64 start = g_get_monotonic_time ();
+#endif
 
 	g_object_freeze_notify (object);
 
@@ -835,11 +954,22 @@ terminal_app_profile_list_notify_cb (GSettings   *settings,
 			/* make profiles_to_delete point to profiles we didn't find in the list */
 			profiles_to_delete = g_list_delete_link (profiles_to_delete, link);
 		else
+		{
 			terminal_app_create_profile (app, profile_name);
+#ifdef CAFE_ENABLE_DEBUG
+			n_created++;
+#endif
+		}
 	}
 
 	g_free (value_list);
 
+#ifdef CAFE_ENABLE_DEBUG
+	_terminal_debug_print (TERMINAL_DEBUG_PROFILE,
+	                       "Created %u profiles in %" G_GINT64_FORMAT " us\n",
+	                       n_created, g_get_monotonic_time () - start);
+#endif
+
 ensure_one_profile:
 
 	if (val != NULL)
@@ -1036,6 +1166,7 @@ terminal_app_system_font_notify_cb (GSettings   *settings,
 	GVariant *val;
 	const char *font = NULL;
 	PangoFontDescription *font_desc;
+	GList *l;
 
 	if (strcmp (key, MONOSPACE_FONT_KEY) != 0)
 		return;
@@ -1066,6 +1197,28 @@ terminal_app_system_font_notify_cb (GSettings   *settings,
 
 	g_object_notify (G_OBJECT (app), TERMINAL_APP_SYSTEM_FONT);
 	g_variant_unref (val);
+
+	/* One pass over all terminals, resizing each window once */
+	for (l = app->windows; l != NULL; l = l->next)
+	{
+		TerminalWindow *window = TERMINAL_WINDOW (l->data);
+		GList *containers, *lc;
+		gboolean changed = FALSE;
+
+		containers = terminal_window_list_screen_containers (window);
+		for (lc = containers; lc != NULL; lc = lc->next)
+		{
+			TerminalScreen *screen;
+
+			screen = terminal_screen_container_get_screen (TERMINAL_SCREEN_CONTAINER (lc->data));
+			if (terminal_screen_update_system_font (screen))
+				changed = TRUE;
+		}
+		g_list_free (containers);
+
+		if (changed && terminal_window_get_active (window) != NULL)
+			terminal_window_update_size (window, terminal_window_get_active (window), TRUE);
+	}
 }
 
 static void
@@ -1100,6 +1253,237 @@ terminal_app_enable_menu_accels_notify_cb (GSettings   *settings,
 	g_object_notify (G_OBJECT (app), TERMINAL_APP_ENABLE_MENU_BAR_ACCEL);
 }
 
+static void
+terminal_app_enable_notifications_notify_cb (GSettings   *settings,
+                                             const gchar *key,
+                                             gpointer     user_data)
+{
+	TerminalApp *app = TERMINAL_APP (user_data);
+
+	app->enable_notifications = g_settings_get_boolean (settings, key);
+}
+
+typedef struct
+{
+	TerminalScreen *screen;
+	guint64 usage; /* estimated bytes */
+	glong lines; /* scrollback only */
+	glong cap; /* see terminal_screen_set_scrollback_cap() */
+	gint64 last_viewed;
+} ScrollbackUsage;
+
+static int
+scrollback_usage_compare_viewed (gconstpointer a,
+                                 gconstpointer b)
+{
+	const ScrollbackUsage *ua = a;
+	const ScrollbackUsage *ub = b;
+
+	if (ua->last_viewed < ub->last_viewed)
+		return -1;
+	if (ua->last_viewed > ub->last_viewed)
+		return 1;
+	return 0;
+}
+
+/* Every live screen is in the foreground monitor's table; see
+ * terminal_app_monitor_screen().
+ */
+static GArray *
+terminal_app_collect_scrollback_usage (TerminalApp *app,
+                                       guint64     *total)
+{
+	GHashTableIter iter;
+	gpointer key;
+	GArray *usages;
+
+	usages = g_array_sized_new (FALSE, FALSE, sizeof (ScrollbackUsage),
+	                            g_hash_table_size (app->foregrounds));
+	*total = 0;
+
+	g_hash_table_iter_init (&iter, app->foregrounds);
+	while (g_hash_table_iter_next (&iter, &key, NULL))
+	{
+		ScrollbackUsage usage;
+		glong columns;
+
+		usage.screen = TERMINAL_SCREEN (key);
+		terminal_screen_get_scrollback_usage (usage.screen,
+		                                      &usage.lines,
+		                                      &columns,
+		                                      &usage.cap,
+		                                      &usage.last_viewed);
+		usage.usage = (guint64) usage.lines * columns * SCROLLBACK_BYTES_PER_CELL;
+		*total += usage.usage;
+		g_array_append_val (usages, usage);
+	}
+
+	return usages;
+}
+
+static gboolean
+terminal_app_scrollback_budget_cb (TerminalApp *app)
+{
+	GArray *usages;
+	guint64 total;
+	guint i;
+
+	usages = terminal_app_collect_scrollback_usage (app, &total);
+
+	_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+	                       "Scrollback: about %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " bytes in %u terminals\n",
+	                       total, app->scrollback_budget, usages->len);
+
+	if (total <= app->scrollback_budget)
+		goto out;
+
+	/* Shrink the tabs that have gone unseen the longest first */
+	g_array_sort (usages, scrollback_usage_compare_viewed);
+
+	for (i = 0; i < usages->len && total > app->scrollback_budget; ++i)
+	{
+		ScrollbackUsage *usage = &g_array_index (usages, ScrollbackUsage, i);
+		guint64 bytes_per_line, excess;
+		glong lines;
+
+		if (usage->last_viewed == 0 || /* showing */
+		    usage->lines <= SCROLLBACK_MIN_LINES ||
+		    (usage->cap >= 0 && usage->lines <= usage->cap)) /* trimmed already */
+			continue;
+
+		bytes_per_line = usage->usage / usage->lines;
+		if (bytes_per_line == 0)
+			continue;
+
+		excess = total - app->scrollback_budget;
+		lines = usage->lines - (glong) MIN ((guint64) usage->lines, (excess + bytes_per_line - 1) / bytes_per_line);
+		lines = MAX (lines, SCROLLBACK_MIN_LINES);
+		if (lines >= usage->lines)
+			continue;
+
+		terminal_screen_set_scrollback_cap (usage->screen, lines);
+		total -= (guint64) (usage->lines - lines) * bytes_per_line;
+		app->scrollback_budget_trims++;
+
+		_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+		                       "Scrollback: trimmed terminal %p from %ld to %ld lines\n",
+		                       usage->screen, usage->lines, lines);
+	}
+
+out:
+	g_array_free (usages, TRUE);
+
+	return TRUE; /* run again */
+}
+
+static void
+terminal_app_scrollback_budget_notify_cb (GSettings   *settings,
+                                          const gchar *key,
+                                          gpointer     user_data)
+{
+	TerminalApp *app = TERMINAL_APP (user_data);
+
+	app->scrollback_budget = (guint64) g_settings_get_int (settings, key) * 1024 * 1024;
+
+	if (app->scrollback_budget == 0)
+	{
+		if (app->scrollback_budget_source_id != 0)
+		{
+			g_source_remove (app->scrollback_budget_source_id);
+			app->scrollback_budget_source_id = 0;
+		}
+		return;
+	}
+
+	if (app->scrollback_budget_source_id == 0)
+		app->scrollback_budget_source_id =
+			g_timeout_add_seconds (SCROLLBACK_BUDGET_INTERVAL,
+			                       (GSourceFunc) terminal_app_scrollback_budget_cb,
+			                       app);
+}
+
+static void
+terminal_app_proxy_settings_changed_cb (GSettings   *settings G_GNUC_UNUSED,
+                                        const gchar *key G_GNUC_UNUSED,
+                                        TerminalApp *app)
+{
+	/* Resolved again on the next spawn */
+	if (app->proxy_env != NULL)
+	{
+		g_hash_table_destroy (app->proxy_env);
+		app->proxy_env = NULL;
+	}
+}
+
+static void
+terminal_app_init_proxy_settings (TerminalApp *app)
+{
+	GSettingsSchema *schema;
+	GSettings **settings[] =
+	{
+		&app->settings_proxy,
+		&app->settings_proxy_http,
+		&app->settings_proxy_https,
+		&app->settings_proxy_ftp,
+		&app->settings_proxy_socks
+	};
+	const char *schemas[] =
+	{
+		CONF_PROXY_SCHEMA,
+		CONF_HTTP_PROXY_SCHEMA,
+		CONF_HTTPS_PROXY_SCHEMA,
+		CONF_FTP_PROXY_SCHEMA,
+		CONF_SOCKS_PROXY_SCHEMA
+	};
+	guint i;
+
+	schema = g_settings_schema_source_lookup (g_settings_schema_source_get_default (),
+	                                          CONF_PROXY_SCHEMA, TRUE);
+	if (schema == NULL)
+		return;
+
+	g_settings_schema_unref (schema);
+
+	for (i = 0; i < G_N_ELEMENTS (schemas); ++i)
+	{
+		*settings[i] = g_settings_new (schemas[i]);
+		g_signal_connect (*settings[i], "changed",
+		                  G_CALLBACK (terminal_app_proxy_settings_changed_cb), app);
+	}
+}
+
+static void
+terminal_app_clear_proxy_settings (TerminalApp *app)
+{
+	GSettings **settings[] =
+	{
+		&app->settings_proxy,
+		&app->settings_proxy_http,
+		&app->settings_proxy_https,
+		&app->settings_proxy_ftp,
+		&app->settings_proxy_socks
+	};
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (settings); ++i)
+	{
+		if (*settings[i] == NULL)
+			continue;
+
+		g_signal_handlers_disconnect_by_func (*settings[i],
+		                                      G_CALLBACK (terminal_app_proxy_settings_changed_cb),
+		                                      app);
+		g_object_unref (*settings[i]);
+		*settings[i] = NULL;
+	}
+
+	if (app->proxy_env != NULL)
+	{
+		g_hash_table_destroy (app->proxy_env);
+		app->proxy_env = NULL;
+	}
+}
+
 static void
 new_profile_response_cb (CtkWidget *new_profile_dialog,
                          int        response_id,
@@ -1410,6 +1794,15 @@ terminal_app_init (TerminalApp *app)
 
 	app->profiles = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
 
+	app->shell_pools = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify) shell_pool_free);
+
+	app->foregrounds = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify) foreground_info_free);
+
+	app->font_cache = g_hash_table_new_full (scaled_font_key_hash,
+	                                         scaled_font_key_equal,
+	                                         (GDestroyNotify) scaled_font_key_free,
+	                                         (GDestroyNotify) pango_font_description_free);
+
 	app->encodings = terminal_encodings_get_builtins ();
 
 	settings_global = g_settings_new (CONF_GLOBAL_SCHEMA);
@@ -1446,6 +1839,18 @@ terminal_app_init (TerminalApp *app)
 	                  G_CALLBACK(terminal_app_enable_menu_accels_notify_cb),
 	                  app);
 
+	g_signal_connect (settings_global,
+	                  "changed::" ENABLE_NOTIFICATIONS_KEY,
+	                  G_CALLBACK(terminal_app_enable_notifications_notify_cb),
+	                  app);
+
+	g_signal_connect (settings_global,
+	                  "changed::" SCROLLBACK_BUDGET_KEY,
+	                  G_CALLBACK(terminal_app_scrollback_budget_notify_cb),
+	                  app);
+
+	terminal_app_init_proxy_settings (app);
+
 	/* Load the settings */
         terminal_app_profile_list_notify_cb (settings_global,
 					     PROFILE_LIST_KEY,
@@ -1453,9 +1858,11 @@ terminal_app_init (TerminalApp *app)
 	terminal_app_default_profile_notify_cb (settings_global,
 					        DEFAULT_PROFILE_KEY,
 						app);
+	_terminal_startup_mark (TERMINAL_STARTUP_APP_PROFILES);
 	terminal_app_encoding_list_notify_cb (settings_global,
 					      ENCODING_LIST_KEY,
 					      app);
+	_terminal_startup_mark (TERMINAL_STARTUP_APP_ENCODINGS);
 	terminal_app_system_font_notify_cb (app->settings_font,
 					    MONOSPACE_FONT_KEY,
 					    app);
@@ -1465,12 +1872,19 @@ terminal_app_init (TerminalApp *app)
 	terminal_app_enable_mnemonics_notify_cb (settings_global,
 	                                         ENABLE_MNEMONICS_KEY,
 	                                         app);
+	terminal_app_enable_notifications_notify_cb (settings_global,
+	                                             ENABLE_NOTIFICATIONS_KEY,
+	                                             app);
+	terminal_app_scrollback_budget_notify_cb (settings_global,
+	                                          SCROLLBACK_BUDGET_KEY,
+	                                          app);
 
 	/* Ensure we have valid settings */
 	g_assert (app->default_profile_id != NULL);
 	g_assert (app->system_font_desc != NULL);
 
 	terminal_accels_init ();
+	_terminal_startup_mark (TERMINAL_STARTUP_APP_ACCELS);
 
 	EggSMClient *sm_client;
 	char *desktop_file;
@@ -1487,6 +1901,8 @@ terminal_app_init (TerminalApp *app)
 	                  G_CALLBACK (terminal_app_save_state_cb), app);
 	g_signal_connect (sm_client, "quit",
 	                  G_CALLBACK (terminal_app_client_quit_cb), app);
+
+	_terminal_startup_mark (TERMINAL_STARTUP_APP_INIT);
 }
 
 static void
@@ -1518,6 +1934,30 @@ terminal_app_finalize (GObject *object)
 	g_signal_handlers_disconnect_by_func (settings_global,
 	                                      G_CALLBACK(terminal_app_enable_mnemonics_notify_cb),
 	                                      app);
+	g_signal_handlers_disconnect_by_func (settings_global,
+	                                      G_CALLBACK(terminal_app_enable_notifications_notify_cb),
+	                                      app);
+	g_signal_handlers_disconnect_by_func (settings_global,
+	                                      G_CALLBACK(terminal_app_scrollback_budget_notify_cb),
+	                                      app);
+
+	if (app->scrollback_budget_source_id != 0)
+		g_source_remove (app->scrollback_budget_source_id);
+
+	if (app->notify_initialised)
+		notify_uninit ();
+
+	g_hash_table_destroy (app->shell_pools);
+
+	if (app->foreground_activity_source_id != 0)
+		g_source_remove (app->foreground_activity_source_id);
+	if (app->foreground_poll_source_id != 0)
+		g_source_remove (app->foreground_poll_source_id);
+	g_hash_table_destroy (app->foregrounds);
+
+	terminal_app_clear_proxy_settings (app);
+	if (app->base_env != NULL)
+		g_hash_table_destroy (app->base_env);
 
 	g_object_unref (settings_global);
 	g_object_unref (app->settings_font);
@@ -1529,6 +1969,7 @@ terminal_app_finalize (GObject *object)
 	g_hash_table_destroy (app->encodings);
 
 	pango_font_description_free (app->system_font_desc);
+	g_hash_table_destroy (app->font_cache);
 
 	terminal_accels_shutdown ();
 
@@ -1690,6 +2131,256 @@ terminal_app_shutdown (void)
 
 	g_object_unref (global_app);
 	g_assert (global_app == NULL);
+
+	/* Don't lose queued output, or leave compressed logs truncated */
+	terminal_logger_shutdown ();
+}
+
+/* Windows that are built after the first one, in idle slices */
+typedef struct
+{
+	TerminalApp *app;
+	TerminalOptions *options;
+	CdkScreen *cdk_screen;
+	gboolean lazy_restore;
+	guint trickle_interval;
+	GList *next;                /* InitialWindow being built, or to build next */
+	TerminalWindow *window;     /* window being built, or NULL */
+	GList *tabs;                /* InitialTab still to add to @window */
+	TerminalWindow *attach_window; /* for the first InitialWindow; weak pointer */
+} StagedWindows;
+
+/* Time spent building windows in one idle slice, in microseconds */
+#define STAGED_WINDOWS_SLICE_BUDGET (8 * 1000)
+
+/* The window that was current before any of @options' windows was
+ * created, for the first InitialWindow's tabs to be added to.
+ */
+static TerminalWindow *
+initial_window_get_attach_window (TerminalApp     *app,
+                                  TerminalOptions *options,
+                                  CdkScreen       *cdk_screen)
+{
+	InitialWindow *iw = options->initial_windows->data;
+
+	g_assert (iw->tabs);
+
+	if (!((InitialTab *)iw->tabs->data)->attach_window)
+		return NULL;
+
+	return terminal_app_get_current_window (app, cdk_screen, options->initial_workspace);
+}
+
+static TerminalWindow *
+initial_window_begin (TerminalApp     *app,
+                      TerminalOptions *options,
+                      InitialWindow   *iw,
+                      CdkScreen       *cdk_screen,
+                      TerminalWindow  *attach_window)
+{
+	TerminalWindow *window;
+
+	g_assert (iw->tabs);
+
+	if (attach_window)
+		return attach_window;
+
+	/* Create & setup new window */
+	window = terminal_app_new_window (app, cdk_screen);
+
+	/* Restored windows shouldn't demand attention; see bug #586308. */
+	if (iw->source_tag == SOURCE_SESSION)
+		terminal_window_set_is_restored (window);
+
+	if (options->startup_id != NULL)
+		ctk_window_set_startup_id (CTK_WINDOW (window), options->startup_id);
+
+	/* Overwrite the default, unique window role set in terminal_window_init */
+	if (iw->role)
+		ctk_window_set_role (CTK_WINDOW (window), iw->role);
+
+	if (iw->force_menubar_state)
+		terminal_window_set_menubar_visible (window, iw->menubar_state);
+
+	if (iw->start_fullscreen)
+		ctk_window_fullscreen (CTK_WINDOW (window));
+	if (iw->start_maximized)
+		ctk_window_maximize (CTK_WINDOW (window));
+
+	return window;
+}
+
+static void
+initial_window_add_tab (TerminalApp     *app,
+                        TerminalOptions *options,
+                        TerminalWindow  *window,
+                        InitialTab      *it,
+                        gboolean         lazy,
+                        guint            trickle_interval)
+{
+	TerminalProfile *profile = NULL;
+	TerminalScreen *screen;
+	const char *profile_name;
+	gboolean profile_is_id;
+
+	if (it->profile)
+	{
+		profile_name = it->profile;
+		profile_is_id = it->profile_is_id;
+	}
+	else
+	{
+		profile_name = options->default_profile;
+		profile_is_id = options->default_profile_is_id;
+	}
+
+	if (profile_name)
+	{
+		if (profile_is_id)
+			profile = terminal_app_get_profile_by_name (app, profile_name);
+		else
+			profile = terminal_app_get_profile_by_visible_name (app, profile_name);
+
+		if (profile == NULL)
+			g_printerr (_("No such profile \"%s\", using default profile\n"), it->profile);
+	}
+	if (profile == NULL)
+		profile = terminal_app_get_profile_for_new_term (app);
+	g_assert (profile);
+
+	screen = terminal_app_new_terminal (app, window, profile,
+	                                    it->exec_argv ? it->exec_argv : options->exec_argv,
+	                                    it->title ? it->title : options->default_title,
+	                                    it->working_dir ? it->working_dir : options->default_working_dir,
+	                                    options->env,
+	                                    it->zoom_set ? it->zoom : options->zoom);
+
+	if (it->active)
+		terminal_window_switch_screen (window, screen);
+	else if (lazy)
+		terminal_screen_defer_launch_child (screen, trickle_interval);
+}
+
+static gboolean
+initial_window_map_event_cb (CtkWidget   *widget,
+                             CdkEventAny *event G_GNUC_UNUSED,
+                             gpointer     user_data G_GNUC_UNUSED)
+{
+	ctk_window_set_focus_on_map (CTK_WINDOW (widget), TRUE);
+	g_signal_handlers_disconnect_by_func (widget, G_CALLBACK (initial_window_map_event_cb), NULL);
+
+	return FALSE;
+}
+
+static void
+initial_window_finish (InitialWindow  *iw,
+                       TerminalWindow *window,
+                       gboolean        lazy,
+                       gboolean        take_focus)
+{
+	/* The tab that ends up selected is not switched to again */
+	if (lazy && terminal_window_get_active (window) != NULL)
+		terminal_screen_launch_deferred_child (terminal_window_get_active (window));
+
+	if (iw->geometry)
+	{
+		_terminal_debug_print (TERMINAL_DEBUG_GEOMETRY,
+		                       "[window %p] applying geometry %s\n",
+		                       window, iw->geometry);
+
+		if (!terminal_window_update_size_set_geometry (window,
+		                                               terminal_window_get_active (window),
+		                                               FALSE,
+		                                               iw->geometry))
+			g_printerr (_("Invalid geometry string \"%s\"\n"), iw->geometry);
+	}
+
+	if (take_focus || ctk_widget_get_mapped (CTK_WIDGET (window)))
+	{
+		ctk_window_present (CTK_WINDOW (window));
+		return;
+	}
+
+	/* Don't take the focus away from the window that was shown first */
+	ctk_window_set_focus_on_map (CTK_WINDOW (window), FALSE);
+	g_signal_connect (window, "map-event",
+	                  G_CALLBACK (initial_window_map_event_cb), NULL);
+	ctk_widget_show (CTK_WIDGET (window));
+}
+
+static gboolean
+initial_window_is_lazy (TerminalOptions *options,
+                        InitialWindow   *iw,
+                        gboolean         lazy_restore)
+{
+	/* Only restored layouts get their background tabs launched lazily */
+	return lazy_restore && (options->load_config || iw->source_tag == SOURCE_SESSION);
+}
+
+static gboolean
+staged_windows_build_cb (StagedWindows *staged)
+{
+	gint64 deadline;
+	guint steps = 0;
+
+	deadline = g_get_monotonic_time () + STAGED_WINDOWS_SLICE_BUDGET;
+
+	do
+	{
+		InitialWindow *iw = staged->next->data;
+
+		if (staged->window == NULL)
+		{
+			staged->window = initial_window_begin (staged->app, staged->options, iw,
+			                                       staged->cdk_screen,
+			                                       staged->next == staged->options->initial_windows ?
+			                                       staged->attach_window : NULL);
+			staged->tabs = iw->tabs;
+		}
+		else if (staged->tabs != NULL)
+		{
+			initial_window_add_tab (staged->app, staged->options, staged->window,
+			                        staged->tabs->data,
+			                        initial_window_is_lazy (staged->options, iw, staged->lazy_restore),
+			                        staged->trickle_interval);
+			staged->tabs = staged->tabs->next;
+		}
+		else
+		{
+			initial_window_finish (iw, staged->window,
+			                       initial_window_is_lazy (staged->options, iw, staged->lazy_restore),
+			                       FALSE);
+			staged->window = NULL;
+			staged->next = staged->next->next;
+
+			/* The last one was built first */
+			if (staged->next->next == NULL)
+			{
+				_terminal_debug_print (TERMINAL_DEBUG_FACTORY,
+				                       "Built the remaining windows on idle\n");
+				return FALSE; /* don't run again */
+			}
+		}
+
+		steps++;
+	}
+	while (g_get_monotonic_time () < deadline);
+
+	_terminal_debug_print (TERMINAL_DEBUG_FACTORY,
+	                       "Window building slice ran %u steps, continuing on idle\n",
+	                       steps);
+
+	return TRUE; /* run again */
+}
+
+static void
+staged_windows_free (StagedWindows *staged)
+{
+	if (staged->attach_window)
+		g_object_remove_weak_pointer (G_OBJECT (staged->attach_window),
+		                              (gpointer *) &staged->attach_window);
+	terminal_options_free (staged->options);
+	g_slice_free (StagedWindows, staged);
 }
 
 /**
@@ -1712,8 +2403,12 @@ terminal_app_handle_options (TerminalApp *app,
                              gboolean allow_resume,
                              GError **error)
 {
-	GList *lw;
+	GList *lw, *lt;
+	InitialWindow *iw;
+	TerminalWindow *window, *attach_window;
 	CdkScreen *cdk_screen;
+	gboolean lazy_restore, lazy;
+	guint trickle_interval;
 
 	cdk_screen = terminal_app_get_screen_by_display_name (options->display_name);
 
@@ -1760,107 +2455,55 @@ terminal_app_handle_options (TerminalApp *app,
 	/* Make sure we open at least one window */
 	terminal_options_ensure_window (options);
 
+	lazy_restore = g_settings_get_boolean (settings_global, LAZY_RESTORE_KEY);
+	trickle_interval = (guint) g_settings_get_int (settings_global, RESTORE_SPAWN_INTERVAL_KEY);
+
 	if (options->startup_id != NULL)
 		_terminal_debug_print (TERMINAL_DEBUG_FACTORY,
 		                       "Startup ID is '%s'\n",
 		                       options->startup_id);
 
-	for (lw = options->initial_windows;  lw != NULL; lw = lw->next)
-	{
-		InitialWindow *iw = lw->data;
-		TerminalWindow *window = NULL;
-		GList *lt;
+	/* Before the windows below become the current one */
+	attach_window = initial_window_get_attach_window (app, options, cdk_screen);
 
-		g_assert (iw->tabs);
+	/* Build and show the window that ends up focused first, which is the
+	 * last one, then the others on idle, a few tabs at a time.
+	 */
+	lw = g_list_last (options->initial_windows);
+	iw = lw->data;
+	lazy = initial_window_is_lazy (options, iw, lazy_restore);
 
-        if ( lw == options->initial_windows && ((InitialTab *)iw->tabs->data)->attach_window )
-            window = terminal_app_get_current_window(app, cdk_screen, options->initial_workspace);
+	window = initial_window_begin (app, options, iw, cdk_screen,
+	                               lw == options->initial_windows ? attach_window : NULL);
+	for (lt = iw->tabs; lt != NULL; lt = lt->next)
+		initial_window_add_tab (app, options, window, lt->data, lazy, trickle_interval);
+	initial_window_finish (iw, window, lazy, TRUE);
 
-        if (!window)
-        {
-            /* Create & setup new window */
-            window = terminal_app_new_window (app, cdk_screen);
+	if (lw != options->initial_windows)
+	{
+		StagedWindows *staged;
 
-            /* Restored windows shouldn't demand attention; see bug #586308. */
-            if (iw->source_tag == SOURCE_SESSION)
-                terminal_window_set_is_restored (window);
-
-            if (options->startup_id != NULL)
-                ctk_window_set_startup_id (CTK_WINDOW (window), options->startup_id);
-
-            /* Overwrite the default, unique window role set in terminal_window_init */
-            if (iw->role)
-                ctk_window_set_role (CTK_WINDOW (window), iw->role);
-
-            if (iw->force_menubar_state)
-                terminal_window_set_menubar_visible (window, iw->menubar_state);
-
-            if (iw->start_fullscreen)
-                ctk_window_fullscreen (CTK_WINDOW (window));
-            if (iw->start_maximized)
-                ctk_window_maximize (CTK_WINDOW (window));
-        }
-
-		/* Now add the tabs */
-		for (lt = iw->tabs; lt != NULL; lt = lt->next)
-		{
-			InitialTab *it = lt->data;
-			TerminalProfile *profile = NULL;
-			TerminalScreen *screen;
-			const char *profile_name;
-			gboolean profile_is_id;
-
-			if (it->profile)
-			{
-				profile_name = it->profile;
-				profile_is_id = it->profile_is_id;
-			}
-			else
-			{
-				profile_name = options->default_profile;
-				profile_is_id = options->default_profile_is_id;
-			}
-
-			if (profile_name)
-			{
-				if (profile_is_id)
-					profile = terminal_app_get_profile_by_name (app, profile_name);
-				else
-					profile = terminal_app_get_profile_by_visible_name (app, profile_name);
-
-				if (profile == NULL)
-					g_printerr (_("No such profile \"%s\", using default profile\n"), it->profile);
-			}
-			if (profile == NULL)
-				profile = terminal_app_get_profile_for_new_term (app);
-			g_assert (profile);
-
-			screen = terminal_app_new_terminal (app, window, profile,
-			                                    it->exec_argv ? it->exec_argv : options->exec_argv,
-			                                    it->title ? it->title : options->default_title,
-			                                    it->working_dir ? it->working_dir : options->default_working_dir,
-			                                    options->env,
-			                                    it->zoom_set ? it->zoom : options->zoom);
-
-			if (it->active)
-				terminal_window_switch_screen (window, screen);
-		}
-
-		if (iw->geometry)
-		{
-			_terminal_debug_print (TERMINAL_DEBUG_GEOMETRY,
-			                       "[window %p] applying geometry %s\n",
-			                       window, iw->geometry);
-
-			if (!terminal_window_update_size_set_geometry (window,
-			                                               terminal_window_get_active (window),
-			                                               FALSE,
-			                                               iw->geometry))
-				g_printerr (_("Invalid geometry string \"%s\"\n"), iw->geometry);
-		}
-
-		ctk_window_present (CTK_WINDOW (window));
-	}
+		_terminal_debug_print (TERMINAL_DEBUG_FACTORY,
+		                       "Building %u more windows on idle\n",
+		                       g_list_length (options->initial_windows) - 1);
+
+		staged = g_slice_new0 (StagedWindows);
+		staged->app = app;
+		staged->options = terminal_options_steal (options);
+		staged->cdk_screen = cdk_screen;
+		staged->lazy_restore = lazy_restore;
+		staged->trickle_interval = trickle_interval;
+		staged->next = staged->options->initial_windows;
+		staged->attach_window = attach_window;
+		if (attach_window)
+			g_object_add_weak_pointer (G_OBJECT (attach_window),
+			                           (gpointer *) &staged->attach_window);
+
+		g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+		                 (GSourceFunc) staged_windows_build_cb,
+		                 staged,
+		                 (GDestroyNotify) staged_windows_free);
+	}
 
 	return TRUE;
 }
@@ -1872,6 +2515,7 @@ terminal_app_new_window (TerminalApp *app,
 	TerminalWindow *window;
 
 	window = terminal_window_new ();
+	_terminal_startup_mark (TERMINAL_STARTUP_WINDOW_CREATED);
 
 	app->windows = g_list_append (app->windows, window);
 	g_signal_connect (window, "destroy",
@@ -2099,6 +2743,1178 @@ terminal_app_get_active_encodings (TerminalApp *app)
 	return g_slist_sort (list, (GCompareFunc) compare_encodings);
 }
 
+/**
+ * terminal_app_dup_child_environment:
+ * @app:
+ *
+ * Copies the environment template for a new child process: the factory's
+ * environment plus the system proxy settings. Both are resolved once and
+ * cached; the proxy part is dropped whenever the proxy settings change.
+ * The caller applies the per-terminal variables on top of it, and then
+ * calls terminal_app_add_proxy_env().
+ *
+ * Returns: a newly allocated #GHashTable mapping variable names to values
+ */
+GHashTable *
+terminal_app_dup_child_environment (TerminalApp *app)
+{
+	GHashTable *env_table;
+	GHashTableIter iter;
+	gpointer key, value;
+	gboolean hit = TRUE;
+
+	if (app->base_env == NULL)
+	{
+		char **env;
+		guint i;
+
+		app->base_env = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+		env = g_listenv ();
+		for (i = 0; env[i]; ++i)
+			g_hash_table_insert (app->base_env, env[i], g_strdup (g_getenv (env[i])));
+		g_free (env); /* the strings themselves are now owned by the hash table */
+
+		hit = FALSE;
+	}
+
+	if (app->settings_proxy != NULL && app->proxy_env == NULL)
+	{
+		app->proxy_env = terminal_util_get_proxy_env (app->settings_proxy,
+		                                              app->settings_proxy_http,
+		                                              app->settings_proxy_https,
+		                                              app->settings_proxy_ftp,
+		                                              app->settings_proxy_socks);
+		hit = FALSE;
+	}
+
+	if (hit)
+		app->env_template_hits++;
+	else
+		app->env_template_misses++;
+
+	_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+	                       "Child environment template: %u hits, %u misses\n",
+	                       app->env_template_hits, app->env_template_misses);
+
+	env_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+	g_hash_table_iter_init (&iter, app->base_env);
+	while (g_hash_table_iter_next (&iter, &key, &value))
+		g_hash_table_insert (env_table, g_strdup (key), g_strdup (value));
+
+	return env_table;
+}
+
+/**
+ * terminal_app_add_proxy_env:
+ * @app:
+ * @env_table: a #GHashTable from terminal_app_dup_child_environment()
+ *
+ * Adds the cached proxy env variables to @env_table, without overwriting
+ * any variable already set there.
+ */
+void
+terminal_app_add_proxy_env (TerminalApp *app,
+                            GHashTable  *env_table)
+{
+	if (app->proxy_env == NULL)
+		return;
+
+	terminal_util_merge_proxy_env (env_table, app->proxy_env);
+}
+
+/**
+ * terminal_app_get_child_environment:
+ * @app:
+ * @initial_env: the environment passed to the terminal, or %NULL
+ * @display: the display the terminal is on
+ * @window_xid: the X window id of the terminal's window, or 0 if not known
+ * @shell: return location for the value of SHELL in the environment
+ *
+ * Returns: the environment for a new child process, as a %NULL-terminated
+ *   array of "NAME=value" strings
+ */
+char **
+terminal_app_get_child_environment (TerminalApp *app,
+                                    char       **initial_env,
+                                    CdkDisplay  *display,
+                                    gulong       window_xid,
+                                    char       **shell)
+{
+	char *e, *v;
+	GHashTable *env_table;
+	GHashTableIter iter;
+	GPtrArray *retval;
+	guint i;
+
+	/* First take the factory's environment */
+	env_table = terminal_app_dup_child_environment (app);
+
+	/* and then merge the child environment, if any */
+	if (initial_env)
+	{
+		for (i = 0; initial_env[i]; ++i)
+		{
+			v = strchr (initial_env[i], '=');
+			if (v)
+				g_hash_table_replace (env_table, g_strndup (initial_env[i], v - initial_env[i]), g_strdup (v + 1));
+			else
+				g_hash_table_replace (env_table, g_strdup (initial_env[i]), NULL);
+		}
+	}
+
+	g_hash_table_remove (env_table, "COLUMNS");
+	g_hash_table_remove (env_table, "LINES");
+	g_hash_table_remove (env_table, "CAFE_DESKTOP_ICON");
+
+	g_hash_table_replace (env_table, g_strdup ("TERM"), g_strdup ("xterm-256color")); /* FIXME configurable later? */
+
+	if (window_xid != 0)
+		g_hash_table_replace (env_table, g_strdup ("WINDOWID"), g_strdup_printf ("%lu", window_xid));
+	else
+		g_hash_table_remove (env_table, "WINDOWID");
+	g_hash_table_replace (env_table, g_strdup ("DISPLAY"), g_strdup (cdk_display_get_name (display)));
+
+	terminal_app_add_proxy_env (app, env_table);
+
+	retval = g_ptr_array_sized_new (g_hash_table_size (env_table));
+	g_hash_table_iter_init (&iter, env_table);
+	while (g_hash_table_iter_next (&iter, (gpointer *) &e, (gpointer *) &v))
+		g_ptr_array_add (retval, g_strdup_printf ("%s=%s", e, v ? v : ""));
+	g_ptr_array_add (retval, NULL);
+
+	*shell = g_strdup (g_hash_table_lookup (env_table, "SHELL"));
+
+	g_hash_table_destroy (env_table);
+	return (char **) g_ptr_array_free (retval, FALSE);
+}
+
+/* Pre-spawned shells
+ *
+ * Profiles with a non-zero warm-pool-size keep that many shells started in
+ * the background, so that a new terminal can adopt one instead of waiting
+ * for the shell to source its startup files. A pooled shell only matches a
+ * new terminal with the same profile, working directory and initial
+ * environment; the pool refills for wherever the last new terminal with
+ * its profile was opened.
+ *
+ * Pooled shells don't know their terminal's window yet, so WINDOWID is not
+ * set in their environment.
+ */
+
+typedef struct
+{
+	ShellPool *pool; /* NULL once the shell was dropped from its pool */
+	BtePty *pty;
+	GPid pid;
+	guint child_watch_id;
+	char *working_dir;
+	char **initial_env;
+} PooledShell;
+
+struct _ShellPool
+{
+	TerminalApp *app;
+	TerminalProfile *profile;
+	GQueue shells; /* PooledShell, ready to be adopted */
+	PooledShell *spawning;
+	GCancellable *cancellable;
+	guint refill_source_id;
+	gboolean spawn_failed;
+
+	/* Where new shells are started */
+	char *working_dir;
+	char **initial_env;
+};
+
+static void
+shell_pool_print_stats (TerminalApp *app,
+                        const char  *event)
+{
+	_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+	                       "Shell pool %s: %u hits, %u misses, %u refills\n",
+	                       event,
+	                       app->shell_pool_hits,
+	                       app->shell_pool_misses,
+	                       app->shell_pool_refills);
+}
+
+static gboolean
+strv_equal (char **a,
+            char **b)
+{
+	guint i;
+
+	if (a == NULL || b == NULL)
+		return a == b;
+
+	for (i = 0; a[i] && b[i]; ++i)
+		if (strcmp (a[i], b[i]) != 0)
+			return FALSE;
+
+	return a[i] == b[i];
+}
+
+static void
+pooled_shell_free (PooledShell *shell)
+{
+	if (shell->pty)
+		g_object_unref (shell->pty);
+	g_free (shell->working_dir);
+	g_strfreev (shell->initial_env);
+	g_slice_free (PooledShell, shell);
+}
+
+static void
+pooled_shell_child_exited_cb (GPid         pid,
+                              int          status G_GNUC_UNUSED,
+                              PooledShell *shell)
+{
+	g_spawn_close_pid (pid);
+
+	if (shell->pool)
+	{
+		_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+		                       "Pooled shell %d exited while waiting\n", (int) pid);
+		g_queue_remove (&shell->pool->shells, shell);
+	}
+
+	pooled_shell_free (shell);
+}
+
+/* Ends a pooled shell; it is freed once it has been reaped */
+static void
+pooled_shell_drop (PooledShell *shell)
+{
+	shell->pool = NULL;
+
+	if (shell->pty)
+	{
+		g_object_unref (shell->pty);
+		shell->pty = NULL;
+	}
+
+	kill (shell->pid, SIGHUP);
+}
+
+static gboolean
+pooled_shell_matches (PooledShell *shell,
+                      const char  *working_dir,
+                      char       **initial_env)
+{
+	return g_strcmp0 (shell->working_dir, working_dir) == 0 &&
+	       strv_equal (shell->initial_env, initial_env);
+}
+
+static void
+shell_pool_clear (ShellPool *pool)
+{
+	PooledShell *shell;
+
+	if (pool->refill_source_id != 0)
+	{
+		g_source_remove (pool->refill_source_id);
+		pool->refill_source_id = 0;
+	}
+
+	if (pool->spawning)
+	{
+		pool->spawning->pool = NULL;
+		pool->spawning = NULL;
+
+		g_cancellable_cancel (pool->cancellable);
+		g_clear_object (&pool->cancellable);
+	}
+
+	while ((shell = g_queue_pop_head (&pool->shells)) != NULL)
+		pooled_shell_drop (shell);
+}
+
+static void
+shell_pool_free (ShellPool *pool)
+{
+	shell_pool_clear (pool);
+
+	g_signal_handlers_disconnect_matched (pool->profile, G_SIGNAL_MATCH_DATA,
+	                                      0, 0, NULL, NULL, pool);
+	g_object_unref (pool->profile);
+
+	g_free (pool->working_dir);
+	g_strfreev (pool->initial_env);
+	g_slice_free (ShellPool, pool);
+}
+
+static void shell_pool_schedule_refill (ShellPool *pool);
+
+static void
+shell_pool_spawn_cb (BtePty       *pty,
+                     GAsyncResult *result,
+                     PooledShell  *shell)
+{
+	ShellPool *pool = shell->pool;
+	GError *error = NULL;
+	GPid pid = -1;
+
+	if (!bte_pty_spawn_finish (pty, result, &pid, &error))
+	{
+		if (pool != NULL)
+		{
+			_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+			                       "Failed to start a pooled shell: %s\n",
+			                       error->message);
+
+			/* Don't retry until the profile changes */
+			pool->spawn_failed = TRUE;
+			pool->spawning = NULL;
+			g_clear_object (&pool->cancellable);
+		}
+
+		g_error_free (error);
+		pooled_shell_free (shell);
+		return;
+	}
+
+	shell->pid = pid;
+	shell->child_watch_id = g_child_watch_add (pid,
+	                                           (GChildWatchFunc) pooled_shell_child_exited_cb,
+	                                           shell);
+
+	if (pool == NULL)
+	{
+		/* The pool went away while the shell was starting */
+		pooled_shell_drop (shell);
+		return;
+	}
+
+	pool->spawning = NULL;
+	g_clear_object (&pool->cancellable);
+
+	g_queue_push_tail (&pool->shells, shell);
+
+	pool->app->shell_pool_refills++;
+	shell_pool_print_stats (pool->app, "refill");
+
+	shell_pool_schedule_refill (pool);
+}
+
+static gboolean
+shell_pool_refill_cb (ShellPool *pool)
+{
+	const TerminalProfileSnapshot *snapshot;
+	PooledShell *shell;
+	BtePty *pty;
+	GSpawnFlags spawn_flags = 0;
+	char **env, **argv;
+	char *shell_env = NULL;
+	GError *error = NULL;
+
+	pool->refill_source_id = 0;
+
+	if (pool->spawning || pool->spawn_failed)
+		return FALSE; /* don't run again */
+
+	snapshot = terminal_profile_get_snapshot (pool->profile);
+	if (g_queue_get_length (&pool->shells) >= (guint) snapshot->warm_pool_size)
+		return FALSE; /* don't run again */
+
+	env = terminal_app_get_child_environment (pool->app, pool->initial_env,
+	                                          cdk_display_get_default (), 0,
+	                                          &shell_env);
+
+	if (!terminal_util_get_profile_command (pool->profile, shell_env,
+	                                        &spawn_flags, &argv, &error))
+		goto failed;
+
+	pty = bte_pty_new_sync (BTE_PTY_DEFAULT, NULL, &error);
+	if (!pty)
+	{
+		g_strfreev (argv);
+		goto failed;
+	}
+
+	bte_pty_set_size (pty, snapshot->default_size_rows, snapshot->default_size_columns, NULL);
+
+	shell = g_slice_new0 (PooledShell);
+	shell->pool = pool;
+	shell->pty = pty;
+	shell->pid = -1;
+	shell->working_dir = g_strdup (pool->working_dir);
+	shell->initial_env = g_strdupv (pool->initial_env);
+
+	pool->spawning = shell;
+	pool->cancellable = g_cancellable_new ();
+
+	bte_pty_spawn_async (pty,
+	                     pool->working_dir,
+	                     argv,
+	                     env,
+	                     spawn_flags,
+	                     NULL, NULL, NULL,
+	                     -1,
+	                     pool->cancellable,
+	                     (GAsyncReadyCallback) shell_pool_spawn_cb,
+	                     shell);
+
+	g_strfreev (argv);
+	g_strfreev (env);
+	g_free (shell_env);
+
+	return FALSE; /* don't run again */
+
+failed:
+	_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+	                       "Failed to start a pooled shell: %s\n",
+	                       error->message);
+	g_error_free (error);
+	g_strfreev (env);
+	g_free (shell_env);
+
+	pool->spawn_failed = TRUE;
+
+	return FALSE; /* don't run again */
+}
+
+static void
+shell_pool_schedule_refill (ShellPool *pool)
+{
+	if (pool->refill_source_id != 0)
+		return;
+
+	/* Stay out of the way of the terminal that was just opened */
+	pool->refill_source_id = g_idle_add_full (G_PRIORITY_LOW,
+	                                          (GSourceFunc) shell_pool_refill_cb,
+	                                          pool, NULL);
+}
+
+static void
+shell_pool_profile_notify_cb (TerminalProfile *profile,
+                              GParamSpec      *pspec,
+                              ShellPool       *pool)
+{
+	const char *prop_name = pspec->name;
+
+	if (prop_name == I_(TERMINAL_PROFILE_WARM_POOL_SIZE))
+	{
+		int size = terminal_profile_get_snapshot (profile)->warm_pool_size;
+
+		while (g_queue_get_length (&pool->shells) > (guint) MAX (size, 0))
+			pooled_shell_drop (g_queue_pop_tail (&pool->shells));
+	}
+	else if (prop_name == I_(TERMINAL_PROFILE_USE_CUSTOM_COMMAND) ||
+	         prop_name == I_(TERMINAL_PROFILE_CUSTOM_COMMAND) ||
+	         prop_name == I_(TERMINAL_PROFILE_LOGIN_SHELL) ||
+	         prop_name == I_(TERMINAL_PROFILE_DEFAULT_SIZE_COLUMNS) ||
+	         prop_name == I_(TERMINAL_PROFILE_DEFAULT_SIZE_ROWS))
+	{
+		/* The pooled shells were started with the old settings */
+		shell_pool_clear (pool);
+	}
+	else
+		return;
+
+	pool->spawn_failed = FALSE;
+	shell_pool_schedule_refill (pool);
+}
+
+static void
+shell_pool_profile_forgotten_cb (TerminalProfile *profile,
+                                 ShellPool       *pool)
+{
+	g_hash_table_remove (pool->app->shell_pools, profile);
+}
+
+static ShellPool *
+shell_pool_new (TerminalApp     *app,
+                TerminalProfile *profile)
+{
+	ShellPool *pool;
+
+	pool = g_slice_new0 (ShellPool);
+	pool->app = app;
+	pool->profile = g_object_ref (profile);
+	g_queue_init (&pool->shells);
+
+	g_signal_connect (profile, "notify",
+	                  G_CALLBACK (shell_pool_profile_notify_cb), pool);
+	g_signal_connect (profile, "forgotten",
+	                  G_CALLBACK (shell_pool_profile_forgotten_cb), pool);
+
+	return pool;
+}
+
+/**
+ * terminal_app_take_pooled_child:
+ * @app:
+ * @profile: the profile of the new terminal
+ * @working_dir: the working directory of the new terminal
+ * @initial_env: the initial environment of the new terminal, or %NULL
+ * @pty: return location for the pooled shell's #BtePty
+ * @pid: return location for the pooled shell's process id
+ *
+ * Hands over a pre-spawned shell for a new terminal, if the profile has a
+ * warm pool and a matching shell is ready. The caller owns the returned
+ * @pty and is responsible for watching @pid. Either way, the pool is
+ * refilled in the background.
+ *
+ * Returns: %TRUE if a pooled shell was handed over
+ */
+gboolean
+terminal_app_take_pooled_child (TerminalApp     *app,
+                                TerminalProfile *profile,
+                                const char      *working_dir,
+                                char           **initial_env,
+                                BtePty         **pty,
+                                GPid            *pid)
+{
+	ShellPool *pool;
+	PooledShell *shell;
+	GList *l;
+
+	if (terminal_profile_get_snapshot (profile)->warm_pool_size <= 0)
+		return FALSE;
+
+	pool = g_hash_table_lookup (app->shell_pools, profile);
+	if (pool == NULL)
+	{
+		pool = shell_pool_new (app, profile);
+		g_hash_table_insert (app->shell_pools, profile, pool);
+	}
+
+	for (l = pool->shells.head; l != NULL; l = l->next)
+	{
+		shell = l->data;
+
+		if (!pooled_shell_matches (shell, working_dir, initial_env))
+			continue;
+
+		g_queue_delete_link (&pool->shells, l);
+
+		/* The terminal watches the child from now on */
+		g_source_remove (shell->child_watch_id);
+
+		*pty = shell->pty;
+		*pid = shell->pid;
+		shell->pty = NULL;
+		pooled_shell_free (shell);
+
+		app->shell_pool_hits++;
+		shell_pool_print_stats (app, "hit");
+
+		shell_pool_schedule_refill (pool);
+
+		return TRUE;
+	}
+
+	app->shell_pool_misses++;
+	shell_pool_print_stats (app, "miss");
+
+	if (g_strcmp0 (pool->working_dir, working_dir) != 0 ||
+	    !strv_equal (pool->initial_env, initial_env))
+	{
+		/* Follow where new terminals are being opened */
+		g_free (pool->working_dir);
+		g_strfreev (pool->initial_env);
+		pool->working_dir = g_strdup (working_dir);
+		pool->initial_env = g_strdupv (initial_env);
+
+		while ((shell = g_queue_pop_head (&pool->shells)) != NULL)
+			pooled_shell_drop (shell);
+
+		pool->spawn_failed = FALSE;
+	}
+
+	shell_pool_schedule_refill (pool);
+
+	return FALSE;
+}
+
+/**
+ * terminal_app_get_system_font:
+ * @app:
+ *
+ * Returns: (transfer none): the monospace font from the desktop settings
+ */
+const PangoFontDescription *
+terminal_app_get_system_font (TerminalApp *app)
+{
+	return app->system_font_desc;
+}
+
+/**
+ * terminal_app_get_scaled_font:
+ * @app:
+ * @desc: a font
+ * @scale: the zoom factor
+ *
+ * Looks up @desc with its size multiplied by @scale, shared between all
+ * terminals showing the same font at the same zoom level.
+ *
+ * Returns: (transfer none): the scaled font, owned by @app and only valid
+ *   until the next call
+ */
+const PangoFontDescription *
+terminal_app_get_scaled_font (TerminalApp                *app,
+                              const PangoFontDescription *desc,
+                              double                      scale)
+{
+	ScaledFontKey lookup, *key;
+	PangoFontDescription *scaled;
+
+	lookup.desc = (PangoFontDescription *) desc;
+	lookup.scale = scale;
+
+	scaled = g_hash_table_lookup (app->font_cache, &lookup);
+	if (scaled != NULL)
+	{
+		app->font_cache_hits++;
+		return scaled;
+	}
+
+	app->font_cache_misses++;
+
+	/* Zoomed through many sizes, or many font changes; start over */
+	if (g_hash_table_size (app->font_cache) >= FONT_CACHE_MAX_SIZE)
+		g_hash_table_remove_all (app->font_cache);
+
+	scaled = pango_font_description_copy (desc);
+	if (pango_font_description_get_size_is_absolute (scaled))
+		pango_font_description_set_absolute_size (scaled,
+		        scale * pango_font_description_get_size (scaled));
+	else
+		pango_font_description_set_size (scaled,
+		                                 scale * pango_font_description_get_size (scaled));
+
+	key = g_slice_new (ScaledFontKey);
+	key->desc = pango_font_description_copy (desc);
+	key->scale = scale;
+	g_hash_table_insert (app->font_cache, key, scaled);
+
+	return scaled;
+}
+
+/**
+ * terminal_app_get_notifications_enabled:
+ * @app:
+ *
+ * Returns: the cached value of the global "notifications" setting
+ */
+gboolean
+terminal_app_get_notifications_enabled (TerminalApp *app)
+{
+	return app->enable_notifications;
+}
+
+/**
+ * terminal_app_get_scrollback_report:
+ * @app:
+ *
+ * Describes the estimated scrollback memory use of every terminal, for
+ * diagnostics. The usage figures are approximations; see
+ * terminal_screen_get_scrollback_usage().
+ *
+ * Returns: a floating #GVariant of type (ttta(stxx)): the budget in bytes
+ *   (0 for none), the estimated total, the number of times a terminal was
+ *   trimmed to stay within the budget, and for each terminal its title,
+ *   estimated bytes, number of scrollback lines, and scrollback limit
+ *   (-1 for none)
+ */
+GVariant *
+terminal_app_get_scrollback_report (TerminalApp *app)
+{
+	GVariantBuilder builder;
+	GArray *usages;
+	guint64 total;
+	guint i;
+
+	usages = terminal_app_collect_scrollback_usage (app, &total);
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(stxx)"));
+
+	for (i = 0; i < usages->len; ++i)
+	{
+		ScrollbackUsage *usage = &g_array_index (usages, ScrollbackUsage, i);
+		const char *title;
+
+		title = terminal_screen_get_title (usage->screen);
+
+		g_variant_builder_add (&builder, "(stxx)",
+		                       title ? title : "",
+		                       usage->usage,
+		                       (gint64) usage->lines,
+		                       (gint64) usage->cap);
+	}
+
+	g_array_free (usages, TRUE);
+
+	return g_variant_new ("(ttt@a(stxx))",
+	                      app->scrollback_budget,
+	                      total,
+	                      (guint64) app->scrollback_budget_trims,
+	                      g_variant_builder_end (&builder));
+}
+
+/**
+ * terminal_app_show_notification:
+ * @app:
+ * @body: the notification text
+ *
+ * Shows a desktop notification, unless notifications are disabled or
+ * another one was shown less than %NOTIFICATION_MIN_INTERVAL ago.
+ * libnotify is initialised on first use and kept until the app goes away.
+ *
+ * Returns: %TRUE if the notification was shown
+ */
+gboolean
+terminal_app_show_notification (TerminalApp *app,
+                                const char  *body)
+{
+	NotifyNotification *notification;
+	gint64 now;
+
+	if (!app->enable_notifications)
+		return FALSE;
+
+	now = g_get_monotonic_time ();
+	if (app->last_notification_time != 0 &&
+	    now - app->last_notification_time < NOTIFICATION_MIN_INTERVAL)
+	{
+		app->notifications_suppressed++;
+		return FALSE;
+	}
+
+	if (!app->notify_initialised)
+	{
+		if (!notify_init ("cafe-terminal"))
+			return FALSE;
+
+		app->notify_initialised = TRUE;
+	}
+
+	app->last_notification_time = now;
+
+	notification = notify_notification_new ("CAFE Terminal",
+	                                         body,
+	                                         CAFE_TERMINAL_ICON_NAME);
+	notify_notification_show (notification, NULL);
+	g_object_unref (notification);
+
+	app->notifications_shown++;
+
+	return TRUE;
+}
+
+/**
+ * terminal_app_record_spawn_latency:
+ * @app:
+ * @latency: time from deciding to launch a child to having its PID, in µs
+ *
+ * Counts a child launch in the spawn latency histogram. Shells taken from
+ * the pool don't go through here; see terminal_app_take_pooled_child().
+ */
+void
+terminal_app_record_spawn_latency (TerminalApp *app,
+                                   gint64       latency)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (spawn_latency_bounds) - 1; ++i)
+		if (latency < spawn_latency_bounds[i] * G_TIME_SPAN_MILLISECOND)
+			break;
+
+	app->spawn_latency_counts[i]++;
+}
+
+/**
+ * terminal_app_get_stat:
+ * @app:
+ * @name: the name of a property of the org.cafe.Terminal.Stats interface
+ *
+ * Computes the current value of a runtime metric, for monitoring.
+ *
+ * Returns: a floating #GVariant, or %NULL if @name is unknown
+ */
+GVariant *
+terminal_app_get_stat (TerminalApp *app,
+                       const char  *name)
+{
+	GVariantBuilder builder;
+	guint i;
+
+	if (g_strcmp0 (name, "Windows") == 0)
+		return g_variant_new_uint32 (g_list_length (app->windows));
+
+	if (g_strcmp0 (name, "Screens") == 0)
+		return g_variant_new_uint32 (g_hash_table_size (app->foregrounds));
+
+	if (g_strcmp0 (name, "ScreenStats") == 0)
+	{
+		GHashTableIter iter;
+		gpointer key;
+
+		g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sittx)"));
+
+		g_hash_table_iter_init (&iter, app->foregrounds);
+		while (g_hash_table_iter_next (&iter, &key, NULL))
+		{
+			TerminalScreen *screen = TERMINAL_SCREEN (key);
+			const char *title;
+			guint64 usage;
+			glong lines, columns;
+
+			title = terminal_screen_get_title (screen);
+			terminal_screen_get_scrollback_usage (screen, &lines, &columns, NULL, NULL);
+			usage = (guint64) lines * columns * SCROLLBACK_BYTES_PER_CELL;
+
+			g_variant_builder_add (&builder, "(sittx)",
+			                       title ? title : "",
+			                       (gint32) terminal_screen_get_pid (screen),
+			                       terminal_screen_get_output_events (screen),
+			                       usage,
+			                       (gint64) lines);
+		}
+
+		return g_variant_builder_end (&builder);
+	}
+
+	if (g_strcmp0 (name, "SpawnLatency") == 0)
+	{
+		g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(xu)"));
+
+		for (i = 0; i < G_N_ELEMENTS (spawn_latency_bounds); ++i)
+			g_variant_builder_add (&builder, "(xu)",
+			                       spawn_latency_bounds[i] < 0 ? (gint64) -1 : spawn_latency_bounds[i] * G_TIME_SPAN_MILLISECOND,
+			                       app->spawn_latency_counts[i]);
+
+		return g_variant_builder_end (&builder);
+	}
+
+	if (g_strcmp0 (name, "NotificationsShown") == 0)
+		return g_variant_new_uint32 (app->notifications_shown);
+
+	if (g_strcmp0 (name, "NotificationsSuppressed") == 0)
+		return g_variant_new_uint32 (app->notifications_suppressed);
+
+	if (g_strcmp0 (name, "ProfileNotifies") == 0)
+		return g_variant_new_uint64 (_terminal_screen_get_n_profile_notifies ());
+
+	if (g_strcmp0 (name, "TitlesSuppressed") == 0)
+		return g_variant_new_uint64 (_terminal_screen_get_n_titles_suppressed ());
+
+	if (g_strcmp0 (name, "ShellPool") == 0)
+		return g_variant_new ("(uuu)",
+		                      app->shell_pool_hits,
+		                      app->shell_pool_misses,
+		                      app->shell_pool_refills);
+
+	if (g_strcmp0 (name, "FontCache") == 0)
+		return g_variant_new ("(uu)",
+		                      app->font_cache_hits,
+		                      app->font_cache_misses);
+
+	if (g_strcmp0 (name, "EnvironmentTemplate") == 0)
+		return g_variant_new ("(uu)",
+		                      app->env_template_hits,
+		                      app->env_template_misses);
+
+	if (g_strcmp0 (name, "LogLinesDropped") == 0)
+		return g_variant_new_uint32 (terminal_logger_get_total_dropped ());
+
+	return NULL;
+}
+
+/* Foreground process monitor */
+
+struct _ForegroundInfo
+{
+	GPid pgid;            /* foreground process group other than the child's, or -1 */
+	char *name;           /* name of its leader, or NULL */
+	guint64 start_time;   /* start time of its leader, in clock ticks since boot */
+	gboolean dirty;       /* sample on the next activity pass */
+};
+
+static void
+foreground_info_free (ForegroundInfo *info)
+{
+	g_free (info->name);
+	g_slice_free (ForegroundInfo, info);
+}
+
+static char *
+process_name (GPid pid)
+{
+	char filename[64];
+	char *cmdline, *basename, *name;
+
+	g_snprintf (filename, sizeof (filename), "/proc/%d/cmdline", pid);
+	if (!g_file_get_contents (filename, &cmdline, NULL, NULL))
+		return NULL;
+
+	basename = g_path_get_basename (cmdline);
+	g_free (cmdline);
+
+	name = g_filename_to_utf8 (basename, -1, NULL, NULL, NULL);
+	g_free (basename);
+
+	return name;
+}
+
+static guint64
+process_start_time (GPid pid)
+{
+	char filename[64];
+	char *contents, *p;
+	guint64 start_time = 0;
+	int i;
+
+	g_snprintf (filename, sizeof (filename), "/proc/%d/stat", pid);
+	if (!g_file_get_contents (filename, &contents, NULL, NULL))
+		return 0;
+
+	/* The command name may contain spaces; the fields after it don't.
+	 * The start time is the 22nd field.
+	 */
+	p = strrchr (contents, ')');
+	for (i = 3; p != NULL && i <= 22; i++)
+		p = strchr (p + 1, ' ');
+	if (p != NULL)
+		start_time = g_ascii_strtoull (p + 1, NULL, 10);
+
+	g_free (contents);
+
+	return start_time;
+}
+
+/* Samples the foreground process of @screen, and returns whether it changed */
+static gboolean
+terminal_app_sample_foreground (TerminalApp    *app,
+                                TerminalScreen *screen,
+                                ForegroundInfo *info)
+{
+	GPid pgid;
+	gboolean was_busy;
+
+	info->dirty = FALSE;
+
+	/* Only a change of process group is noticed; /proc is not read
+	 * otherwise. A pid recycled between two samples goes unnoticed.
+	 */
+	pgid = _terminal_screen_probe_foreground_pgid (screen);
+	if (pgid == info->pgid)
+		return FALSE;
+
+	was_busy = info->pgid != -1;
+
+	g_free (info->name);
+	info->pgid = pgid;
+	info->start_time = pgid != -1 ? process_start_time (pgid) : 0;
+	info->name = pgid != -1 ? process_name (pgid) : NULL;
+
+	_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+	                       "[screen %p] foreground process is now %d (%s)\n",
+	                       screen, (int) pgid, info->name ? info->name : "none");
+
+	/* Only notify on the busy -> idle transition */
+	if (was_busy && pgid == -1)
+	{
+		TerminalWindow *window;
+
+		window = terminal_screen_get_window (screen);
+		if (window != NULL && !ctk_window_is_active (CTK_WINDOW (window)))
+			terminal_app_show_notification (app, _("Process completed"));
+	}
+
+	return TRUE;
+}
+
+/* Samples the screens marked dirty, or all of them, in one pass */
+static void
+terminal_app_sample_foregrounds (TerminalApp *app,
+                                 gboolean     all)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	GPtrArray *changed;
+	guint i, n_sampled = 0;
+
+	changed = g_ptr_array_new ();
+
+	g_hash_table_iter_init (&iter, app->foregrounds);
+	while (g_hash_table_iter_next (&iter, &key, &value))
+	{
+		ForegroundInfo *info = value;
+
+		if (!all && !info->dirty)
+			continue;
+
+		n_sampled++;
+		if (terminal_app_sample_foreground (app, key, info))
+			g_ptr_array_add (changed, key);
+	}
+
+	_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+	                       "Sampled %u of %u terminals, %u foreground changes\n",
+	                       n_sampled, g_hash_table_size (app->foregrounds), changed->len);
+
+	/* Emit after the pass, so handlers see a consistent state */
+	for (i = 0; i < changed->len; i++)
+		g_signal_emit_by_name (g_ptr_array_index (changed, i), "foreground-changed");
+
+	g_ptr_array_free (changed, TRUE);
+}
+
+static gboolean
+terminal_app_foreground_activity_cb (TerminalApp *app)
+{
+	app->foreground_activity_source_id = 0;
+
+	terminal_app_sample_foregrounds (app, FALSE);
+
+	return FALSE; /* don't run again */
+}
+
+static gboolean
+terminal_app_foreground_poll_cb (TerminalApp *app)
+{
+	terminal_app_sample_foregrounds (app, TRUE);
+
+	return TRUE; /* run again */
+}
+
+/**
+ * terminal_app_monitor_screen:
+ * @app:
+ * @screen:
+ *
+ * Starts tracking the foreground process of @screen.
+ */
+void
+terminal_app_monitor_screen (TerminalApp    *app,
+                             TerminalScreen *screen)
+{
+	ForegroundInfo *info;
+
+	if (g_hash_table_contains (app->foregrounds, screen))
+		return;
+
+	info = g_slice_new0 (ForegroundInfo);
+	info->pgid = -1;
+	g_hash_table_insert (app->foregrounds, screen, info);
+
+	if (app->foreground_poll_source_id == 0)
+		app->foreground_poll_source_id =
+			g_timeout_add_seconds (FOREGROUND_POLL_INTERVAL,
+			                       (GSourceFunc) terminal_app_foreground_poll_cb,
+			                       app);
+}
+
+/**
+ * terminal_app_unmonitor_screen:
+ * @app:
+ * @screen:
+ *
+ * Stops tracking the foreground process of @screen.
+ */
+void
+terminal_app_unmonitor_screen (TerminalApp    *app,
+                               TerminalScreen *screen)
+{
+	if (!g_hash_table_remove (app->foregrounds, screen))
+		return;
+
+	if (g_hash_table_size (app->foregrounds) == 0 &&
+	    app->foreground_poll_source_id != 0)
+	{
+		g_source_remove (app->foreground_poll_source_id);
+		app->foreground_poll_source_id = 0;
+	}
+}
+
+/**
+ * terminal_app_queue_foreground_check:
+ * @app:
+ * @screen:
+ *
+ * Marks @screen as having had PTY activity; its foreground process is
+ * sampled, along with that of the other active terminals, once output has
+ * settled for %FOREGROUND_ACTIVITY_DELAY.
+ */
+void
+terminal_app_queue_foreground_check (TerminalApp    *app,
+                                     TerminalScreen *screen)
+{
+	ForegroundInfo *info;
+
+	info = g_hash_table_lookup (app->foregrounds, screen);
+	if (info == NULL)
+		return;
+
+	info->dirty = TRUE;
+
+	/* Coalesce bursts of output into a single pass */
+	if (app->foreground_activity_source_id != 0)
+		return;
+
+	app->foreground_activity_source_id =
+		g_timeout_add (FOREGROUND_ACTIVITY_DELAY,
+		               (GSourceFunc) terminal_app_foreground_activity_cb,
+		               app);
+}
+
+/**
+ * terminal_app_check_foreground:
+ * @app:
+ * @screen:
+ *
+ * Samples the foreground process of @screen right away, so that the cached
+ * state is current e.g. before asking whether to close it.
+ */
+void
+terminal_app_check_foreground (TerminalApp    *app,
+                               TerminalScreen *screen)
+{
+	ForegroundInfo *info;
+
+	info = g_hash_table_lookup (app->foregrounds, screen);
+	if (info == NULL)
+		return;
+
+	if (terminal_app_sample_foreground (app, screen, info))
+		g_signal_emit_by_name (screen, "foreground-changed");
+}
+
+/**
+ * terminal_app_get_foreground_process:
+ * @app:
+ * @screen:
+ * @name: (allow-none): return location for the process name, or %NULL;
+ *   owned by @app, and %NULL if unknown
+ * @start_time: (allow-none): return location for the process start time
+ *   in clock ticks since boot, or %NULL; 0 if unknown
+ *
+ * Looks up the cached foreground process of @screen, as of the last sample.
+ *
+ * Returns: the foreground process group of @screen if it is not the child's
+ *   own, or -1
+ */
+GPid
+terminal_app_get_foreground_process (TerminalApp     *app,
+                                     TerminalScreen  *screen,
+                                     const char     **name,
+                                     guint64         *start_time)
+{
+	ForegroundInfo *info;
+
+	info = g_hash_table_lookup (app->foregrounds, screen);
+
+	if (name)
+		*name = info ? info->name : NULL;
+	if (start_time)
+		*start_time = info ? info->start_time : 0;
+
+	return info ? info->pgid : -1;
+}
+
 void
 terminal_app_save_config (TerminalApp *app,
                           GKeyFile *key_file)
@@ -153,6 +153,60 @@ GHashTable *terminal_app_get_encodings (TerminalApp *app);
 
 GSList* terminal_app_get_active_encodings (TerminalApp *app);
 
+GHashTable *terminal_app_dup_child_environment (TerminalApp *app);
+
+void terminal_app_add_proxy_env (TerminalApp *app,
+                                 GHashTable  *env_table);
+
+char **terminal_app_get_child_environment (TerminalApp *app,
+                                           char       **initial_env,
+                                           CdkDisplay  *display,
+                                           gulong       window_xid,
+                                           char       **shell);
+
+gboolean terminal_app_take_pooled_child (TerminalApp     *app,
+                                         TerminalProfile *profile,
+                                         const char      *working_dir,
+                                         char           **initial_env,
+                                         BtePty         **pty,
+                                         GPid            *pid);
+
+const PangoFontDescription *terminal_app_get_system_font (TerminalApp *app);
+
+const PangoFontDescription *terminal_app_get_scaled_font (TerminalApp                *app,
+                                                          const PangoFontDescription *desc,
+                                                          double                      scale);
+
+gboolean terminal_app_get_notifications_enabled (TerminalApp *app);
+
+void terminal_app_monitor_screen (TerminalApp    *app,
+                                  TerminalScreen *screen);
+
+void terminal_app_unmonitor_screen (TerminalApp    *app,
+                                    TerminalScreen *screen);
+
+void terminal_app_queue_foreground_check (TerminalApp    *app,
+                                          TerminalScreen *screen);
+
+void terminal_app_check_foreground (TerminalApp    *app,
+                                    TerminalScreen *screen);
+
+GPid terminal_app_get_foreground_process (TerminalApp     *app,
+                                          TerminalScreen  *screen,
+                                          const char     **name,
+                                          guint64         *start_time);
+
+GVariant *terminal_app_get_scrollback_report (TerminalApp *app);
+
+void terminal_app_record_spawn_latency (TerminalApp *app,
+                                        gint64       latency);
+
+GVariant *terminal_app_get_stat (TerminalApp *app,
+                                 const char  *name);
+
+gboolean terminal_app_show_notification (TerminalApp *app,
+                                         const char  *body);
+
 void terminal_app_save_config (TerminalApp *app,
                                GKeyFile *key_file);
 
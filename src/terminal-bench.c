@@ -0,0 +1,239 @@
+/*
+ * Copyright © 2026 CAFE developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Micro-benchmarks for the hot paths of the terminal, run outside of the
+ * terminal itself. Build with "make cafe-terminal-bench" after "make" and run
+ *
+ *   ./cafe-terminal-bench [BENCHMARK...]
+ *
+ * on an X display; without arguments all benchmarks are run. Settings are
+ * read from a memory backend, so the user's profiles are left alone.
+ */
+
+#include <config.h>
+
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ctk/ctk.h>
+
+#include "terminal-app.h"
+#include "terminal-debug.h"
+#include "terminal-profile.h"
+#include "terminal-screen.h"
+
+typedef struct
+{
+	const char *name;
+	void (* run) (void);
+} TerminalBenchmark;
+
+/* Reads four properties through the by-name accessors and through the
+ * snapshot, see terminal_profile_get_snapshot() */
+static void
+bench_profile_accessors (void)
+{
+	const guint n_iterations = 100000;
+	TerminalProfile *profile;
+	const TerminalProfileSnapshot *snapshot;
+	volatile int sink = 0;
+	gint64 start, by_name, by_snapshot;
+	guint i;
+
+	profile = terminal_app_get_profile_for_new_term (terminal_app_get ());
+
+	start = g_get_monotonic_time ();
+	for (i = 0; i < n_iterations; ++i)
+	{
+		sink += terminal_profile_get_property_enum (profile, TERMINAL_PROFILE_TITLE_MODE);
+		sink += terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_USE_URLS);
+		sink += terminal_profile_get_property_int (profile, TERMINAL_PROFILE_SCROLLBACK_LINES);
+		sink += terminal_profile_get_property_string (profile, TERMINAL_PROFILE_TITLE) != NULL;
+	}
+	by_name = g_get_monotonic_time () - start;
+
+	snapshot = terminal_profile_get_snapshot (profile);
+	start = g_get_monotonic_time ();
+	for (i = 0; i < n_iterations; ++i)
+	{
+		sink += snapshot->title_mode;
+		sink += snapshot->use_urls;
+		sink += snapshot->scrollback_lines;
+		sink += snapshot->title != NULL;
+	}
+	by_snapshot = g_get_monotonic_time () - start;
+
+	g_print ("%u x 4 reads: by name %" G_GINT64_FORMAT " us, snapshot %" G_GINT64_FORMAT " us\n",
+	         n_iterations, by_name, by_snapshot);
+}
+
+/* Creates 500 profiles, as the profile list does at startup, and then
+ * reads the settings they defer until first use, see
+ * terminal_profile_ensure_loaded() */
+static void
+bench_profile_startup (void)
+{
+	const guint n_profiles = 500;
+	TerminalProfile **profiles;
+	gint64 start, created, loaded;
+	guint i;
+
+	profiles = g_new (TerminalProfile *, n_profiles);
+
+	start = g_get_monotonic_time ();
+	for (i = 0; i < n_profiles; ++i)
+	{
+		char *name;
+
+		name = g_strdup_printf ("bench-%u", i);
+		profiles[i] = _terminal_profile_new (name);
+		g_free (name);
+	}
+	created = g_get_monotonic_time () - start;
+
+	start = g_get_monotonic_time ();
+	for (i = 0; i < n_profiles; ++i)
+		terminal_profile_get_snapshot (profiles[i]);
+	loaded = g_get_monotonic_time () - start;
+
+	for (i = 0; i < n_profiles; ++i)
+		g_object_unref (profiles[i]);
+	g_free (profiles);
+
+	g_print ("%u profiles: created in %" G_GINT64_FORMAT " us, loading them all takes another %" G_GINT64_FORMAT " us\n",
+	         n_profiles, created, loaded);
+}
+
+static void
+bench_drain_events (void)
+{
+	while (ctk_events_pending ())
+		ctk_main_iteration ();
+}
+
+/* Switches between the light and the dark theme with 200 tabs open, see
+ * update_color_scheme() in terminal-screen.c */
+static void
+bench_theme_switch (void)
+{
+	const guint n_screens = 200;
+	const guint n_switches = 10;
+	TerminalProfile *profile;
+	CtkSettings *settings;
+	CtkWidget *window, *notebook;
+	gboolean dark;
+	gint64 start, elapsed;
+	guint i;
+
+	profile = terminal_app_get_profile_for_new_term (terminal_app_get ());
+
+	window = ctk_window_new (CTK_WINDOW_TOPLEVEL);
+	notebook = ctk_notebook_new ();
+	ctk_container_add (CTK_CONTAINER (window), notebook);
+
+	for (i = 0; i < n_screens; ++i)
+	{
+		TerminalScreen *screen;
+
+		screen = terminal_screen_new (profile, NULL, NULL, NULL, NULL, 1.0);
+		/* No shells are needed */
+		terminal_screen_defer_launch_child (screen, 0);
+		ctk_notebook_append_page (CTK_NOTEBOOK (notebook), CTK_WIDGET (screen), NULL);
+	}
+
+	ctk_widget_show_all (window);
+	bench_drain_events ();
+
+	settings = ctk_settings_get_default ();
+	g_object_get (settings, "ctk-application-prefer-dark-theme", &dark, NULL);
+
+	start = g_get_monotonic_time ();
+	for (i = 0; i < n_switches; ++i)
+	{
+		dark = !dark;
+		g_object_set (settings, "ctk-application-prefer-dark-theme", dark, NULL);
+		bench_drain_events ();
+	}
+	elapsed = g_get_monotonic_time () - start;
+
+	ctk_widget_destroy (window);
+	bench_drain_events ();
+
+	g_print ("%u tabs: %" G_GINT64_FORMAT " us per theme switch\n",
+	         n_screens, elapsed / n_switches);
+}
+
+static const TerminalBenchmark benchmarks[] =
+{
+	{ "profile-accessors", bench_profile_accessors },
+	{ "profile-startup", bench_profile_startup },
+	{ "theme-switch", bench_theme_switch },
+};
+
+int
+main (int argc, char **argv)
+{
+	guint i;
+	int j, ret = EXIT_SUCCESS;
+
+	setlocale (LC_ALL, "");
+
+	/* Never touch the user's settings */
+	g_setenv ("GSETTINGS_BACKEND", "memory", TRUE);
+
+	_terminal_debug_init ();
+
+	cdk_set_allowed_backends ("x11");
+	ctk_init (&argc, &argv);
+
+	for (j = 1; j < argc; ++j)
+	{
+		for (i = 0; i < G_N_ELEMENTS (benchmarks); ++i)
+			if (strcmp (argv[j], benchmarks[i].name) == 0)
+				break;
+
+		if (i == G_N_ELEMENTS (benchmarks))
+		{
+			g_printerr ("Unknown benchmark “%s”\n", argv[j]);
+			ret = EXIT_FAILURE;
+		}
+	}
+
+	if (ret != EXIT_SUCCESS)
+		return ret;
+
+	for (i = 0; i < G_N_ELEMENTS (benchmarks); ++i)
+	{
+		gboolean selected = argc == 1;
+
+		for (j = 1; j < argc && !selected; ++j)
+			selected = strcmp (argv[j], benchmarks[i].name) == 0;
+
+		if (!selected)
+			continue;
+
+		g_print ("%s: ", benchmarks[i].name);
+		benchmarks[i].run ();
+	}
+
+	terminal_app_shutdown ();
+
+	return ret;
+}
@@ -24,6 +24,25 @@
 
 TerminalDebugFlags _terminal_debug_flags;
 
+static const char * const startup_phase_names[TERMINAL_STARTUP_N_PHASES] =
+{
+	"main",
+	"options-parsed",
+	"ctk-init",
+	"bus-name-acquired",
+	"app-profiles",
+	"app-encodings",
+	"app-accels",
+	"app-init",
+	"window-created",
+	"window-realized",
+	"child-spawned",
+	"first-output"
+};
+
+/* Monotonic time each phase was first reached, 0 if not yet */
+static gint64 startup_times[TERMINAL_STARTUP_N_PHASES];
+
 void
 _terminal_debug_init(void)
 {
@@ -36,7 +55,8 @@ _terminal_debug_init(void)
 		{ "geometry",  TERMINAL_DEBUG_GEOMETRY  },
 		{ "mdi",       TERMINAL_DEBUG_MDI       },
 		{ "processes", TERMINAL_DEBUG_PROCESSES },
-		{ "profile",   TERMINAL_DEBUG_PROFILE   }
+		{ "profile",   TERMINAL_DEBUG_PROFILE   },
+		{ "startup",   TERMINAL_DEBUG_STARTUP   }
 	};
 
 	_terminal_debug_flags = g_parse_debug_string (g_getenv ("CAFE_TERMINAL_DEBUG"),
@@ -44,3 +64,76 @@ _terminal_debug_init(void)
 #endif /* CAFE_ENABLE_DEBUG */
 }
 
+static void
+_terminal_startup_print (void)
+{
+	gint64 previous;
+	guint i;
+
+	g_printerr ("Startup timeline (ms since main, ms since previous phase):\n");
+
+	previous = startup_times[TERMINAL_STARTUP_MAIN];
+	for (i = 0; i < TERMINAL_STARTUP_N_PHASES; ++i)
+	{
+		if (startup_times[i] == 0)
+			continue;
+
+		g_printerr ("  %-20s %8.1f %8.1f\n",
+		            startup_phase_names[i],
+		            (startup_times[i] - startup_times[TERMINAL_STARTUP_MAIN]) / 1000.0,
+		            (startup_times[i] - previous) / 1000.0);
+		previous = startup_times[i];
+	}
+}
+
+/**
+ * _terminal_startup_mark:
+ * @phase: the startup phase that was just reached
+ *
+ * Records the first time @phase is reached. Once the first output from a
+ * child has been seen, the timeline is printed if the "startup" debug
+ * flag is set.
+ */
+void
+_terminal_startup_mark (TerminalStartupPhase phase)
+{
+	g_return_if_fail (phase < TERMINAL_STARTUP_N_PHASES);
+
+	if (G_LIKELY (startup_times[phase] != 0))
+		return;
+
+	startup_times[phase] = g_get_monotonic_time ();
+
+	if (phase == TERMINAL_STARTUP_FIRST_OUTPUT)
+	{
+		_TERMINAL_DEBUG_IF (TERMINAL_DEBUG_STARTUP)
+			_terminal_startup_print ();
+	}
+}
+
+/**
+ * _terminal_startup_get_timeline:
+ *
+ * Returns: a floating #GVariant of type a(sx), listing the phases reached
+ *   so far with their time in microseconds since main() started
+ */
+GVariant *
+_terminal_startup_get_timeline (void)
+{
+	GVariantBuilder builder;
+	guint i;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sx)"));
+
+	for (i = 0; i < TERMINAL_STARTUP_N_PHASES; ++i)
+	{
+		if (startup_times[i] == 0)
+			continue;
+
+		g_variant_builder_add (&builder, "(sx)",
+		                       startup_phase_names[i],
+		                       startup_times[i] - startup_times[TERMINAL_STARTUP_MAIN]);
+	}
+
+	return g_variant_builder_end (&builder);
+}
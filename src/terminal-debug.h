@@ -33,11 +33,34 @@ typedef enum
     TERMINAL_DEBUG_GEOMETRY   = 1 << 3,
     TERMINAL_DEBUG_MDI        = 1 << 4,
     TERMINAL_DEBUG_PROCESSES  = 1 << 5,
-    TERMINAL_DEBUG_PROFILE    = 1 << 6
+    TERMINAL_DEBUG_PROFILE    = 1 << 6,
+    TERMINAL_DEBUG_STARTUP    = 1 << 7
 } TerminalDebugFlags;
 
 void _terminal_debug_init(void);
 
+/* Startup timeline, in the order the phases are reached */
+typedef enum
+{
+    TERMINAL_STARTUP_MAIN,
+    TERMINAL_STARTUP_OPTIONS_PARSED,
+    TERMINAL_STARTUP_CTK_INIT,
+    TERMINAL_STARTUP_BUS_NAME_ACQUIRED,
+    TERMINAL_STARTUP_APP_PROFILES,
+    TERMINAL_STARTUP_APP_ENCODINGS,
+    TERMINAL_STARTUP_APP_ACCELS,
+    TERMINAL_STARTUP_APP_INIT,
+    TERMINAL_STARTUP_WINDOW_CREATED,
+    TERMINAL_STARTUP_WINDOW_REALIZED,
+    TERMINAL_STARTUP_CHILD_SPAWNED,
+    TERMINAL_STARTUP_FIRST_OUTPUT,
+    TERMINAL_STARTUP_N_PHASES
+} TerminalStartupPhase;
+
+void _terminal_startup_mark (TerminalStartupPhase phase);
+
+GVariant *_terminal_startup_get_timeline (void);
+
 extern TerminalDebugFlags _terminal_debug_flags;
 static inline gboolean _terminal_debug_on (TerminalDebugFlags flags) G_GNUC_CONST G_GNUC_UNUSED;
 
@@ -114,3 +114,20 @@ terminal_info_bar_format_text (TerminalInfoBar *bar,
 	ctk_box_pack_start (CTK_BOX (priv->content_box), label, FALSE, FALSE, 0);
 	ctk_widget_show_all (priv->content_box);
 }
+
+/**
+ * terminal_info_bar_add_widget:
+ * @bar: a #TerminalInfoBar
+ * @widget: a #CtkWidget
+ *
+ * Adds @widget below the text of @bar.
+ */
+void
+terminal_info_bar_add_widget (TerminalInfoBar *bar,
+                              CtkWidget *widget)
+{
+	g_return_if_fail (TERMINAL_IS_INFO_BAR (bar));
+
+	ctk_box_pack_start (CTK_BOX (bar->priv->content_box), widget, FALSE, FALSE, 0);
+	ctk_widget_show (widget);
+}
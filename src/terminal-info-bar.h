@@ -57,6 +57,9 @@ void terminal_info_bar_format_text (TerminalInfoBar *bar,
                                     const char *format,
                                     ...) G_GNUC_PRINTF (2, 3);
 
+void terminal_info_bar_add_widget (TerminalInfoBar *bar,
+                                   CtkWidget *widget);
+
 G_END_DECLS
 
 #endif /* !TERMINAL_INFO_BAR_H */
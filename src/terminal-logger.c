@@ -0,0 +1,499 @@
+/*
+ * Copyright © 2026 CAFE developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "terminal-debug.h"
+#include "terminal-logger.h"
+
+/* Size of the buffer between the main thread and the writer, per logger;
+ * a power of two */
+#define LOGGER_RING_SIZE (1 << 18)
+
+/* How often the writer wakes up to write out what has accumulated */
+#define LOGGER_FLUSH_INTERVAL (250 * G_TIME_SPAN_MILLISECOND)
+
+/* Number of rotated files kept besides the current one */
+#define LOGGER_KEEP_FILES (5)
+
+/* How long terminal_logger_shutdown() waits for the writer */
+#define LOGGER_SHUTDOWN_TIMEOUT (2 * G_TIME_SPAN_SECOND)
+
+/* The main thread appends to the ring and only moves @head; the writer
+ * thread only moves @tail. Neither ever waits for the other: when the
+ * ring is full, the main thread drops the output and counts it.
+ *
+ * A single writer thread serves all loggers. Once closed, a logger
+ * belongs to the writer, which frees it after writing out what is left.
+ * At shutdown the writer finishes the loggers before their owners close
+ * them; then whichever of the two comes last frees the logger.
+ */
+struct _TerminalLogger
+{
+	char *ring; /* allocated on the first append */
+	gint head; /* guint, accessed atomically */
+	gint tail; /* guint, accessed atomically */
+	gint dropped; /* lines, accessed atomically */
+
+	/* Protected by writer_lock */
+	gboolean stopping; /* finish once the ring is empty */
+	gboolean released; /* closed by its owner */
+	gboolean finished; /* the writer is done with it */
+
+	char *directory;
+	char *name;
+	gboolean compress;
+	guint64 max_size;
+
+	/* Only used by the writer thread */
+	GOutputStream *stream;
+	guint64 written;
+};
+
+/* The loggers the writer still has to finish, and the writer itself */
+static GMutex writer_lock;
+static GCond writer_cond;
+static GCond writer_done_cond; /* writer_loggers became empty */
+static GList *writer_loggers = NULL;
+static gboolean writer_wakeup = FALSE;
+static GThread *writer_thread = NULL;
+
+/* Lines dropped by all loggers so far, accessed atomically */
+static gint total_dropped = 0;
+
+static char *
+terminal_logger_get_path (TerminalLogger *logger,
+                          guint           index)
+{
+	char *basename, *path;
+
+	if (index == 0)
+		basename = g_strdup_printf ("%s.log%s", logger->name,
+		                            logger->compress ? ".gz" : "");
+	else
+		basename = g_strdup_printf ("%s.%u.log%s", logger->name, index,
+		                            logger->compress ? ".gz" : "");
+
+	path = g_build_filename (logger->directory, basename, NULL);
+	g_free (basename);
+
+	return path;
+}
+
+/* Runs in the writer thread */
+static GOutputStream *
+terminal_logger_open (TerminalLogger *logger)
+{
+	GFile *file;
+	GFileOutputStream *file_stream;
+	GOutputStream *stream;
+	GError *error = NULL;
+	char *path;
+	guint i;
+
+	if (g_mkdir_with_parents (logger->directory, 0700) != 0)
+	{
+		_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+		                       "Logger: can't create %s\n", logger->directory);
+		return NULL;
+	}
+
+	/* Shift the older files up, the oldest one falls off the end */
+	for (i = LOGGER_KEEP_FILES; i > 0; --i)
+	{
+		char *from, *to;
+
+		from = terminal_logger_get_path (logger, i - 1);
+		to = terminal_logger_get_path (logger, i);
+		g_rename (from, to);
+		g_free (from);
+		g_free (to);
+	}
+
+	path = terminal_logger_get_path (logger, 0);
+	file = g_file_new_for_path (path);
+	file_stream = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_PRIVATE, NULL, &error);
+	g_object_unref (file);
+
+	if (!file_stream)
+	{
+		_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+		                       "Logger: can't open %s: %s\n", path, error->message);
+		g_error_free (error);
+		g_free (path);
+		return NULL;
+	}
+
+	_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+	                       "Logger: writing to %s\n", path);
+	g_free (path);
+
+	if (!logger->compress)
+		return G_OUTPUT_STREAM (file_stream);
+
+	{
+		GZlibCompressor *compressor;
+
+		compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+		stream = g_converter_output_stream_new (G_OUTPUT_STREAM (file_stream),
+		                                        G_CONVERTER (compressor));
+		g_object_unref (compressor);
+		g_object_unref (file_stream);
+	}
+
+	return stream;
+}
+
+static void
+terminal_logger_free (TerminalLogger *logger)
+{
+	g_free (logger->ring);
+	g_free (logger->directory);
+	g_free (logger->name);
+	g_slice_free (TerminalLogger, logger);
+}
+
+/* Runs in the writer thread. Writes out what is queued in the ring of
+ * @logger, using @chunk as a buffer of LOGGER_RING_SIZE bytes. */
+static void
+terminal_logger_flush (TerminalLogger *logger,
+                       char           *chunk)
+{
+	GError *error = NULL;
+	guint head, tail, avail, offset, first;
+
+	head = (guint) g_atomic_int_get (&logger->head);
+	tail = (guint) g_atomic_int_get (&logger->tail);
+	avail = head - tail;
+
+	if (avail == 0)
+		return;
+
+	offset = tail & (LOGGER_RING_SIZE - 1);
+	first = MIN (avail, LOGGER_RING_SIZE - offset);
+	memcpy (chunk, logger->ring + offset, first);
+	memcpy (chunk + first, logger->ring, avail - first);
+
+	/* Hand the space back before the slow part */
+	g_atomic_int_set (&logger->tail, (gint) head);
+
+	if (logger->stream && logger->written >= logger->max_size)
+	{
+		g_output_stream_close (logger->stream, NULL, NULL);
+		g_clear_object (&logger->stream);
+	}
+
+	if (!logger->stream)
+	{
+		logger->stream = terminal_logger_open (logger);
+		logger->written = 0;
+	}
+
+	if (!logger->stream)
+		return;
+
+	if (!g_output_stream_write_all (logger->stream, chunk, avail, NULL, NULL, &error))
+	{
+		_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+		                       "Logger: write failed: %s\n", error->message);
+		g_error_free (error);
+		g_clear_object (&logger->stream);
+		return;
+	}
+
+	logger->written += avail;
+}
+
+static gpointer
+terminal_logger_thread (gpointer data G_GNUC_UNUSED)
+{
+	char *chunk;
+
+	chunk = g_malloc (LOGGER_RING_SIZE);
+
+	g_mutex_lock (&writer_lock);
+
+	for (;;)
+	{
+		GList *loggers, *l;
+
+		if (!writer_loggers)
+			g_cond_wait (&writer_cond, &writer_lock);
+		else if (!writer_wakeup)
+			g_cond_wait_until (&writer_cond, &writer_lock,
+			                   g_get_monotonic_time () + LOGGER_FLUSH_INTERVAL);
+		writer_wakeup = FALSE;
+
+		loggers = g_list_copy (writer_loggers);
+
+		for (l = loggers; l != NULL; l = l->next)
+		{
+			TerminalLogger *logger = l->data;
+			gboolean stopping;
+
+			/* What is appended after stopping is set is never
+			 * written; see terminal_logger_shutdown() */
+			stopping = logger->stopping;
+			g_mutex_unlock (&writer_lock);
+
+			terminal_logger_flush (logger, chunk);
+
+			if (stopping && logger->stream)
+			{
+				g_output_stream_close (logger->stream, NULL, NULL);
+				g_clear_object (&logger->stream);
+			}
+
+			g_mutex_lock (&writer_lock);
+
+			if (!stopping)
+				continue;
+
+			writer_loggers = g_list_remove (writer_loggers, logger);
+			logger->finished = TRUE;
+
+			if (logger->released)
+				terminal_logger_free (logger);
+		}
+
+		g_list_free (loggers);
+
+		if (!writer_loggers)
+			g_cond_broadcast (&writer_done_cond);
+	}
+
+	/* Runs until the process exits */
+	return NULL;
+}
+
+/**
+ * terminal_logger_new:
+ * @directory: where to write the log files; created if needed
+ * @name: the name of the log file, without extension
+ * @compress: whether to gzip the log files
+ * @max_size: the size in bytes of the output after which the log file is
+ *   rotated, before compression
+ *
+ * Starts a logger, served by the writer thread shared by all loggers.
+ * Nothing touches the disk until the first output is appended.
+ *
+ * Returns: a new #TerminalLogger, to be closed with terminal_logger_close()
+ */
+TerminalLogger *
+terminal_logger_new (const char *directory,
+                     const char *name,
+                     gboolean    compress,
+                     guint64     max_size)
+{
+	TerminalLogger *logger;
+
+	logger = g_slice_new0 (TerminalLogger);
+	logger->directory = g_strdup (directory);
+	logger->name = g_strdup (name);
+	logger->compress = compress != FALSE;
+	logger->max_size = max_size;
+
+	g_mutex_lock (&writer_lock);
+	writer_loggers = g_list_prepend (writer_loggers, logger);
+	g_cond_signal (&writer_cond);
+	g_mutex_unlock (&writer_lock);
+
+	if (!writer_thread)
+		writer_thread = g_thread_new ("terminal-logger", terminal_logger_thread, NULL);
+
+	return logger;
+}
+
+/**
+ * terminal_logger_append:
+ * @logger:
+ * @text: the lines to log
+ * @length: the length of @text, or -1 if it is nul-terminated
+ *
+ * Queues @text for writing, each line prefixed with the current time.
+ * Never blocks: if the writer has fallen too far behind, the lines are
+ * dropped and counted instead.
+ */
+void
+terminal_logger_append (TerminalLogger *logger,
+                        const char     *text,
+                        gssize          length)
+{
+	GDateTime *now;
+	GString *record;
+	char *stamp;
+	const char *line, *end;
+	guint head, tail, offset, first, n_lines = 0;
+
+	if (length < 0)
+		length = strlen (text);
+	if (length == 0)
+		return;
+
+	now = g_date_time_new_now_local ();
+	stamp = g_date_time_format (now, "%Y-%m-%dT%H:%M:%S");
+	record = g_string_sized_new (length + 64);
+
+	end = text + length;
+	for (line = text; line < end; )
+	{
+		const char *eol;
+
+		eol = memchr (line, '\n', end - line);
+		if (!eol)
+			eol = end;
+
+		g_string_append_printf (record, "[%s.%03d] ",
+		                        stamp, g_date_time_get_microsecond (now) / 1000);
+		g_string_append_len (record, line, eol - line);
+		g_string_append_c (record, '\n');
+		n_lines++;
+
+		line = eol + 1;
+	}
+
+	g_free (stamp);
+	g_date_time_unref (now);
+
+	/* The writer only reads the ring once @head has moved */
+	if (!logger->ring)
+		logger->ring = g_malloc (LOGGER_RING_SIZE);
+
+	head = (guint) g_atomic_int_get (&logger->head);
+	tail = (guint) g_atomic_int_get (&logger->tail);
+
+	if (record->len > LOGGER_RING_SIZE - (head - tail))
+	{
+		g_atomic_int_add (&logger->dropped, n_lines);
+		g_atomic_int_add (&total_dropped, n_lines);
+		g_string_free (record, TRUE);
+		return;
+	}
+
+	offset = head & (LOGGER_RING_SIZE - 1);
+	first = MIN (record->len, LOGGER_RING_SIZE - offset);
+	memcpy (logger->ring + offset, record->str, first);
+	memcpy (logger->ring, record->str + first, record->len - first);
+
+	g_atomic_int_set (&logger->head, (gint) (head + record->len));
+
+	/* Only wake the writer early when the ring is filling up */
+	if (head + record->len - tail > LOGGER_RING_SIZE / 2)
+	{
+		g_mutex_lock (&writer_lock);
+		writer_wakeup = TRUE;
+		g_cond_signal (&writer_cond);
+		g_mutex_unlock (&writer_lock);
+	}
+
+	g_string_free (record, TRUE);
+}
+
+/**
+ * terminal_logger_get_dropped:
+ * @logger:
+ *
+ * Returns: the number of lines dropped because the writer fell behind
+ */
+guint
+terminal_logger_get_dropped (TerminalLogger *logger)
+{
+	return (guint) g_atomic_int_get (&logger->dropped);
+}
+
+/**
+ * terminal_logger_get_total_dropped:
+ *
+ * Returns: the number of lines dropped by all loggers, closed ones included
+ */
+guint
+terminal_logger_get_total_dropped (void)
+{
+	return (guint) g_atomic_int_get (&total_dropped);
+}
+
+/**
+ * terminal_logger_close:
+ * @logger:
+ *
+ * Stops accepting output. The writer thread writes out what is queued,
+ * closes the file and frees @logger on its own; this doesn't wait for it.
+ */
+void
+terminal_logger_close (TerminalLogger *logger)
+{
+	gboolean free_logger;
+
+	g_mutex_lock (&writer_lock);
+	logger->stopping = TRUE;
+	logger->released = TRUE;
+	free_logger = logger->finished;
+	writer_wakeup = TRUE;
+	g_cond_signal (&writer_cond);
+	g_mutex_unlock (&writer_lock);
+
+	if (free_logger)
+		terminal_logger_free (logger);
+}
+
+/**
+ * terminal_logger_shutdown:
+ *
+ * Stops all loggers, and waits a bounded time for the writer thread
+ * to write out what is queued and close the files, so that nothing
+ * is lost and compressed logs are complete when the process exits.
+ * Loggers that are still open remain valid until they are closed, but
+ * what is appended to them from now on is discarded.
+ */
+void
+terminal_logger_shutdown (void)
+{
+	gint64 deadline;
+	GList *l;
+
+	deadline = g_get_monotonic_time () + LOGGER_SHUTDOWN_TIMEOUT;
+
+	g_mutex_lock (&writer_lock);
+
+	for (l = writer_loggers; l != NULL; l = l->next)
+	{
+		TerminalLogger *logger = l->data;
+
+		logger->stopping = TRUE;
+	}
+
+	writer_wakeup = TRUE;
+	g_cond_signal (&writer_cond);
+
+	while (writer_loggers)
+		if (!g_cond_wait_until (&writer_done_cond, &writer_lock, deadline))
+			break;
+
+	if (writer_loggers)
+		_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+		                       "Logger: %u logs still being written at shutdown\n",
+		                       g_list_length (writer_loggers));
+	g_mutex_unlock (&writer_lock);
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright © 2026 CAFE developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef TERMINAL_LOGGER_H
+#define TERMINAL_LOGGER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TerminalLogger TerminalLogger;
+
+TerminalLogger *terminal_logger_new (const char *directory,
+                                     const char *name,
+                                     gboolean    compress,
+                                     guint64     max_size);
+
+void terminal_logger_append (TerminalLogger *logger,
+                             const char     *text,
+                             gssize          length);
+
+guint terminal_logger_get_dropped (TerminalLogger *logger);
+
+guint terminal_logger_get_total_dropped (void);
+
+void terminal_logger_close (TerminalLogger *logger);
+
+void terminal_logger_shutdown (void);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_LOGGER_H */
@@ -945,6 +945,27 @@ terminal_options_free (TerminalOptions *options)
 	g_slice_free (TerminalOptions, options);
 }
 
+/**
+ * terminal_options_steal:
+ * @options:
+ *
+ * Moves the contents of @options into a new #TerminalOptions, leaving
+ * @options empty but still to be freed with terminal_options_free().
+ *
+ * Returns: a newly allocated #TerminalOptions
+ */
+TerminalOptions *
+terminal_options_steal (TerminalOptions *options)
+{
+	TerminalOptions *stolen;
+
+	stolen = g_slice_new (TerminalOptions);
+	*stolen = *options;
+	memset (options, 0, sizeof (TerminalOptions));
+
+	return stolen;
+}
+
 static GOptionContext *
 get_goption_context (TerminalOptions *options)
 {
@@ -113,6 +113,8 @@ gboolean terminal_options_merge_config (TerminalOptions *options,
 
 void terminal_options_ensure_window (TerminalOptions *options);
 
+TerminalOptions *terminal_options_steal (TerminalOptions *options);
+
 void terminal_options_free (TerminalOptions *options);
 
 G_END_DECLS
@@ -30,13 +30,16 @@
 #include "terminal-profile.h"
 #include "terminal-screen.h"
 #include "terminal-type-builtins.h"
+#include "terminal-util.h"
 
 #include "cafevaluearray.h"
 
 /* To add a new key, you need to:
  *
- *  - add an entry to the enum below
+ *  - add an entry to the TerminalProfileProp enum in terminal-profile.h
  *  - add a #define with its name in terminal-profile.h
+ *  - if it is a scalar or string, add it to TerminalProfileSnapshot and
+ *    terminal_profile_update_snapshot
  *  - add a gobject property for it in terminal_profile_class_init
  *  - if the property's type needs special casing, add that to
  *    terminal_profile_gsettings_notify_cb and
@@ -44,51 +47,13 @@
  *  - if necessary the default value cannot be handled via the paramspec,
  *    handle that in terminal_profile_reset_property_internal
  */
-enum
-{
-    PROP_0,
-    PROP_ALLOW_BOLD,
-    PROP_BACKGROUND_COLOR,
-    PROP_BACKGROUND_DARKNESS,
-    PROP_BACKGROUND_IMAGE,
-    PROP_BACKGROUND_IMAGE_FILE,
-    PROP_BACKGROUND_TYPE,
-    PROP_BACKSPACE_BINDING,
-    PROP_BOLD_COLOR,
-    PROP_BOLD_COLOR_SAME_AS_FG,
-    PROP_CURSOR_BLINK_MODE,
-    PROP_CURSOR_SHAPE,
-    PROP_CUSTOM_COMMAND,
-    PROP_DEFAULT_SIZE_COLUMNS,
-    PROP_DEFAULT_SIZE_ROWS,
-    PROP_DEFAULT_SHOW_MENUBAR,
-    PROP_DELETE_BINDING,
-    PROP_EXIT_ACTION,
-    PROP_FONT,
-    PROP_FOREGROUND_COLOR,
-    PROP_LOGIN_SHELL,
-    PROP_NAME,
-    PROP_PALETTE,
-    PROP_SCROLL_BACKGROUND,
-    PROP_SCROLLBACK_LINES,
-    PROP_SCROLLBACK_UNLIMITED,
-    PROP_SCROLLBAR_POSITION,
-    PROP_SCROLL_ON_KEYSTROKE,
-    PROP_SCROLL_ON_OUTPUT,
-    PROP_SILENT_BELL,
-    PROP_TITLE,
-    PROP_TITLE_MODE,
-    PROP_USE_CUSTOM_COMMAND,
-    PROP_USE_CUSTOM_DEFAULT_SIZE,
-    PROP_USE_SKEY,
-    PROP_USE_URLS,
-    PROP_USE_SYSTEM_FONT,
-    PROP_USE_THEME_COLORS,
-    PROP_VISIBLE_NAME,
-    PROP_WORD_CHARS,
-    PROP_COPY_SELECTION,
-    LAST_PROP
-};
+
+/* Properties read from GSettings when the profile is created; all the
+ * others wait until it is first used.
+ */
+#define TERMINAL_PROFILE_PROP_IS_EAGER(prop_id) \
+	((prop_id) == TERMINAL_PROFILE_PROP_NAME || \
+	 (prop_id) == TERMINAL_PROFILE_PROP_VISIBLE_NAME)
 
 #define KEY_ALLOW_BOLD "allow-bold"
 #define KEY_BACKGROUND_COLOR "background-color"
@@ -108,6 +73,10 @@ enum
 #define KEY_EXIT_ACTION "exit-action"
 #define KEY_FONT "font"
 #define KEY_FOREGROUND_COLOR "foreground-color"
+#define KEY_LOG_COMPRESS "log-compress"
+#define KEY_LOG_DIRECTORY "log-directory"
+#define KEY_LOG_MAX_SIZE "log-max-size"
+#define KEY_LOG_OUTPUT "log-output"
 #define KEY_LOGIN_SHELL "login-shell"
 #define KEY_PALETTE "palette"
 #define KEY_SCROLL_BACKGROUND "scroll-background"
@@ -127,6 +96,7 @@ enum
 #define KEY_USE_SYSTEM_FONT "use-system-font"
 #define KEY_USE_THEME_COLORS "use-theme-colors"
 #define KEY_VISIBLE_NAME "visible-name"
+#define KEY_WARM_POOL_SIZE "warm-pool-size"
 #define KEY_WORD_CHARS "word-chars"
 
 /* Keep these in sync with the GSettings schema! */
@@ -147,6 +117,10 @@ enum
 #define DEFAULT_EXIT_ACTION           (TERMINAL_EXIT_CLOSE)
 #define DEFAULT_FONT                  ("Monospace 12")
 #define DEFAULT_FOREGROUND_COLOR      ("#000000")
+#define DEFAULT_LOG_COMPRESS          (FALSE)
+#define DEFAULT_LOG_DIRECTORY         ("")
+#define DEFAULT_LOG_MAX_SIZE          (16)
+#define DEFAULT_LOG_OUTPUT            (FALSE)
 #define DEFAULT_LOGIN_SHELL           (FALSE)
 #define DEFAULT_NAME                  (NULL)
 #define DEFAULT_PALETTE               (terminal_palettes[TERMINAL_PALETTE_TANGO])
@@ -168,6 +142,7 @@ enum
 #define DEFAULT_USE_THEME_COLORS      (TRUE)
 #define DEFAULT_VISIBLE_NAME          (N_("Unnamed"))
 #define DEFAULT_WORD_CHARS            ("-A-Za-z0-9,./?%&#:_=+@~")
+#define DEFAULT_WARM_POOL_SIZE        (0)
 
 struct _TerminalProfilePrivate
 {
@@ -183,8 +158,20 @@ struct _TerminalProfilePrivate
 	GParamSpec *gsettings_notification_pspec;
 
 	gboolean background_load_failed;
+	GCancellable *background_cancellable; /* set while the image is loading */
+
+	TerminalProfileSnapshot snapshot;
+
+	TerminalColorScheme color_scheme;
+	CdkRGBA color_scheme_theme_fg, color_scheme_theme_bg; /* what it was resolved against */
+	gboolean color_scheme_valid;
+
+	/* TerminalProfileProp bits set through g_object_new(), not read from GSettings */
+	guint32 construct_props[(TERMINAL_PROFILE_N_PROPS + 31) / 32];
 
 	guint forgotten : 1;
+	guint loading : 1; /* inside terminal_profile_ensure_loaded() */
+	guint loaded : 1; /* all keys read from GSettings, not just the visible name */
 };
 
 static const CdkRGBA terminal_palettes[TERMINAL_PALETTE_N_BUILTINS][TERMINAL_PALETTE_SIZE] =
@@ -301,6 +288,7 @@ static void terminal_profile_set_property (GObject *object,
         guint prop_id,
         const GValue *value,
         GParamSpec *pspec);
+static void terminal_profile_ensure_loaded (TerminalProfile *profile);
 static void ensure_pixbuf_property (TerminalProfile *profile,
                                     guint path_prop_id,
                                     guint pixbuf_prop_id,
@@ -339,6 +327,160 @@ palette_cmp (const CdkRGBA *ca,
     return TRUE;
 }
 
+static void
+terminal_profile_update_snapshot (TerminalProfile *profile,
+                                  guint prop_id)
+{
+	TerminalProfilePrivate *priv = profile->priv;
+	TerminalProfileSnapshot *snapshot = &priv->snapshot;
+	const GValue *value = cafe_value_array_index (priv->properties, prop_id);
+
+	switch (prop_id)
+	{
+	case TERMINAL_PROFILE_PROP_BACKGROUND_COLOR:
+	case TERMINAL_PROFILE_PROP_BACKGROUND_DARKNESS:
+	case TERMINAL_PROFILE_PROP_BACKGROUND_IMAGE:
+	case TERMINAL_PROFILE_PROP_BACKGROUND_IMAGE_FILE:
+	case TERMINAL_PROFILE_PROP_BACKGROUND_TYPE:
+	case TERMINAL_PROFILE_PROP_BOLD_COLOR:
+	case TERMINAL_PROFILE_PROP_BOLD_COLOR_SAME_AS_FG:
+	case TERMINAL_PROFILE_PROP_FOREGROUND_COLOR:
+	case TERMINAL_PROFILE_PROP_PALETTE:
+	case TERMINAL_PROFILE_PROP_USE_THEME_COLORS:
+		/* The background image is not part of the scheme, but a new
+		 * serial makes the screens reload it */
+		priv->color_scheme_valid = FALSE;
+		break;
+	default:
+		break;
+	}
+
+	switch (prop_id)
+	{
+	case TERMINAL_PROFILE_PROP_ALLOW_BOLD:
+		snapshot->allow_bold = g_value_get_boolean (value) != FALSE;
+		break;
+	case TERMINAL_PROFILE_PROP_BOLD_COLOR_SAME_AS_FG:
+		snapshot->bold_color_same_as_fg = g_value_get_boolean (value) != FALSE;
+		break;
+	case TERMINAL_PROFILE_PROP_COPY_SELECTION:
+		snapshot->copy_selection = g_value_get_boolean (value) != FALSE;
+		break;
+	case TERMINAL_PROFILE_PROP_DEFAULT_SHOW_MENUBAR:
+		snapshot->default_show_menubar = g_value_get_boolean (value) != FALSE;
+		break;
+	case TERMINAL_PROFILE_PROP_LOG_COMPRESS:
+		snapshot->log_compress = g_value_get_boolean (value) != FALSE;
+		break;
+	case TERMINAL_PROFILE_PROP_LOG_OUTPUT:
+		snapshot->log_output = g_value_get_boolean (value) != FALSE;
+		break;
+	case TERMINAL_PROFILE_PROP_LOGIN_SHELL:
+		snapshot->login_shell = g_value_get_boolean (value) != FALSE;
+		break;
+	case TERMINAL_PROFILE_PROP_SCROLL_BACKGROUND:
+		snapshot->scroll_background = g_value_get_boolean (value) != FALSE;
+		break;
+	case TERMINAL_PROFILE_PROP_SCROLLBACK_UNLIMITED:
+		snapshot->scrollback_unlimited = g_value_get_boolean (value) != FALSE;
+		break;
+	case TERMINAL_PROFILE_PROP_SCROLL_ON_KEYSTROKE:
+		snapshot->scroll_on_keystroke = g_value_get_boolean (value) != FALSE;
+		break;
+	case TERMINAL_PROFILE_PROP_SCROLL_ON_OUTPUT:
+		snapshot->scroll_on_output = g_value_get_boolean (value) != FALSE;
+		break;
+	case TERMINAL_PROFILE_PROP_SILENT_BELL:
+		snapshot->silent_bell = g_value_get_boolean (value) != FALSE;
+		break;
+	case TERMINAL_PROFILE_PROP_USE_CUSTOM_COMMAND:
+		snapshot->use_custom_command = g_value_get_boolean (value) != FALSE;
+		break;
+	case TERMINAL_PROFILE_PROP_USE_CUSTOM_DEFAULT_SIZE:
+		snapshot->use_custom_default_size = g_value_get_boolean (value) != FALSE;
+		break;
+	case TERMINAL_PROFILE_PROP_USE_SKEY:
+		snapshot->use_skey = g_value_get_boolean (value) != FALSE;
+		break;
+	case TERMINAL_PROFILE_PROP_USE_URLS:
+		snapshot->use_urls = g_value_get_boolean (value) != FALSE;
+		break;
+	case TERMINAL_PROFILE_PROP_USE_SYSTEM_FONT:
+		snapshot->use_system_font = g_value_get_boolean (value) != FALSE;
+		break;
+	case TERMINAL_PROFILE_PROP_USE_THEME_COLORS:
+		snapshot->use_theme_colors = g_value_get_boolean (value) != FALSE;
+		break;
+
+	case TERMINAL_PROFILE_PROP_BACKGROUND_TYPE:
+		snapshot->background_type = g_value_get_enum (value);
+		break;
+	case TERMINAL_PROFILE_PROP_EXIT_ACTION:
+		snapshot->exit_action = g_value_get_enum (value);
+		break;
+	case TERMINAL_PROFILE_PROP_SCROLLBAR_POSITION:
+		snapshot->scrollbar_position = g_value_get_enum (value);
+		break;
+	case TERMINAL_PROFILE_PROP_TITLE_MODE:
+		snapshot->title_mode = g_value_get_enum (value);
+		break;
+	case TERMINAL_PROFILE_PROP_BACKSPACE_BINDING:
+		snapshot->backspace_binding = g_value_get_enum (value);
+		break;
+	case TERMINAL_PROFILE_PROP_DELETE_BINDING:
+		snapshot->delete_binding = g_value_get_enum (value);
+		break;
+	case TERMINAL_PROFILE_PROP_CURSOR_BLINK_MODE:
+		snapshot->cursor_blink_mode = g_value_get_enum (value);
+		break;
+	case TERMINAL_PROFILE_PROP_CURSOR_SHAPE:
+		snapshot->cursor_shape = g_value_get_enum (value);
+		break;
+
+	case TERMINAL_PROFILE_PROP_DEFAULT_SIZE_COLUMNS:
+		snapshot->default_size_columns = g_value_get_int (value);
+		break;
+	case TERMINAL_PROFILE_PROP_DEFAULT_SIZE_ROWS:
+		snapshot->default_size_rows = g_value_get_int (value);
+		break;
+	case TERMINAL_PROFILE_PROP_SCROLLBACK_LINES:
+		snapshot->scrollback_lines = g_value_get_int (value);
+		break;
+	case TERMINAL_PROFILE_PROP_WARM_POOL_SIZE:
+		snapshot->warm_pool_size = g_value_get_int (value);
+		break;
+	case TERMINAL_PROFILE_PROP_LOG_MAX_SIZE:
+		snapshot->log_max_size = g_value_get_int (value);
+		break;
+	case TERMINAL_PROFILE_PROP_BACKGROUND_DARKNESS:
+		snapshot->background_darkness = g_value_get_double (value);
+		break;
+
+	case TERMINAL_PROFILE_PROP_BACKGROUND_IMAGE_FILE:
+		snapshot->background_image_file = g_value_get_string (value);
+		break;
+	case TERMINAL_PROFILE_PROP_CUSTOM_COMMAND:
+		snapshot->custom_command = g_value_get_string (value);
+		break;
+	case TERMINAL_PROFILE_PROP_LOG_DIRECTORY:
+		snapshot->log_directory = g_value_get_string (value);
+		break;
+	case TERMINAL_PROFILE_PROP_TITLE:
+		snapshot->title = g_value_get_string (value);
+		break;
+	case TERMINAL_PROFILE_PROP_VISIBLE_NAME:
+		snapshot->visible_name = g_value_get_string (value);
+		break;
+	case TERMINAL_PROFILE_PROP_WORD_CHARS:
+		snapshot->word_chars = g_value_get_string (value);
+		break;
+
+	default:
+		/* Boxed and object properties aren't part of the snapshot */
+		break;
+	}
+}
+
 static GParamSpec *
 get_pspec_from_name (TerminalProfile *profile,
                      const char *prop_name)
@@ -365,8 +507,11 @@ get_prop_value_from_prop_name (TerminalProfile *profile,
 	if (!pspec)
 		return NULL;
 
-	if (G_UNLIKELY (pspec->param_id == PROP_BACKGROUND_IMAGE))
-		ensure_pixbuf_property (profile, PROP_BACKGROUND_IMAGE_FILE, PROP_BACKGROUND_IMAGE, &priv->background_load_failed);
+	if (!TERMINAL_PROFILE_PROP_IS_EAGER (pspec->param_id))
+		terminal_profile_ensure_loaded (profile);
+
+	if (G_UNLIKELY (pspec->param_id == TERMINAL_PROFILE_PROP_BACKGROUND_IMAGE))
+		ensure_pixbuf_property (profile, TERMINAL_PROFILE_PROP_BACKGROUND_IMAGE_FILE, TERMINAL_PROFILE_PROP_BACKGROUND_IMAGE, &priv->background_load_failed);
 
 	return cafe_value_array_index (priv->properties, pspec->param_id);
 }
@@ -449,6 +594,57 @@ values_equal (GParamSpec *pspec,
 	return FALSE;
 }
 
+typedef struct
+{
+	TerminalProfile *profile;
+	guint pixbuf_prop_id;
+	gboolean *load_failed;
+} PixbufLoadData;
+
+static void
+pixbuf_property_loaded_cb (GObject      *source_object G_GNUC_UNUSED,
+                           GAsyncResult *result,
+                           gpointer      user_data)
+{
+	PixbufLoadData *data = user_data;
+	TerminalProfile *profile = data->profile;
+	TerminalProfilePrivate *priv;
+	GdkPixbuf *pixbuf;
+	GError *error = NULL;
+
+	pixbuf = terminal_util_load_image_finish (result, &error);
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+	{
+		/* The profile or the path is gone */
+		g_error_free (error);
+		g_slice_free (PixbufLoadData, data);
+		return;
+	}
+
+	priv = profile->priv;
+	g_clear_object (&priv->background_cancellable);
+
+	if (!pixbuf)
+	{
+		_terminal_debug_print (TERMINAL_DEBUG_PROFILE,
+		                       "Failed to load image: %s\n",
+		                       error->message);
+
+		g_error_free (error);
+		*data->load_failed = TRUE;
+		g_slice_free (PixbufLoadData, data);
+		return;
+	}
+
+	g_value_take_object (cafe_value_array_index (priv->properties, data->pixbuf_prop_id), pixbuf);
+	g_object_notify (G_OBJECT (profile), TERMINAL_PROFILE_BACKGROUND_IMAGE);
+
+	g_slice_free (PixbufLoadData, data);
+}
+
+/* Starts loading the image in the background; the property stays unset
+ * until it is loaded, and is notified then.
+ */
 static void
 ensure_pixbuf_property (TerminalProfile *profile,
                         guint path_prop_id,
@@ -458,9 +654,9 @@ ensure_pixbuf_property (TerminalProfile *profile,
 	TerminalProfilePrivate *priv = profile->priv;
 	GValue *path_value, *pixbuf_value;
 	GdkPixbuf *pixbuf;
+	PixbufLoadData *data;
 	const char *path_utf8;
 	char *path;
-	GError *error = NULL;
 
 	pixbuf_value = cafe_value_array_index (priv->properties, pixbuf_prop_id);
 
@@ -468,7 +664,7 @@ ensure_pixbuf_property (TerminalProfile *profile,
 	if (pixbuf)
 		return;
 
-	if (*load_failed)
+	if (*load_failed || priv->background_cancellable)
 		return;
 
 	path_value = cafe_value_array_index (priv->properties, path_prop_id);
@@ -480,19 +676,15 @@ ensure_pixbuf_property (TerminalProfile *profile,
 	if (!path)
 		goto failed;
 
-	pixbuf = gdk_pixbuf_new_from_file (path, &error);
-	if (!pixbuf)
-	{
-		_terminal_debug_print (TERMINAL_DEBUG_PROFILE,
-		                       "Failed to load image \"%s\": %s\n",
-		                       path, error->message);
-
-		g_error_free (error);
-		g_free (path);
-		goto failed;
-	}
+	data = g_slice_new (PixbufLoadData);
+	data->profile = profile;
+	data->pixbuf_prop_id = pixbuf_prop_id;
+	data->load_failed = load_failed;
 
-	g_value_take_object (pixbuf_value, pixbuf);
+	priv->background_cancellable = g_cancellable_new ();
+	terminal_util_load_image_async (path, 0, 0,
+	                                priv->background_cancellable,
+	                                pixbuf_property_loaded_cb, data);
 	g_free (path);
 	return;
 
@@ -521,20 +713,20 @@ terminal_profile_reset_property_internal (TerminalProfile *profile,
 	/* A few properties don't have defaults via the param spec; set them explicitly */
 	switch (pspec->param_id)
 	{
-	case PROP_FOREGROUND_COLOR:
-	case PROP_BOLD_COLOR:
+	case TERMINAL_PROFILE_PROP_FOREGROUND_COLOR:
+	case TERMINAL_PROFILE_PROP_BOLD_COLOR:
 		g_value_set_boxed (value, &DEFAULT_FOREGROUND_COLOR);
 		break;
 
-	case PROP_BACKGROUND_COLOR:
+	case TERMINAL_PROFILE_PROP_BACKGROUND_COLOR:
 		g_value_set_boxed (value, &DEFAULT_BACKGROUND_COLOR);
 		break;
 
-	case PROP_FONT:
+	case TERMINAL_PROFILE_PROP_FONT:
 		g_value_take_boxed (value, pango_font_description_from_string (DEFAULT_FONT));
 		break;
 
-	case PROP_PALETTE:
+	case TERMINAL_PROFILE_PROP_PALETTE:
 		set_value_from_palette (value, DEFAULT_PALETTE, TERMINAL_PALETTE_SIZE);
 		break;
 
@@ -576,6 +768,10 @@ terminal_profile_gsettings_notify_cb (GSettings *settings,
 	if (!pspec)
 		return; /* ignore unknown keys, for future extensibility */
 
+	/* Read when the profile is first used */
+	if (!priv->loaded && !priv->loading && !TERMINAL_PROFILE_PROP_IS_EAGER (pspec->param_id))
+		return;
+
 	priv->locked[pspec->param_id] = !g_settings_is_writable (settings, key);
 
 	settings_value = g_settings_get_value (settings, key);
@@ -915,10 +1111,10 @@ terminal_profile_init (TerminalProfile *profile)
 	priv = profile->priv = terminal_profile_get_instance_private (profile);
 
 	priv->gsettings_notification_pspec = NULL;
-	priv->locked = g_new0 (gboolean, LAST_PROP);
+	priv->locked = g_new0 (gboolean, TERMINAL_PROFILE_N_PROPS);
 
-	priv->properties = cafe_value_array_new (LAST_PROP);
-	for (i = 0; i < LAST_PROP; ++i)
+	priv->properties = cafe_value_array_new (TERMINAL_PROFILE_N_PROPS);
+	for (i = 0; i < TERMINAL_PROFILE_N_PROPS; ++i)
 		cafe_value_array_append (priv->properties, NULL);
 
 	pspecs = g_object_class_list_properties (G_OBJECT_CLASS (TERMINAL_PROFILE_GET_CLASS (profile)), &n_pspecs);
@@ -930,7 +1126,7 @@ terminal_profile_init (TerminalProfile *profile)
 		if (pspec->owner_type != TERMINAL_TYPE_PROFILE)
 			continue;
 
-		g_assert (pspec->param_id < LAST_PROP);
+		g_assert (pspec->param_id < TERMINAL_PROFILE_N_PROPS);
 		value = cafe_value_array_index (priv->properties, pspec->param_id);
 		g_value_init (value, pspec->value_type);
 		g_param_value_set_default (pspec, value);
@@ -945,6 +1141,67 @@ terminal_profile_init (TerminalProfile *profile)
 	terminal_profile_reset_property_internal (profile, g_object_class_find_property (object_class, TERMINAL_PROFILE_BACKGROUND_COLOR), FALSE);
 	terminal_profile_reset_property_internal (profile, g_object_class_find_property (object_class, TERMINAL_PROFILE_FONT), FALSE);
 	terminal_profile_reset_property_internal (profile, g_object_class_find_property (object_class, TERMINAL_PROFILE_PALETTE), FALSE);
+
+	for (i = 1; i < TERMINAL_PROFILE_N_PROPS; ++i)
+		terminal_profile_update_snapshot (profile, i);
+}
+
+/* Reads the keys that were skipped when @profile was created. Profiles
+ * are created for every entry of the profile list at startup, but most
+ * of them are never used.
+ */
+static void
+terminal_profile_ensure_loaded (TerminalProfile *profile)
+{
+	TerminalProfilePrivate *priv = profile->priv;
+	GParamSpec **pspecs;
+	guint n_pspecs, i;
+
+	/* Loading sets the properties, which would come back here */
+	if (G_LIKELY (priv->loaded) || priv->loading)
+		return;
+
+	priv->loading = TRUE;
+
+	_terminal_debug_print (TERMINAL_DEBUG_PROFILE,
+	                       "Loading profile %s\n",
+	                       g_value_get_string (cafe_value_array_index (priv->properties, TERMINAL_PROFILE_PROP_NAME)));
+
+	/* Listeners only see the profile once it is complete */
+	g_object_freeze_notify (G_OBJECT (profile));
+
+	pspecs = g_object_class_list_properties (G_OBJECT_CLASS (TERMINAL_PROFILE_GET_CLASS (profile)), &n_pspecs);
+	for (i = 0; i < n_pspecs; ++i)
+	{
+		GParamSpec *pspec = pspecs[i];
+		guint id = pspec->param_id;
+		char *key;
+
+		if (pspec->owner_type != TERMINAL_TYPE_PROFILE)
+			continue;
+
+		if ((pspec->flags & G_PARAM_WRITABLE) == 0 ||
+		        (pspec->flags & G_PARAM_CONSTRUCT_ONLY) != 0 ||
+		        TERMINAL_PROFILE_PROP_IS_EAGER (id))
+			continue;
+
+		/* Don't override what was set as a construction param */
+		if (priv->construct_props[id / 32] & (1u << (id % 32)))
+			continue;
+
+		key = g_param_spec_get_qdata (pspec, gsettings_key_quark);
+		if (!key)
+			continue;
+
+		terminal_profile_gsettings_notify_cb (priv->settings, key,  profile);
+	}
+
+	g_free (pspecs);
+
+	priv->loading = FALSE;
+	priv->loaded = TRUE;
+
+	g_object_thaw_notify (G_OBJECT (profile));
 }
 
 static GObject *
@@ -956,9 +1213,8 @@ terminal_profile_constructor (GType type,
 	TerminalProfile *profile;
 	TerminalProfilePrivate *priv;
 	const char *name;
-	GParamSpec **pspecs;
-	guint n_pspecs, i;
 	gchar *concat;
+	guint i;
 
 	object = G_OBJECT_CLASS (terminal_profile_parent_class)->constructor
 	         (type, n_construct_properties, construct_params);
@@ -966,7 +1222,15 @@ terminal_profile_constructor (GType type,
 	profile = TERMINAL_PROFILE (object);
 	priv = profile->priv;
 
-	name = g_value_get_string (cafe_value_array_index (priv->properties, PROP_NAME));
+	for (i = 0; i < n_construct_properties; ++i)
+	{
+		GParamSpec *pspec = construct_params[i].pspec;
+
+		if (pspec->owner_type == TERMINAL_TYPE_PROFILE)
+			priv->construct_props[pspec->param_id / 32] |= 1u << (pspec->param_id % 32);
+	}
+
+	name = g_value_get_string (cafe_value_array_index (priv->properties, TERMINAL_PROFILE_PROP_NAME));
 	g_assert (name != NULL);
 
 	concat = g_strconcat (CONF_PROFILE_PREFIX, name, "/", NULL);
@@ -981,40 +1245,10 @@ terminal_profile_constructor (GType type,
 
 	g_free (concat);
 
-	/* Now load those properties from GSettings that were not set as construction params */
-	pspecs = g_object_class_list_properties (G_OBJECT_CLASS (TERMINAL_PROFILE_GET_CLASS (profile)), &n_pspecs);
-	for (i = 0; i < n_pspecs; ++i)
-	{
-		GParamSpec *pspec = pspecs[i];
-		guint j;
-		gboolean is_construct = FALSE;
-		char *key;
-
-		if (pspec->owner_type != TERMINAL_TYPE_PROFILE)
-			continue;
-
-		if ((pspec->flags & G_PARAM_WRITABLE) == 0 ||
-		        (pspec->flags & G_PARAM_CONSTRUCT_ONLY) != 0)
-			continue;
-
-		for (j = 0; j < n_construct_properties; ++j)
-			if (pspec == construct_params[j].pspec)
-			{
-				is_construct = TRUE;
-				break;
-			}
-
-		if (is_construct)
-			continue;
-
-		key = g_param_spec_get_qdata (pspec, gsettings_key_quark);
-		if (!key)
-			continue;
-
-		terminal_profile_gsettings_notify_cb (priv->settings, key,  profile);
-	}
-
-	g_free (pspecs);
+	/* Only what the menus and the profile list show; the rest is
+	 * loaded on first use, see terminal_profile_ensure_loaded().
+	 */
+	terminal_profile_gsettings_notify_cb (priv->settings, (gchar *) KEY_VISIBLE_NAME, profile);
 
 	return object;
 }
@@ -1039,6 +1273,12 @@ terminal_profile_finalize (GObject *object)
 
 	_terminal_profile_forget (profile);
 
+	if (priv->background_cancellable)
+	{
+		g_cancellable_cancel (priv->background_cancellable);
+		g_object_unref (priv->background_cancellable);
+	}
+
 	g_object_unref (priv->settings);
 
 	g_free (priv->profile_dir);
@@ -1057,17 +1297,20 @@ terminal_profile_get_property (GObject *object,
 	TerminalProfile *profile = TERMINAL_PROFILE (object);
 	TerminalProfilePrivate *priv = profile->priv;
 
-	if (prop_id == 0 || prop_id >= LAST_PROP)
+	if (prop_id == 0 || prop_id >= TERMINAL_PROFILE_N_PROPS)
 	{
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		return;
 	}
 
+	if (!TERMINAL_PROFILE_PROP_IS_EAGER (prop_id))
+		terminal_profile_ensure_loaded (profile);
+
 	/* Note: When adding things here, do the same in get_prop_value_from_prop_name! */
 	switch (prop_id)
 	{
-	case PROP_BACKGROUND_IMAGE:
-		ensure_pixbuf_property (profile, PROP_BACKGROUND_IMAGE_FILE, PROP_BACKGROUND_IMAGE, &priv->background_load_failed);
+	case TERMINAL_PROFILE_PROP_BACKGROUND_IMAGE:
+		ensure_pixbuf_property (profile, TERMINAL_PROFILE_PROP_BACKGROUND_IMAGE_FILE, TERMINAL_PROFILE_PROP_BACKGROUND_IMAGE, &priv->background_load_failed);
 		break;
 	default:
 		break;
@@ -1086,19 +1329,24 @@ terminal_profile_set_property (GObject *object,
 	TerminalProfilePrivate *priv = profile->priv;
 	GValue *prop_value;
 
-	if (prop_id == 0 || prop_id >= LAST_PROP)
+	if (prop_id == 0 || prop_id >= TERMINAL_PROFILE_N_PROPS)
 	{
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		return;
 	}
 
+	/* Or loading it later would overwrite the new value. Construction
+	 * params come before there are any settings to load from. */
+	if (priv->settings != NULL && !TERMINAL_PROFILE_PROP_IS_EAGER (prop_id))
+		terminal_profile_ensure_loaded (profile);
+
 	prop_value = cafe_value_array_index (priv->properties, prop_id);
 
 	/* Preprocessing */
 	switch (prop_id)
 	{
 #if 0
-	case PROP_FONT:
+	case TERMINAL_PROFILE_PROP_FONT:
 	{
 		PangoFontDescription *font_desc, *new_font_desc;
 
@@ -1121,10 +1369,12 @@ terminal_profile_set_property (GObject *object,
 		break;
 	}
 
+	terminal_profile_update_snapshot (profile, prop_id);
+
 	/* Postprocessing */
 	switch (prop_id)
 	{
-	case PROP_NAME:
+	case TERMINAL_PROFILE_PROP_NAME:
 	{
 		const char *name = g_value_get_string (value);
 
@@ -1149,9 +1399,14 @@ terminal_profile_set_property (GObject *object,
 		break;
 	}
 
-	case PROP_BACKGROUND_IMAGE_FILE:
+	case TERMINAL_PROFILE_PROP_BACKGROUND_IMAGE_FILE:
 		/* Clear the cached image */
-		g_value_set_object (cafe_value_array_index (priv->properties, PROP_BACKGROUND_IMAGE), NULL);
+		if (priv->background_cancellable)
+		{
+			g_cancellable_cancel (priv->background_cancellable);
+			g_clear_object (&priv->background_cancellable);
+		}
+		g_value_set_object (cafe_value_array_index (priv->properties, TERMINAL_PROFILE_PROP_BACKGROUND_IMAGE), NULL);
 		priv->background_load_failed = FALSE;
 		g_object_notify (object, TERMINAL_PROFILE_BACKGROUND_IMAGE);
 		break;
@@ -1222,35 +1477,35 @@ terminal_profile_class_init (TerminalProfileClass *klass)
 }
 
 #define TERMINAL_PROFILE_PROPERTY_BOOLEAN(prop, propDefault, propGSettings) \
-  TERMINAL_PROFILE_PROPERTY (PROP_##prop,\
+  TERMINAL_PROFILE_PROPERTY (TERMINAL_PROFILE_PROP_##prop,\
     g_param_spec_boolean (TERMINAL_PROFILE_##prop, NULL, NULL,\
                           propDefault,\
                           G_PARAM_READWRITE | TERMINAL_PROFILE_PSPEC_STATIC),\
     propGSettings)
 
 #define TERMINAL_PROFILE_PROPERTY_BOXED(prop, propType, propGSettings)\
-  TERMINAL_PROFILE_PROPERTY (PROP_##prop,\
+  TERMINAL_PROFILE_PROPERTY (TERMINAL_PROFILE_PROP_##prop,\
     g_param_spec_boxed (TERMINAL_PROFILE_##prop, NULL, NULL,\
                         propType,\
                         G_PARAM_READWRITE | TERMINAL_PROFILE_PSPEC_STATIC),\
     propGSettings)
 
 #define TERMINAL_PROFILE_PROPERTY_DOUBLE(prop, propMin, propMax, propDefault, propGSettings)\
-  TERMINAL_PROFILE_PROPERTY (PROP_##prop,\
+  TERMINAL_PROFILE_PROPERTY (TERMINAL_PROFILE_PROP_##prop,\
     g_param_spec_double (TERMINAL_PROFILE_##prop, NULL, NULL,\
                          propMin, propMax, propDefault,\
                          G_PARAM_READWRITE | TERMINAL_PROFILE_PSPEC_STATIC),\
     propGSettings)
 
 #define TERMINAL_PROFILE_PROPERTY_ENUM(prop, propType, propDefault, propGSettings)\
-  TERMINAL_PROFILE_PROPERTY (PROP_##prop,\
+  TERMINAL_PROFILE_PROPERTY (TERMINAL_PROFILE_PROP_##prop,\
     g_param_spec_enum (TERMINAL_PROFILE_##prop, NULL, NULL,\
                        propType, propDefault,\
                        G_PARAM_READWRITE | TERMINAL_PROFILE_PSPEC_STATIC),\
     propGSettings)
 
 #define TERMINAL_PROFILE_PROPERTY_INT(prop, propMin, propMax, propDefault, propGSettings)\
-  TERMINAL_PROFILE_PROPERTY (PROP_##prop,\
+  TERMINAL_PROFILE_PROPERTY (TERMINAL_PROFILE_PROP_##prop,\
     g_param_spec_int (TERMINAL_PROFILE_##prop, NULL, NULL,\
                       propMin, propMax, propDefault,\
                       G_PARAM_READWRITE | TERMINAL_PROFILE_PSPEC_STATIC),\
@@ -1258,28 +1513,28 @@ terminal_profile_class_init (TerminalProfileClass *klass)
 
 	/* these are all read-only */
 #define TERMINAL_PROFILE_PROPERTY_OBJECT(prop, propType, propGSettings)\
-  TERMINAL_PROFILE_PROPERTY (PROP_##prop,\
+  TERMINAL_PROFILE_PROPERTY (TERMINAL_PROFILE_PROP_##prop,\
     g_param_spec_object (TERMINAL_PROFILE_##prop, NULL, NULL,\
                          propType,\
                          G_PARAM_READABLE | TERMINAL_PROFILE_PSPEC_STATIC),\
     propGSettings)
 
 #define TERMINAL_PROFILE_PROPERTY_STRING(prop, propDefault, propGSettings)\
-  TERMINAL_PROFILE_PROPERTY (PROP_##prop,\
+  TERMINAL_PROFILE_PROPERTY (TERMINAL_PROFILE_PROP_##prop,\
     g_param_spec_string (TERMINAL_PROFILE_##prop, NULL, NULL,\
                          propDefault,\
                          G_PARAM_READWRITE | TERMINAL_PROFILE_PSPEC_STATIC),\
     propGSettings)
 
 #define TERMINAL_PROFILE_PROPERTY_STRING_CO(prop, propDefault, propGSettings)\
-  TERMINAL_PROFILE_PROPERTY (PROP_##prop,\
+  TERMINAL_PROFILE_PROPERTY (TERMINAL_PROFILE_PROP_##prop,\
     g_param_spec_string (TERMINAL_PROFILE_##prop, NULL, NULL,\
                          propDefault,\
                          G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | TERMINAL_PROFILE_PSPEC_STATIC),\
     propGSettings)
 
 #define TERMINAL_PROFILE_PROPERTY_VALUE_ARRAY_BOXED(prop, propElementName, propElementType, propGSettings)\
-  TERMINAL_PROFILE_PROPERTY (PROP_##prop,\
+  TERMINAL_PROFILE_PROPERTY (TERMINAL_PROFILE_PROP_##prop,\
     cafe_param_spec_value_array (TERMINAL_PROFILE_##prop, NULL, NULL,\
                               g_param_spec_boxed (propElementName, NULL, NULL,\
                                                   propElementType, \
@@ -1290,6 +1545,8 @@ terminal_profile_class_init (TerminalProfileClass *klass)
 	TERMINAL_PROFILE_PROPERTY_BOOLEAN (ALLOW_BOLD, DEFAULT_ALLOW_BOLD, KEY_ALLOW_BOLD);
 	TERMINAL_PROFILE_PROPERTY_BOOLEAN (BOLD_COLOR_SAME_AS_FG, DEFAULT_BOLD_COLOR_SAME_AS_FG, KEY_BOLD_COLOR_SAME_AS_FG);
 	TERMINAL_PROFILE_PROPERTY_BOOLEAN (DEFAULT_SHOW_MENUBAR, DEFAULT_DEFAULT_SHOW_MENUBAR, KEY_DEFAULT_SHOW_MENUBAR);
+	TERMINAL_PROFILE_PROPERTY_BOOLEAN (LOG_COMPRESS, DEFAULT_LOG_COMPRESS, KEY_LOG_COMPRESS);
+	TERMINAL_PROFILE_PROPERTY_BOOLEAN (LOG_OUTPUT, DEFAULT_LOG_OUTPUT, KEY_LOG_OUTPUT);
 	TERMINAL_PROFILE_PROPERTY_BOOLEAN (LOGIN_SHELL, DEFAULT_LOGIN_SHELL, KEY_LOGIN_SHELL);
 	TERMINAL_PROFILE_PROPERTY_BOOLEAN (SCROLL_BACKGROUND, DEFAULT_SCROLL_BACKGROUND, KEY_SCROLL_BACKGROUND);
 	TERMINAL_PROFILE_PROPERTY_BOOLEAN (SCROLLBACK_UNLIMITED, DEFAULT_SCROLLBACK_UNLIMITED, KEY_SCROLLBACK_UNLIMITED);
@@ -1324,12 +1581,15 @@ terminal_profile_class_init (TerminalProfileClass *klass)
 	TERMINAL_PROFILE_PROPERTY_INT (DEFAULT_SIZE_COLUMNS, 1, 1024, DEFAULT_DEFAULT_SIZE_COLUMNS, KEY_DEFAULT_SIZE_COLUMNS);
 	TERMINAL_PROFILE_PROPERTY_INT (DEFAULT_SIZE_ROWS, 1, 1024, DEFAULT_DEFAULT_SIZE_ROWS, KEY_DEFAULT_SIZE_ROWS);
 	TERMINAL_PROFILE_PROPERTY_INT (SCROLLBACK_LINES, 1, G_MAXINT, DEFAULT_SCROLLBACK_LINES, KEY_SCROLLBACK_LINES);
+	TERMINAL_PROFILE_PROPERTY_INT (WARM_POOL_SIZE, 0, 8, DEFAULT_WARM_POOL_SIZE, KEY_WARM_POOL_SIZE);
+	TERMINAL_PROFILE_PROPERTY_INT (LOG_MAX_SIZE, 1, 4096, DEFAULT_LOG_MAX_SIZE, KEY_LOG_MAX_SIZE);
 
 	TERMINAL_PROFILE_PROPERTY_OBJECT (BACKGROUND_IMAGE, GDK_TYPE_PIXBUF, NULL);
 
 	TERMINAL_PROFILE_PROPERTY_STRING_CO (NAME, DEFAULT_NAME, NULL);
 	TERMINAL_PROFILE_PROPERTY_STRING (BACKGROUND_IMAGE_FILE, DEFAULT_BACKGROUND_IMAGE_FILE, KEY_BACKGROUND_IMAGE_FILE);
 	TERMINAL_PROFILE_PROPERTY_STRING (CUSTOM_COMMAND, DEFAULT_CUSTOM_COMMAND, KEY_CUSTOM_COMMAND);
+	TERMINAL_PROFILE_PROPERTY_STRING (LOG_DIRECTORY, DEFAULT_LOG_DIRECTORY, KEY_LOG_DIRECTORY);
 	TERMINAL_PROFILE_PROPERTY_STRING (TITLE, _(DEFAULT_TITLE), KEY_TITLE);
 	TERMINAL_PROFILE_PROPERTY_STRING (VISIBLE_NAME, _(DEFAULT_VISIBLE_NAME), KEY_VISIBLE_NAME);
 	TERMINAL_PROFILE_PROPERTY_STRING (WORD_CHARS, DEFAULT_WORD_CHARS, KEY_WORD_CHARS);
@@ -1569,6 +1829,8 @@ terminal_profile_property_locked (TerminalProfile *profile,
 	if (!pspec)
 		return FALSE;
 
+	terminal_profile_ensure_loaded (profile);
+
 	return priv->locked[pspec->param_id];
 }
 
@@ -1587,6 +1849,109 @@ terminal_profile_reset_property (TerminalProfile *profile,
 	terminal_profile_reset_property_internal (profile, pspec, TRUE);
 }
 
+/**
+ * terminal_profile_get_snapshot:
+ * @profile: a #TerminalProfile
+ *
+ * Returns the typed snapshot of @profile's scalar and string properties,
+ * for hot paths that would otherwise look the property up by name.
+ * The returned pointer stays valid for the lifetime of @profile.
+ *
+ * Returns: (transfer none): the snapshot
+ */
+const TerminalProfileSnapshot *
+terminal_profile_get_snapshot (TerminalProfile *profile)
+{
+	g_return_val_if_fail (TERMINAL_IS_PROFILE (profile), NULL);
+
+	terminal_profile_ensure_loaded (profile);
+
+	return &profile->priv->snapshot;
+}
+
+/**
+ * terminal_profile_get_color_scheme:
+ * @profile: a #TerminalProfile
+ * @theme_fg: the theme's foreground colour
+ * @theme_bg: the theme's background colour
+ *
+ * Returns the colours of @profile resolved against the theme. They are
+ * computed once and shared by all screens using @profile, until one of
+ * the colour properties changes or, if @profile uses the theme colours,
+ * until it is asked for with different theme colours.
+ *
+ * Returns: (transfer none): the colour scheme, valid until the next call
+ */
+const TerminalColorScheme *
+terminal_profile_get_color_scheme (TerminalProfile *profile,
+                                   const CdkRGBA *theme_fg,
+                                   const CdkRGBA *theme_bg)
+{
+	static guint serial = 0;
+	TerminalProfilePrivate *priv;
+	const TerminalProfileSnapshot *snapshot;
+	TerminalColorScheme *scheme;
+
+	g_return_val_if_fail (TERMINAL_IS_PROFILE (profile), NULL);
+
+	terminal_profile_ensure_loaded (profile);
+
+	priv = profile->priv;
+	snapshot = &priv->snapshot;
+	scheme = &priv->color_scheme;
+
+	if (priv->color_scheme_valid &&
+	        (!snapshot->use_theme_colors ||
+	         (cdk_rgba_equal (&priv->color_scheme_theme_fg, theme_fg) &&
+	          cdk_rgba_equal (&priv->color_scheme_theme_bg, theme_bg))))
+		return scheme;
+
+	scheme->foreground = *theme_fg;
+	scheme->background = *theme_bg;
+	scheme->has_bold = FALSE;
+
+	if (!snapshot->use_theme_colors)
+	{
+		const CdkRGBA *fg_rgba, *bg_rgba, *bold_rgba;
+
+		fg_rgba = g_value_get_boxed (cafe_value_array_index (priv->properties, TERMINAL_PROFILE_PROP_FOREGROUND_COLOR));
+		bg_rgba = g_value_get_boxed (cafe_value_array_index (priv->properties, TERMINAL_PROFILE_PROP_BACKGROUND_COLOR));
+		bold_rgba = g_value_get_boxed (cafe_value_array_index (priv->properties, TERMINAL_PROFILE_PROP_BOLD_COLOR));
+
+		if (fg_rgba)
+			scheme->foreground = *fg_rgba;
+		if (bg_rgba)
+			scheme->background = *bg_rgba;
+		if (!snapshot->bold_color_same_as_fg && bold_rgba)
+		{
+			scheme->bold = *bold_rgba;
+			scheme->has_bold = TRUE;
+		}
+	}
+
+	scheme->n_palette = G_N_ELEMENTS (scheme->palette);
+	if (!terminal_profile_get_palette (profile, scheme->palette, &scheme->n_palette))
+		scheme->n_palette = 0;
+
+	if (snapshot->background_type == TERMINAL_BACKGROUND_TRANSPARENT)
+		scheme->background.alpha = snapshot->background_darkness;
+	else if (snapshot->background_type == TERMINAL_BACKGROUND_IMAGE)
+		scheme->background.alpha = 0.0;
+	else
+		scheme->background.alpha = 1.0;
+
+	scheme->serial = ++serial;
+	priv->color_scheme_theme_fg = *theme_fg;
+	priv->color_scheme_theme_bg = *theme_bg;
+	priv->color_scheme_valid = TRUE;
+
+	_terminal_debug_print (TERMINAL_DEBUG_PROFILE,
+	                       "Profile %p: resolved colour scheme %u\n",
+	                       profile, scheme->serial);
+
+	return scheme;
+}
+
 gboolean
 terminal_profile_get_palette (TerminalProfile *profile,
                               CdkRGBA *colors,
@@ -1599,8 +1964,10 @@ terminal_profile_get_palette (TerminalProfile *profile,
 	g_return_val_if_fail (TERMINAL_IS_PROFILE (profile), FALSE);
 	g_return_val_if_fail (colors != NULL && n_colors != NULL, FALSE);
 
+	terminal_profile_ensure_loaded (profile);
+
 	priv = profile->priv;
-	array = g_value_get_boxed (cafe_value_array_index (priv->properties, PROP_PALETTE));
+	array = g_value_get_boxed (cafe_value_array_index (priv->properties, TERMINAL_PROFILE_PROP_PALETTE));
 	if (!array)
 		return FALSE;
 
@@ -1665,7 +2032,7 @@ terminal_profile_modify_palette_entry (TerminalProfile *profile,
 	GValue *value;
 	CdkRGBA *old_color;
 
-	array = g_value_get_boxed (cafe_value_array_index (priv->properties, PROP_PALETTE));
+	array = g_value_get_boxed (cafe_value_array_index (priv->properties, TERMINAL_PROFILE_PROP_PALETTE));
 	if (!array ||
 	        i >= cafe_value_array_length (array))
 		return FALSE;
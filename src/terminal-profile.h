@@ -85,6 +85,10 @@ typedef enum
 #define TERMINAL_PROFILE_EXIT_ACTION            "exit-action"
 #define TERMINAL_PROFILE_FONT                   "font"
 #define TERMINAL_PROFILE_FOREGROUND_COLOR       "foreground-color"
+#define TERMINAL_PROFILE_LOG_COMPRESS           "log-compress"
+#define TERMINAL_PROFILE_LOG_DIRECTORY          "log-directory"
+#define TERMINAL_PROFILE_LOG_MAX_SIZE           "log-max-size"
+#define TERMINAL_PROFILE_LOG_OUTPUT             "log-output"
 #define TERMINAL_PROFILE_LOGIN_SHELL            "login-shell"
 #define TERMINAL_PROFILE_NAME                   "name"
 #define TERMINAL_PROFILE_PALETTE                "palette"
@@ -105,8 +109,122 @@ typedef enum
 #define TERMINAL_PROFILE_USE_SYSTEM_FONT        "use-system-font"
 #define TERMINAL_PROFILE_USE_THEME_COLORS       "use-theme-colors"
 #define TERMINAL_PROFILE_VISIBLE_NAME           "visible-name"
+#define TERMINAL_PROFILE_WARM_POOL_SIZE         "warm-pool-size"
 #define TERMINAL_PROFILE_WORD_CHARS             "word-chars"
 
+/* Property IDs, for the typed fast path below. Keep in sync with the names above! */
+typedef enum
+{
+    TERMINAL_PROFILE_PROP_0,
+    TERMINAL_PROFILE_PROP_ALLOW_BOLD,
+    TERMINAL_PROFILE_PROP_BACKGROUND_COLOR,
+    TERMINAL_PROFILE_PROP_BACKGROUND_DARKNESS,
+    TERMINAL_PROFILE_PROP_BACKGROUND_IMAGE,
+    TERMINAL_PROFILE_PROP_BACKGROUND_IMAGE_FILE,
+    TERMINAL_PROFILE_PROP_BACKGROUND_TYPE,
+    TERMINAL_PROFILE_PROP_BACKSPACE_BINDING,
+    TERMINAL_PROFILE_PROP_BOLD_COLOR,
+    TERMINAL_PROFILE_PROP_BOLD_COLOR_SAME_AS_FG,
+    TERMINAL_PROFILE_PROP_CURSOR_BLINK_MODE,
+    TERMINAL_PROFILE_PROP_CURSOR_SHAPE,
+    TERMINAL_PROFILE_PROP_CUSTOM_COMMAND,
+    TERMINAL_PROFILE_PROP_DEFAULT_SIZE_COLUMNS,
+    TERMINAL_PROFILE_PROP_DEFAULT_SIZE_ROWS,
+    TERMINAL_PROFILE_PROP_DEFAULT_SHOW_MENUBAR,
+    TERMINAL_PROFILE_PROP_DELETE_BINDING,
+    TERMINAL_PROFILE_PROP_EXIT_ACTION,
+    TERMINAL_PROFILE_PROP_FONT,
+    TERMINAL_PROFILE_PROP_FOREGROUND_COLOR,
+    TERMINAL_PROFILE_PROP_LOGIN_SHELL,
+    TERMINAL_PROFILE_PROP_NAME,
+    TERMINAL_PROFILE_PROP_PALETTE,
+    TERMINAL_PROFILE_PROP_SCROLL_BACKGROUND,
+    TERMINAL_PROFILE_PROP_SCROLLBACK_LINES,
+    TERMINAL_PROFILE_PROP_SCROLLBACK_UNLIMITED,
+    TERMINAL_PROFILE_PROP_SCROLLBAR_POSITION,
+    TERMINAL_PROFILE_PROP_SCROLL_ON_KEYSTROKE,
+    TERMINAL_PROFILE_PROP_SCROLL_ON_OUTPUT,
+    TERMINAL_PROFILE_PROP_SILENT_BELL,
+    TERMINAL_PROFILE_PROP_TITLE,
+    TERMINAL_PROFILE_PROP_TITLE_MODE,
+    TERMINAL_PROFILE_PROP_USE_CUSTOM_COMMAND,
+    TERMINAL_PROFILE_PROP_USE_CUSTOM_DEFAULT_SIZE,
+    TERMINAL_PROFILE_PROP_USE_SKEY,
+    TERMINAL_PROFILE_PROP_USE_URLS,
+    TERMINAL_PROFILE_PROP_USE_SYSTEM_FONT,
+    TERMINAL_PROFILE_PROP_USE_THEME_COLORS,
+    TERMINAL_PROFILE_PROP_VISIBLE_NAME,
+    TERMINAL_PROFILE_PROP_WORD_CHARS,
+    TERMINAL_PROFILE_PROP_COPY_SELECTION,
+    TERMINAL_PROFILE_PROP_WARM_POOL_SIZE,
+    TERMINAL_PROFILE_PROP_LOG_OUTPUT,
+    TERMINAL_PROFILE_PROP_LOG_COMPRESS,
+    TERMINAL_PROFILE_PROP_LOG_DIRECTORY,
+    TERMINAL_PROFILE_PROP_LOG_MAX_SIZE,
+    TERMINAL_PROFILE_N_PROPS
+} TerminalProfileProp;
+
+/* Typed copy of the scalar and string properties, kept up to date on
+ * every property change. Strings are owned by the profile and only valid
+ * until the property changes.
+ */
+typedef struct
+{
+	guint allow_bold : 1;
+	guint bold_color_same_as_fg : 1;
+	guint copy_selection : 1;
+	guint default_show_menubar : 1;
+	guint log_compress : 1;
+	guint log_output : 1;
+	guint login_shell : 1;
+	guint scroll_background : 1;
+	guint scrollback_unlimited : 1;
+	guint scroll_on_keystroke : 1;
+	guint scroll_on_output : 1;
+	guint silent_bell : 1;
+	guint use_custom_command : 1;
+	guint use_custom_default_size : 1;
+	guint use_skey : 1;
+	guint use_urls : 1;
+	guint use_system_font : 1;
+	guint use_theme_colors : 1;
+
+	TerminalBackgroundType background_type;
+	TerminalExitAction exit_action;
+	TerminalScrollbarPosition scrollbar_position;
+	TerminalTitleMode title_mode;
+	int backspace_binding; /* BteEraseBinding */
+	int delete_binding; /* BteEraseBinding */
+	int cursor_blink_mode; /* BteCursorBlinkMode */
+	int cursor_shape; /* BteCursorShape */
+
+	int default_size_columns;
+	int default_size_rows;
+	int scrollback_lines;
+	int warm_pool_size;
+	int log_max_size; /* MiB */
+	double background_darkness;
+
+	const char *background_image_file;
+	const char *custom_command;
+	const char *log_directory;
+	const char *title;
+	const char *visible_name;
+	const char *word_chars;
+} TerminalProfileSnapshot;
+
+/* The colours a screen hands to BTE, resolved against the theme */
+typedef struct
+{
+	CdkRGBA foreground;
+	CdkRGBA background; /* alpha already set from the background type */
+	CdkRGBA bold;
+	gboolean has_bold;
+	CdkRGBA palette[TERMINAL_PALETTE_SIZE];
+	guint n_palette;
+	guint serial; /* changes whenever any of the above is recomputed */
+} TerminalColorScheme;
+
 /* TerminalProfile object */
 
 #define TERMINAL_TYPE_PROFILE              (terminal_profile_get_type ())
@@ -174,6 +292,12 @@ gpointer          terminal_profile_get_property_object    (TerminalProfile *prof
 const char*       terminal_profile_get_property_string    (TerminalProfile *profile,
         const char *prop_name);
 
+const TerminalProfileSnapshot *terminal_profile_get_snapshot (TerminalProfile *profile);
+
+const TerminalColorScheme *terminal_profile_get_color_scheme (TerminalProfile *profile,
+        const CdkRGBA *theme_fg,
+        const CdkRGBA *theme_bg);
+
 gboolean          terminal_profile_get_palette            (TerminalProfile *profile,
         CdkRGBA *colors,
         guint *n_colors);
@@ -19,9 +19,13 @@
 
 #include <config.h>
 
+#include <string.h>
+
 #include "terminal-screen-container.h"
 #include "terminal-debug.h"
+#include "terminal-info-bar.h"
 #include "terminal-intl.h"
+#include "terminal-util.h"
 
 #include <ctk/ctk.h>
 
@@ -38,8 +42,30 @@ struct _TerminalScreenContainerPrivate
 	CtkPolicyType vscrollbar_policy;
 	CtkCornerType window_placement;
 	guint window_placement_set : 1;
+	struct _SaveContentsData *save_data;
 };
 
+/* Save Contents copies the buffer this many rows at a time, only once the
+ * previous chunk has been written out, so the main loop keeps running, the
+ * progress can be updated in between and at most one chunk is held in memory.
+ */
+#define SAVE_CONTENTS_CHUNK_ROWS 2000
+
+typedef struct _SaveContentsData
+{
+	TerminalScreenContainer *container;
+	GFile *file;
+	glong first_row;
+	glong next_row;
+	glong last_row;
+	GBytes *chunk;
+	gsize written;
+	GOutputStream *stream;
+	GCancellable *cancellable;
+	CtkWidget *info_bar;
+	CtkWidget *progress_bar;
+} SaveContentsData;
+
 enum
 {
     PROP_0,
@@ -108,6 +134,217 @@ size_allocate_cb (CtkWidget *widget,
 }
 #endif
 
+static void
+save_contents_data_free (SaveContentsData *data)
+{
+	TerminalScreenContainerPrivate *priv = data->container->priv;
+
+	if (priv->save_data == data)
+		priv->save_data = NULL;
+
+	if (data->info_bar != NULL)
+		ctk_widget_destroy (data->info_bar);
+
+	g_clear_object (&data->stream);
+	g_object_unref (data->cancellable);
+	if (data->chunk != NULL)
+		g_bytes_unref (data->chunk);
+	g_object_unref (data->file);
+	g_object_unref (data->container);
+	g_slice_free (SaveContentsData, data);
+}
+
+static void
+save_contents_report_error (SaveContentsData *data,
+                            GError *error)
+{
+	CtkWidget *toplevel;
+
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		return;
+
+	toplevel = ctk_widget_get_toplevel (CTK_WIDGET (data->container));
+	terminal_util_show_error_dialog (ctk_widget_is_toplevel (toplevel) ? CTK_WINDOW (toplevel) : NULL,
+	                                 NULL, error,
+	                                 "%s", _("Could not save contents"));
+}
+
+static void
+save_contents_close_cb (GObject *source,
+                        GAsyncResult *result,
+                        SaveContentsData *data)
+{
+	GError *error = NULL;
+
+	if (!g_output_stream_close_finish (G_OUTPUT_STREAM (source), result, &error))
+	{
+		save_contents_report_error (data, error);
+		g_error_free (error);
+	}
+
+	save_contents_data_free (data);
+}
+
+static void
+save_contents_finish (SaveContentsData *data,
+                      GError *error)
+{
+	if (error != NULL)
+	{
+		save_contents_report_error (data, error);
+
+		/* Closing with the cancellable cancelled leaves the original file untouched */
+		g_cancellable_cancel (data->cancellable);
+	}
+
+	if (data->stream == NULL)
+	{
+		save_contents_data_free (data);
+		return;
+	}
+
+	g_output_stream_close_async (data->stream,
+	                             G_PRIORITY_DEFAULT,
+	                             data->cancellable,
+	                             (GAsyncReadyCallback) save_contents_close_cb,
+	                             data);
+}
+
+static void save_contents_write_chunk (SaveContentsData *data);
+
+static void
+save_contents_write_cb (GObject *source,
+                        GAsyncResult *result,
+                        SaveContentsData *data)
+{
+	GError *error = NULL;
+	gssize n_written;
+
+	n_written = g_output_stream_write_finish (G_OUTPUT_STREAM (source), result, &error);
+	if (n_written < 0)
+	{
+		save_contents_finish (data, error);
+		g_error_free (error);
+		return;
+	}
+
+	data->written += n_written;
+	save_contents_write_chunk (data);
+}
+
+/* Copies the next rows of the buffer into data->chunk. Returns FALSE
+ * when there are no rows left to save.
+ */
+static gboolean
+save_contents_next_chunk (SaveContentsData *data)
+{
+	BteTerminal *terminal = BTE_TERMINAL (data->container->priv->screen);
+	CtkAdjustment *adjustment;
+	glong last_row;
+	char *text;
+
+	if (data->chunk != NULL)
+	{
+		g_bytes_unref (data->chunk);
+		data->chunk = NULL;
+	}
+	data->written = 0;
+
+	/* Rows that scrolled out of the buffer meanwhile are gone */
+	adjustment = ctk_scrollable_get_vadjustment (CTK_SCROLLABLE (terminal));
+	data->next_row = MAX (data->next_row, (glong) ctk_adjustment_get_lower (adjustment));
+
+	if (data->next_row > data->last_row)
+		return FALSE;
+
+	last_row = MIN (data->next_row + SAVE_CONTENTS_CHUNK_ROWS - 1, data->last_row);
+	text = bte_terminal_get_text_range (terminal,
+	                                    data->next_row, 0,
+	                                    last_row, bte_terminal_get_column_count (terminal) - 1,
+	                                    NULL, NULL, NULL);
+	data->next_row = last_row + 1;
+
+	/* Each row ends with a newline unless it is soft-wrapped, so the
+	 * chunks join up without splitting wrapped lines */
+	if (text != NULL)
+		data->chunk = g_bytes_new_take (text, strlen (text));
+	else
+		data->chunk = g_bytes_new_static ("", 0);
+
+	return TRUE;
+}
+
+static void
+save_contents_write_chunk (SaveContentsData *data)
+{
+	GError *error = NULL;
+	gsize size = 0;
+	const guint8 *contents = NULL;
+
+	if (g_cancellable_set_error_if_cancelled (data->cancellable, &error))
+	{
+		save_contents_finish (data, error);
+		g_error_free (error);
+		return;
+	}
+
+	if (data->chunk != NULL)
+		contents = g_bytes_get_data (data->chunk, &size);
+
+	while (data->written >= size)
+	{
+		if (data->progress_bar != NULL && data->last_row >= data->first_row)
+			ctk_progress_bar_set_fraction (CTK_PROGRESS_BAR (data->progress_bar),
+			                               (double) (MIN (data->next_row, data->last_row + 1) - data->first_row) /
+			                               (double) (data->last_row - data->first_row + 1));
+
+		if (!save_contents_next_chunk (data))
+		{
+			save_contents_finish (data, NULL);
+			return;
+		}
+
+		contents = g_bytes_get_data (data->chunk, &size);
+	}
+
+	g_output_stream_write_async (data->stream,
+	                             contents + data->written,
+	                             size - data->written,
+	                             G_PRIORITY_DEFAULT,
+	                             data->cancellable,
+	                             (GAsyncReadyCallback) save_contents_write_cb,
+	                             data);
+}
+
+static void
+save_contents_replace_cb (GObject *source,
+                          GAsyncResult *result,
+                          SaveContentsData *data)
+{
+	GError *error = NULL;
+	GFileOutputStream *stream;
+
+	stream = g_file_replace_finish (G_FILE (source), result, &error);
+	if (stream == NULL)
+	{
+		save_contents_finish (data, error);
+		g_error_free (error);
+		return;
+	}
+
+	data->stream = G_OUTPUT_STREAM (stream);
+	save_contents_write_chunk (data);
+}
+
+static void
+save_contents_info_bar_response_cb (CtkWidget *info_bar G_GNUC_UNUSED,
+                                    int response,
+                                    SaveContentsData *data)
+{
+	if (response == CTK_RESPONSE_CANCEL)
+		g_cancellable_cancel (data->cancellable);
+}
+
 /* Class implementation */
 
 static void
@@ -125,6 +362,24 @@ terminal_screen_container_init (TerminalScreenContainer *container)
 	ctk_orientable_set_orientation (CTK_ORIENTABLE (container), CTK_ORIENTATION_VERTICAL);
 }
 
+static void
+terminal_screen_container_dispose (GObject *object)
+{
+	TerminalScreenContainer *container = TERMINAL_SCREEN_CONTAINER (object);
+	TerminalScreenContainerPrivate *priv = container->priv;
+
+	if (priv->save_data != NULL)
+	{
+		/* The info bar goes away together with the container */
+		priv->save_data->info_bar = NULL;
+		priv->save_data->progress_bar = NULL;
+		g_cancellable_cancel (priv->save_data->cancellable);
+		priv->save_data = NULL;
+	}
+
+	G_OBJECT_CLASS (terminal_screen_container_parent_class)->dispose (object);
+}
+
 static GObject *
 terminal_screen_container_constructor (GType type,
                                        guint n_construct_properties,
@@ -250,6 +505,7 @@ terminal_screen_container_class_init (TerminalScreenContainerClass *klass)
 	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
 
 	gobject_class->constructor = terminal_screen_container_constructor;
+	gobject_class->dispose = terminal_screen_container_dispose;
 	gobject_class->get_property = terminal_screen_container_get_property;
 	gobject_class->set_property = terminal_screen_container_set_property;
 
@@ -411,3 +667,70 @@ terminal_screen_container_set_placement (TerminalScreenContainer *container,
 	terminal_screen_container_set_placement_internal (container, corner);
 	terminal_screen_container_set_placement_set (container, TRUE);
 }
+
+/**
+ * terminal_screen_container_save_contents:
+ * @container: a #TerminalScreenContainer
+ * @file: the #GFile to save to
+ *
+ * Saves the contents of @container's screen to @file as plain text. The
+ * rows present when the save starts are copied a chunk at a time as the
+ * asynchronous writes complete, with a progress info bar that allows
+ * cancelling the save.
+ * A save already in progress in @container is cancelled.
+ */
+void
+terminal_screen_container_save_contents (TerminalScreenContainer *container,
+                                         GFile *file)
+{
+	TerminalScreenContainerPrivate *priv;
+	SaveContentsData *data;
+	CtkAdjustment *adjustment;
+	char *display_name;
+
+	g_return_if_fail (TERMINAL_IS_SCREEN_CONTAINER (container));
+	g_return_if_fail (G_IS_FILE (file));
+
+	priv = container->priv;
+
+	if (priv->save_data != NULL)
+	{
+		g_cancellable_cancel (priv->save_data->cancellable);
+		priv->save_data = NULL;
+	}
+
+	adjustment = ctk_scrollable_get_vadjustment (CTK_SCROLLABLE (priv->screen));
+
+	data = g_slice_new0 (SaveContentsData);
+	data->container = g_object_ref (container);
+	data->file = g_object_ref (file);
+	data->first_row = (glong) ctk_adjustment_get_lower (adjustment);
+	data->next_row = data->first_row;
+	data->last_row = (glong) ctk_adjustment_get_upper (adjustment) - 1;
+	data->cancellable = g_cancellable_new ();
+
+	data->info_bar = terminal_info_bar_new (CTK_MESSAGE_INFO,
+	                                        _("_Cancel"), CTK_RESPONSE_CANCEL,
+	                                        NULL);
+	display_name = g_file_get_parse_name (file);
+	terminal_info_bar_format_text (TERMINAL_INFO_BAR (data->info_bar),
+	                               _("Saving contents to “%s”…"), display_name);
+	g_free (display_name);
+
+	data->progress_bar = ctk_progress_bar_new ();
+	terminal_info_bar_add_widget (TERMINAL_INFO_BAR (data->info_bar), data->progress_bar);
+
+	g_signal_connect (data->info_bar, "response",
+	                  G_CALLBACK (save_contents_info_bar_response_cb), data);
+
+	ctk_box_pack_start (CTK_BOX (container), data->info_bar, FALSE, FALSE, 0);
+	ctk_widget_show (data->info_bar);
+
+	priv->save_data = data;
+
+	g_file_replace_async (file, NULL, FALSE, G_FILE_CREATE_NONE,
+	                      G_PRIORITY_DEFAULT,
+	                      data->cancellable,
+	                      (GAsyncReadyCallback) save_contents_replace_cb,
+	                      data);
+}
@@ -64,6 +64,9 @@ void terminal_screen_container_set_policy (TerminalScreenContainer *container,
 void terminal_screen_container_set_placement (TerminalScreenContainer *container,
         CtkCornerType corner);
 
+void terminal_screen_container_save_contents (TerminalScreenContainer *container,
+        GFile *file);
+
 G_END_DECLS
 
 #endif /* TERMINAL_SCREEN_CONTAINER_H */
@@ -23,6 +23,7 @@
 #include <unistd.h>
 #include <sys/wait.h>
 
+#include <glib/gstdio.h>
 #include <gio/gio.h>
 #include <ctk/ctk.h>
 #include <cdk/cdkkeysyms.h>
@@ -32,12 +33,12 @@
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include <cairo.h>
 
-#include <libnotify/notify.h>
 
 #include "terminal-accels.h"
 #include "terminal-app.h"
 #include "terminal-debug.h"
 #include "terminal-intl.h"
+#include "terminal-logger.h"
 #include "terminal-marshal.h"
 #include "terminal-profile.h"
 #include "terminal-screen-container.h"
@@ -45,17 +46,33 @@
 #include "terminal-window.h"
 #include "terminal-info-bar.h"
 
-#include "eggshell.h"
-
 #define PCRE2_CODE_UNIT_WIDTH 0
 #include <pcre2.h>
 
 
-typedef struct
+typedef enum
 {
-	int tag;
-	TerminalURLFlavour flavor;
-} TagData;
+	MATCH_TAG_NONE,
+	MATCH_TAG_URL,
+	MATCH_TAG_SKEY
+} MatchTagType;
+
+/* Parts of a title format, see terminal_screen_get_title_format() */
+typedef enum
+{
+	TITLE_PART_DYNAMIC_OR_STATIC, /* %A */
+	TITLE_PART_DYNAMIC,           /* %D */
+	TITLE_PART_STATIC,            /* %S */
+	TITLE_PART_SEPARATOR          /* %- */
+} TitlePart;
+
+#define TITLE_PARTS_MAX (4)
+
+#define PROFILE_DIRTY_WORDS ((TERMINAL_PROFILE_N_PROPS + 31) / 32)
+
+/* Whether @prop is set in @dirty; a %NULL @dirty has every property set */
+#define PROFILE_PROP_DIRTY(dirty, prop) \
+	((dirty) == NULL || ((dirty)[(prop) / 32] & (1u << ((prop) % 32))) != 0)
 
 struct _TerminalScreenPrivate
 {
@@ -63,19 +80,46 @@ struct _TerminalScreenPrivate
 	guint profile_changed_id;
 	guint profile_forgotten_id;
 	char *raw_title, *raw_icon_title;
+	guint8 title_parts[TITLE_PARTS_MAX]; /* TitlePart, parsed from the title mode */
+	guint n_title_parts; /* 0 until parsed */
+	GString *title_buffer; /* reused to format the titles */
+	guint title_tick_id; /* applies the titles BTE reported on the next frame */
+	guint title_idle_id; /* same, while there is no frame clock */
+	guint window_title_pending : 1;
+	guint icon_title_pending : 1;
 	char *cooked_title, *cooked_icon_title;
 	char *override_title;
 	gboolean icon_title_set;
 	char *initial_working_directory;
+	char *reported_cwd;  /* last directory reported by the shell with OSC 7 */
+	char *reported_host; /* and the host it is on, or NULL */
 	char **initial_env;
 	char **override_command;
 	int child_pid;
 	double font_scale;
 	gboolean user_title; /* title was manually set */
-	GSList *match_tags;
+	GArray *match_tags; /* MatchTagType, indexed by tag */
 	guint launch_child_source_id;
+	gboolean launch_deferred; /* child not launched until selected or trickled */
+	glong scrollback_cap; /* limit set by the app's scrollback budget, or -1 */
+	gint64 last_viewed; /* monotonic time the screen was last shown */
+	TerminalLogger *logger; /* NULL unless the profile logs output */
+	glong log_row; /* first row not logged yet */
+	gulong log_contents_changed_id;
+	guint64 output_events;
+	gint64 launch_time; /* monotonic time the child launch started */
+	guint32 profile_dirty[PROFILE_DIRTY_WORDS]; /* TerminalProfileProp bits not applied yet */
+	guint profile_tick_id; /* applies profile_dirty on the next frame */
+	guint profile_idle_id; /* same, while there is no frame clock */
+	guint applied_color_scheme; /* serial of the TerminalColorScheme set on BTE */
+	guint theme_colors_generation; /* theme_generation theme_fg/bg were read at */
+	CdkRGBA theme_fg, theme_bg;
 	gulong bg_image_callback_id;
 	GdkPixbuf *bg_image;
+	char *bg_image_pending; /* background_image_get_key() of the image being loaded for us */
+	guint bg_image_reload_id; /* reloads an image that is too small, after a draw */
+	CdkRGBA bg_placeholder; /* painted until the image is loaded */
+	cairo_surface_t *bg_child_surface; /* offscreen rendering of the terminal */
 };
 
 enum
@@ -84,6 +128,7 @@ enum
     SHOW_POPUP_MENU,
     MATCH_CLICKED,
     CLOSE_SCREEN,
+    FOREGROUND_CHANGED,
     LAST_SIGNAL
 };
 
@@ -117,15 +162,44 @@ static void terminal_screen_drag_data_received (CtkWidget        *widget,
         CtkSelectionData *selection_data,
         guint             info,
         guint             time);
-static void terminal_screen_system_font_notify_cb (TerminalApp *app,
-        GParamSpec *pspec,
-        TerminalScreen *screen);
 static void terminal_screen_change_font (TerminalScreen *screen);
 static gboolean terminal_screen_popup_menu (CtkWidget *widget);
 static gboolean terminal_screen_button_press (CtkWidget *widget,
         CdkEventButton *event);
 static void terminal_screen_launch_child_on_idle (TerminalScreen *screen);
 static void terminal_screen_child_exited (BteTerminal *terminal, int status);
+static void terminal_screen_current_directory_uri_changed (BteTerminal    *bte_terminal,
+                                                           TerminalScreen *screen);
+static void terminal_screen_apply_scrollback (TerminalScreen *screen);
+static void terminal_screen_map_cb (CtkWidget      *widget,
+                                    TerminalScreen *screen);
+static void terminal_screen_unmap_cb (CtkWidget      *widget,
+                                      TerminalScreen *screen);
+static void terminal_screen_update_logging (TerminalScreen *screen);
+static void terminal_screen_stop_logging (TerminalScreen *screen);
+static void terminal_screen_cancel_background_image (TerminalScreen *screen);
+static void terminal_screen_log_lines (TerminalScreen *screen,
+                                       gboolean        to_cursor);
+static const char *terminal_screen_get_local_reported_cwd (TerminalScreen *screen);
+static void terminal_screen_cancel_profile_changes (TerminalScreen *screen);
+static void terminal_screen_cancel_titles (TerminalScreen *screen);
+static void terminal_screen_theme_changed_cb (CtkSettings *settings,
+                                              GParamSpec  *pspec,
+                                              gpointer     user_data);
+
+/* Profile property changes delivered to screens, for the stats */
+static guint64 n_profile_notifies = 0;
+
+/* Title changes from the child that were superseded within a frame */
+static guint64 n_titles_suppressed = 0;
+
+/* Bumped when the CTK theme changes; each screen reads its theme colours
+ * once per generation */
+static guint theme_generation = 1;
+
+/* Screens whose child launch is deferred, in the order they are trickled */
+static GQueue deferred_launches = G_QUEUE_INIT;
+static guint deferred_launch_source_id = 0;
 
 static void terminal_screen_window_title_changed      (BteTerminal *bte_terminal,
         TerminalScreen *screen);
@@ -175,13 +249,46 @@ static const TerminalRegexPattern url_regex_patterns[] =
 	{ "news:[[:alnum:]\\Q^_{|}~!\"#$%&'()*+,./;:=?`\\E]+", FLAVOR_AS_IS, PCRE2_CASELESS  },
 };
 
-static BteRegex **url_regexes;
-static TerminalURLFlavour *url_regex_flavors;
-static guint n_url_regexes;
+/* All URL flavours are matched with one alternation of named groups, shared
+ * between all screens. The flavour of a match is found from the group that
+ * matched it.
+ */
+#define URL_GROUP_NAME_FORMAT "url%u"
+
+static BteRegex *url_regex;
+static GRegex *url_flavor_regex;
 
 static void terminal_screen_url_match_remove (TerminalScreen *screen);
 
 
+/* Background images are shared between all screens using the same file */
+static GHashTable *background_images; /* background_image_get_key() -> GdkPixbuf, not referenced */
+
+/* Images are decoded in a worker thread, once for all screens waiting */
+typedef struct
+{
+	char *key;
+	GSList *screens; /* not referenced */
+	GCancellable *cancellable; /* cancelled once no screen waits any more */
+} BackgroundImageLoad;
+
+static GHashTable *background_image_loads; /* key -> BackgroundImageLoad, not owned */
+
+/* Images that failed to load aren't tried again until the file changes */
+static GHashTable *background_image_failures; /* background_image_get_key() set */
+
+/* The tiled background is cached on the pixbuf, and regenerated only when
+ * a larger area needs to be covered.
+ */
+#define BACKGROUND_TILES_DATA_KEY "terminal-screen-background-tiles"
+
+typedef struct
+{
+	int width;
+	int height;
+	cairo_surface_t *surface;
+} BackgroundTiles;
+
 #ifdef ENABLE_SKEY
 static const TerminalRegexPattern skey_regex_patterns[] =
 {
@@ -253,9 +360,88 @@ cwd_of_pid (int pid)
 }
 
 static void
-free_tag_data (TagData *tagdata)
+terminal_screen_match_tag_add (TerminalScreen *screen,
+                               int             tag,
+                               MatchTagType    type)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+
+	if (tag < 0)
+		return;
+
+	if ((guint) tag >= priv->match_tags->len)
+		g_array_set_size (priv->match_tags, tag + 1);
+
+	g_array_index (priv->match_tags, MatchTagType, tag) = type;
+	bte_terminal_match_set_cursor_name (BTE_TERMINAL (screen), tag, "hand2");
+}
+
+static void
+terminal_screen_match_tags_remove (TerminalScreen *screen,
+                                   MatchTagType    type)
 {
-	g_slice_free (TagData, tagdata);
+	TerminalScreenPrivate *priv = screen->priv;
+	guint tag;
+
+	for (tag = 0; tag < priv->match_tags->len; ++tag)
+	{
+		if (g_array_index (priv->match_tags, MatchTagType, tag) != type)
+			continue;
+
+		bte_terminal_match_remove (BTE_TERMINAL (screen), tag);
+		g_array_index (priv->match_tags, MatchTagType, tag) = MATCH_TAG_NONE;
+	}
+}
+
+static char *
+terminal_screen_build_url_pattern (void)
+{
+	GString *pattern;
+	guint i;
+
+	/* Only PCRE2_CASELESS is supported per pattern, as an inline option */
+	pattern = g_string_new (NULL);
+	for (i = 0; i < G_N_ELEMENTS (url_regex_patterns); ++i)
+	{
+		if (i > 0)
+			g_string_append_c (pattern, '|');
+
+		g_string_append_printf (pattern, "(?<" URL_GROUP_NAME_FORMAT ">%s%s)",
+		                        i,
+		                        (url_regex_patterns[i].flags & PCRE2_CASELESS) ? "(?i)" : "",
+		                        url_regex_patterns[i].pattern);
+	}
+
+	return g_string_free (pattern, FALSE);
+}
+
+static TerminalURLFlavour
+terminal_screen_get_url_flavor (const char *match)
+{
+	GMatchInfo *match_info = NULL;
+	TerminalURLFlavour flavor = FLAVOR_AS_IS;
+	guint i;
+
+	if (url_flavor_regex &&
+	    g_regex_match (url_flavor_regex, match, G_REGEX_MATCH_ANCHORED, &match_info))
+	{
+		for (i = 0; i < G_N_ELEMENTS (url_regex_patterns); ++i)
+		{
+			char name[16];
+			int start;
+
+			g_snprintf (name, sizeof (name), URL_GROUP_NAME_FORMAT, i);
+			if (g_match_info_fetch_named_pos (match_info, name, &start, NULL) && start != -1)
+			{
+				flavor = url_regex_patterns[i].flavor;
+				break;
+			}
+		}
+	}
+
+	g_match_info_free (match_info);
+
+	return flavor;
 }
 
 static void
@@ -309,9 +495,14 @@ static void
 terminal_screen_style_updated (CtkWidget *widget)
 {
     TerminalScreen *screen = TERMINAL_SCREEN (widget);
+    TerminalWindow *window;
 
     CTK_WIDGET_CLASS (terminal_screen_parent_class)->style_updated (widget);
 
+    /* The padding may have changed */
+    if ((window = terminal_screen_get_window (screen)))
+        terminal_window_invalidate_geometry (window);
+
     update_color_scheme (screen);
 
     if (ctk_widget_get_realized (widget))
@@ -355,6 +546,8 @@ terminal_screen_init (TerminalScreen *screen)
 
 	priv->font_scale = PANGO_SCALE_MEDIUM;
 
+	priv->match_tags = g_array_new (FALSE, TRUE, sizeof (MatchTagType));
+
 	/* Setup DND */
 	target_list = ctk_target_list_new (NULL, 0);
 	ctk_target_list_add_uri_targets (target_list, 0);
@@ -385,9 +578,20 @@ terminal_screen_init (TerminalScreen *screen)
 	g_signal_connect (screen, "text-inserted",
 	                  G_CALLBACK (terminal_screen_text_inserted),
 	                  screen);
+	g_signal_connect (screen, "current-directory-uri-changed",
+	                  G_CALLBACK (terminal_screen_current_directory_uri_changed),
+	                  screen);
+	g_signal_connect (screen, "map",
+	                  G_CALLBACK (terminal_screen_map_cb),
+	                  screen);
+	g_signal_connect (screen, "unmap",
+	                  G_CALLBACK (terminal_screen_unmap_cb),
+	                  screen);
+
+	priv->scrollback_cap = -1;
+	priv->last_viewed = g_get_monotonic_time ();
 
-	g_signal_connect (terminal_app_get (), "notify::system-font",
-	                  G_CALLBACK (terminal_screen_system_font_notify_cb), screen);
+	terminal_app_monitor_screen (terminal_app_get (), screen);
 
 	priv->bg_image_callback_id = 0;
 	priv->bg_image = NULL;
@@ -476,7 +680,11 @@ terminal_screen_class_init (TerminalScreenClass *klass)
 	CtkWidgetClass *widget_class = CTK_WIDGET_CLASS(klass);
 	BteTerminalClass *terminal_class = BTE_TERMINAL_CLASS (klass);
 	TerminalApp *app;
+	GError *error = NULL;
+	char *url_pattern;
+#ifdef ENABLE_SKEY
 	guint i;
+#endif
 
 	object_class->dispose = terminal_screen_dispose;
 	object_class->finalize = terminal_screen_finalize;
@@ -485,6 +693,11 @@ terminal_screen_class_init (TerminalScreenClass *klass)
 
 	widget_class->realize = terminal_screen_realize;
 	widget_class->style_updated = terminal_screen_style_updated;
+
+	g_signal_connect (ctk_settings_get_default (), "notify::ctk-theme-name",
+	                  G_CALLBACK (terminal_screen_theme_changed_cb), NULL);
+	g_signal_connect (ctk_settings_get_default (), "notify::ctk-application-prefer-dark-theme",
+	                  G_CALLBACK (terminal_screen_theme_changed_cb), NULL);
 	widget_class->drag_data_received = terminal_screen_drag_data_received;
 	widget_class->button_press_event = terminal_screen_button_press;
 	widget_class->popup_menu = terminal_screen_popup_menu;
@@ -532,6 +745,18 @@ terminal_screen_class_init (TerminalScreenClass *klass)
 	                  G_TYPE_NONE,
 	                  0);
 
+	/* Emitted by the app's process monitor, see
+	 * terminal_app_get_foreground_process() */
+	signals[FOREGROUND_CHANGED] =
+	    g_signal_new (I_("foreground-changed"),
+	                  G_OBJECT_CLASS_TYPE (object_class),
+	                  G_SIGNAL_RUN_LAST,
+	                  G_STRUCT_OFFSET (TerminalScreenClass, foreground_changed),
+	                  NULL, NULL,
+	                  g_cclosure_marshal_VOID__VOID,
+	                  G_TYPE_NONE,
+	                  0);
+
 	g_object_class_install_property
 	(object_class,
 	 PROP_PROFILE,
@@ -575,25 +800,30 @@ terminal_screen_class_init (TerminalScreenClass *klass)
 	                     G_PARAM_READWRITE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB));
 
 	/* Precompile the regexes */
-	n_url_regexes = G_N_ELEMENTS (url_regex_patterns);
-	url_regexes = g_new0 (BteRegex*, n_url_regexes);
-	url_regex_flavors = g_new0 (TerminalURLFlavour, n_url_regexes);
+	url_pattern = terminal_screen_build_url_pattern ();
 
-	for (i = 0; i < n_url_regexes; ++i)
+	url_regex = bte_regex_new_for_match (url_pattern, -1, PCRE2_MULTILINE, &error);
+	if (error)
 	{
-		GError *error = NULL;
-
-		url_regexes[i] = bte_regex_new_for_match(url_regex_patterns[i].pattern, -1,
-				                         url_regex_patterns[i].flags | PCRE2_MULTILINE, &error);
-		if (error)
-		{
-			g_message ("%s", error->message);
-			g_error_free (error);
-		}
+		g_message ("%s", error->message);
+		g_clear_error (&error);
+	}
+	else if (!bte_regex_jit (url_regex, PCRE2_JIT_COMPLETE, &error))
+	{
+		g_message ("%s", error->message);
+		g_clear_error (&error);
+	}
 
-		url_regex_flavors[i] = url_regex_patterns[i].flavor;
+	/* Only used to find the flavour of a match, not for hovering */
+	url_flavor_regex = g_regex_new (url_pattern, G_REGEX_MULTILINE | G_REGEX_OPTIMIZE, 0, &error);
+	if (error)
+	{
+		g_message ("%s", error->message);
+		g_clear_error (&error);
 	}
 
+	g_free (url_pattern);
+
 #ifdef ENABLE_SKEY
 	n_skey_regexes = G_N_ELEMENTS (skey_regex_patterns);
 	skey_regexes = g_new0 (BteRegex*, n_skey_regexes);
@@ -637,6 +867,32 @@ terminal_screen_dispose (GObject *object)
 		priv->launch_child_source_id = 0;
 	}
 
+	if (priv->launch_deferred)
+	{
+		priv->launch_deferred = FALSE;
+		g_queue_remove (&deferred_launches, screen);
+		if (g_queue_is_empty (&deferred_launches) && deferred_launch_source_id != 0)
+		{
+			g_source_remove (deferred_launch_source_id);
+			deferred_launch_source_id = 0;
+		}
+	}
+
+	terminal_app_unmonitor_screen (terminal_app_get (), screen);
+
+	if (priv->logger)
+		terminal_screen_stop_logging (screen);
+
+	terminal_screen_cancel_profile_changes (screen);
+	terminal_screen_cancel_titles (screen);
+	terminal_screen_cancel_background_image (screen);
+
+	if (priv->bg_image_reload_id != 0)
+	{
+		g_source_remove (priv->bg_image_reload_id);
+		priv->bg_image_reload_id = 0;
+	}
+
 	G_OBJECT_CLASS (terminal_screen_parent_class)->dispose (object);
 }
 
@@ -646,30 +902,337 @@ terminal_screen_finalize (GObject *object)
 	TerminalScreen *screen = TERMINAL_SCREEN (object);
 	TerminalScreenPrivate *priv = screen->priv;
 
-	g_signal_handlers_disconnect_by_func (terminal_app_get (),
-	                                      G_CALLBACK (terminal_screen_system_font_notify_cb),
-	                                      screen);
-
 	terminal_screen_set_profile (screen, NULL);
 
 	g_free (priv->raw_title);
 	g_free (priv->cooked_title);
+	if (priv->title_buffer)
+		g_string_free (priv->title_buffer, TRUE);
 	g_free (priv->override_title);
 	g_free (priv->raw_icon_title);
 	g_free (priv->cooked_icon_title);
 	g_free (priv->initial_working_directory);
+	g_free (priv->reported_cwd);
+	g_free (priv->reported_host);
 	g_strfreev (priv->override_command);
 	g_strfreev (priv->initial_env);
 
-	g_slist_foreach (priv->match_tags, (GFunc) free_tag_data, NULL);
-	g_slist_free (priv->match_tags);
+	g_array_free (priv->match_tags, TRUE);
 
 	if (priv->bg_image)
 		g_object_unref (priv->bg_image);
+	if (priv->bg_child_surface)
+		cairo_surface_destroy (priv->bg_child_surface);
 
 	G_OBJECT_CLASS (terminal_screen_parent_class)->finalize (object);
 }
 
+static void
+background_image_weak_notify (gpointer  data,
+                              GObject  *where_the_object_was G_GNUC_UNUSED)
+{
+	g_hash_table_remove (background_images, data);
+}
+
+/* Identifies @filename as it is now, so that the image is decoded again
+ * once the file changes */
+static char *
+background_image_get_key (const char *filename)
+{
+	GStatBuf buf;
+
+	if (g_stat (filename, &buf) != 0)
+		return g_strdup (filename);
+
+	return g_strdup_printf ("%s@%" G_GINT64_FORMAT, filename, (gint64) buf.st_mtime);
+}
+
+static void
+background_image_cache (const char *image_key,
+                        GdkPixbuf  *pixbuf)
+{
+	gpointer old_key, old_pixbuf;
+	char *key;
+
+	if (background_images == NULL)
+		background_images = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	if (g_hash_table_lookup_extended (background_images, image_key, &old_key, &old_pixbuf))
+	{
+		g_object_weak_unref (G_OBJECT (old_pixbuf), background_image_weak_notify, old_key);
+		g_hash_table_remove (background_images, image_key);
+	}
+
+	key = g_strdup (image_key);
+	g_hash_table_insert (background_images, key, pixbuf);
+	g_object_weak_ref (G_OBJECT (pixbuf), background_image_weak_notify, key);
+}
+
+static void
+background_image_load_free (BackgroundImageLoad *load)
+{
+	g_slist_free (load->screens);
+	g_object_unref (load->cancellable);
+	g_free (load->key);
+	g_slice_free (BackgroundImageLoad, load);
+}
+
+/* Nothing beyond the largest terminal window is ever shown */
+static void
+background_image_get_max_size (int *width,
+                               int *height)
+{
+	GList *toplevels, *l;
+
+	*width = *height = 0;
+
+	toplevels = ctk_window_list_toplevels ();
+	for (l = toplevels; l != NULL; l = l->next)
+	{
+		CtkWidget *window = l->data;
+		CtkAllocation alloc;
+
+		if (!TERMINAL_IS_WINDOW (window) || !ctk_widget_get_realized (window))
+			continue;
+
+		ctk_widget_get_allocation (window, &alloc);
+		*width = MAX (*width, alloc.width);
+		*height = MAX (*height, alloc.height);
+	}
+	g_list_free (toplevels);
+
+	/* Before the first window is laid out, it may become as large as the monitor */
+	if (*width <= 1 || *height <= 1)
+	{
+		CdkMonitor *monitor;
+		CdkRectangle geometry;
+
+		monitor = cdk_display_get_primary_monitor (cdk_display_get_default ());
+		if (monitor == NULL)
+		{
+			/* Don't crop at all */
+			*width = *height = 0;
+			return;
+		}
+
+		cdk_monitor_get_geometry (monitor, &geometry);
+		*width = MAX (*width, geometry.width);
+		*height = MAX (*height, geometry.height);
+	}
+}
+
+static void
+terminal_screen_set_background_image (TerminalScreen *screen,
+                                      GdkPixbuf      *pixbuf)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	GdkPixbuf *old_image = priv->bg_image;
+
+	if (pixbuf == old_image)
+		return;
+
+	priv->bg_image = pixbuf ? g_object_ref (pixbuf) : NULL;
+	if (old_image)
+		g_object_unref (old_image);
+
+	ctk_widget_queue_draw (CTK_WIDGET (screen));
+}
+
+static void
+background_image_loaded_cb (GObject      *source_object G_GNUC_UNUSED,
+                            GAsyncResult *result,
+                            gpointer      user_data)
+{
+	BackgroundImageLoad *load = user_data;
+	GdkPixbuf *pixbuf;
+	GError *error = NULL;
+	GSList *l;
+
+	/* Unless it was cancelled, and maybe superseded */
+	if (g_hash_table_lookup (background_image_loads, load->key) == load)
+		g_hash_table_remove (background_image_loads, load->key);
+
+	pixbuf = terminal_util_load_image_finish (result, &error);
+	if (pixbuf)
+		background_image_cache (load->key, pixbuf);
+	else
+	{
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		{
+			g_printerr ("Failed to load background image: %s\n", error->message);
+
+			if (background_image_failures == NULL)
+				background_image_failures = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+			g_hash_table_add (background_image_failures, g_strdup (load->key));
+		}
+		g_error_free (error);
+	}
+
+	for (l = load->screens; l != NULL; l = l->next)
+	{
+		TerminalScreen *screen = l->data;
+
+		g_clear_pointer (&screen->priv->bg_image_pending, g_free);
+		if (pixbuf)
+			terminal_screen_set_background_image (screen, pixbuf);
+	}
+
+	/* Now only held by the screens, if any */
+	if (pixbuf)
+		g_object_unref (pixbuf);
+	background_image_load_free (load);
+}
+
+static void
+terminal_screen_cancel_background_image (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	BackgroundImageLoad *load;
+
+	if (!priv->bg_image_pending)
+		return;
+
+	load = g_hash_table_lookup (background_image_loads, priv->bg_image_pending);
+	if (load)
+	{
+		load->screens = g_slist_remove (load->screens, screen);
+
+		/* Nobody wants it any more; the callback frees it */
+		if (load->screens == NULL)
+		{
+			g_hash_table_remove (background_image_loads, load->key);
+			g_cancellable_cancel (load->cancellable);
+		}
+	}
+
+	g_clear_pointer (&priv->bg_image_pending, g_free);
+}
+
+/* Shows @filename as soon as it is loaded, and the solid background until then */
+static void
+terminal_screen_load_background_image (TerminalScreen *screen,
+                                       const char     *filename)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	BackgroundImageLoad *load;
+	GdkPixbuf *pixbuf = NULL;
+	int width, height;
+	char *key;
+
+	terminal_screen_cancel_background_image (screen);
+
+	background_image_get_max_size (&width, &height);
+
+	key = background_image_get_key (filename);
+
+	/* Painted with the solid background instead, see the draw callback */
+	if (background_image_failures != NULL &&
+	    g_hash_table_contains (background_image_failures, key))
+	{
+		terminal_screen_set_background_image (screen, NULL);
+		g_free (key);
+		return;
+	}
+
+	if (background_images != NULL)
+		pixbuf = g_hash_table_lookup (background_images, key);
+
+	/* A cropped image that is too small stays until the larger one is ready */
+	terminal_screen_set_background_image (screen, pixbuf);
+	if (pixbuf != NULL &&
+	    terminal_util_image_covers (pixbuf,
+	                                width > 0 ? width : G_MAXINT,
+	                                height > 0 ? height : G_MAXINT))
+	{
+		g_free (key);
+		return;
+	}
+
+	if (background_image_loads == NULL)
+		background_image_loads = g_hash_table_new (g_str_hash, g_str_equal);
+
+	load = g_hash_table_lookup (background_image_loads, key);
+	if (load == NULL)
+	{
+		_terminal_debug_print (TERMINAL_DEBUG_PROFILE,
+		                       "Loading background image %s, up to %dx%d\n",
+		                       filename, width, height);
+
+		load = g_slice_new0 (BackgroundImageLoad);
+		load->key = g_strdup (key);
+		load->cancellable = g_cancellable_new ();
+		g_hash_table_insert (background_image_loads, load->key, load);
+		terminal_util_load_image_async (filename, width, height, load->cancellable,
+		                                background_image_loaded_cb, load);
+	}
+
+	load->screens = g_slist_prepend (load->screens, screen);
+	priv->bg_image_pending = key;
+}
+
+static void
+background_tiles_free (BackgroundTiles *tiles)
+{
+	cairo_surface_destroy (tiles->surface);
+	g_free (tiles);
+}
+
+static cairo_surface_t *
+background_image_get_tiles (GdkPixbuf *bg_image,
+                            cairo_t   *cr,
+                            int        width,
+                            int        height)
+{
+	BackgroundTiles *tiles;
+	cairo_t *tiles_cr;
+
+	tiles = g_object_get_data (G_OBJECT (bg_image), BACKGROUND_TILES_DATA_KEY);
+	if (tiles != NULL && tiles->width >= width && tiles->height >= height)
+		return tiles->surface;
+
+	if (tiles == NULL)
+	{
+		tiles = g_new0 (BackgroundTiles, 1);
+		g_object_set_data_full (G_OBJECT (bg_image), BACKGROUND_TILES_DATA_KEY,
+		                        tiles, (GDestroyNotify) background_tiles_free);
+	}
+	else
+		cairo_surface_destroy (tiles->surface);
+
+	/* Since the pattern starts at the origin, a larger surface can be
+	 * used for all smaller screens, too.
+	 */
+	tiles->width = MAX (tiles->width, width);
+	tiles->height = MAX (tiles->height, height);
+	tiles->surface = cairo_surface_create_similar (cairo_get_target (cr),
+	                                               CAIRO_CONTENT_COLOR_ALPHA,
+	                                               tiles->width, tiles->height);
+
+	tiles_cr = cairo_create (tiles->surface);
+	cdk_cairo_set_source_pixbuf (tiles_cr, bg_image, 0, 0);
+	cairo_pattern_set_extend (cairo_get_source (tiles_cr), CAIRO_EXTEND_REPEAT);
+	cairo_paint (tiles_cr);
+	cairo_destroy (tiles_cr);
+
+	return tiles->surface;
+}
+
+static gboolean
+terminal_screen_reload_background_image_cb (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	const TerminalProfileSnapshot *snapshot;
+
+	priv->bg_image_reload_id = 0;
+
+	snapshot = terminal_profile_get_snapshot (priv->profile);
+	if (snapshot->background_type == TERMINAL_BACKGROUND_IMAGE &&
+	    snapshot->background_image_file != NULL)
+		terminal_screen_load_background_image (screen, snapshot->background_image_file);
+
+	return FALSE; /* don't run again */
+}
+
 static gboolean
 terminal_screen_image_draw_cb (CtkWidget *widget,
 			       cairo_t   *cr,
@@ -677,41 +1240,67 @@ terminal_screen_image_draw_cb (CtkWidget *widget,
 {
 	TerminalScreen *screen = TERMINAL_SCREEN (widget);
 	TerminalScreenPrivate *priv = screen->priv;
-	GdkPixbuf *bg_image = priv->bg_image;
-	CdkRectangle target_rect;
+	GdkPixbuf *bg_image;
+	CdkRectangle clip_rect;
 	CtkAllocation alloc;
-	cairo_surface_t *child_surface;
 	cairo_t *child_cr;
 
+	ctk_widget_get_allocation (widget, &alloc);
+
+	/* The window grew beyond the part of the image that was kept. Loading
+	 * changes the image and queues a draw, so not while drawing. */
+	if (priv->bg_image != NULL && priv->bg_image_pending == NULL &&
+	    priv->bg_image_reload_id == 0 &&
+	    !terminal_util_image_covers (priv->bg_image, alloc.width, alloc.height))
+		priv->bg_image_reload_id =
+			g_idle_add ((GSourceFunc) terminal_screen_reload_background_image_cb, screen);
+
+	bg_image = priv->bg_image;
 	if (!bg_image)
+	{
+		/* Still loading, or failed to load */
+		cdk_cairo_set_source_rgba (cr, &priv->bg_placeholder);
+		cairo_paint (cr);
 		return FALSE;
+	}
 
-	ctk_widget_get_allocation (widget, &alloc);
+	if (!cdk_cairo_get_clip_rectangle (cr, &clip_rect))
+		return TRUE;
 
-	target_rect.x = 0;
-	target_rect.y = 0;
-	target_rect.width = alloc.width;
-	target_rect.height = alloc.height;
+	/* Reuse the offscreen surface as long as the size doesn't change */
+	if (priv->bg_child_surface != NULL &&
+	    (cairo_image_surface_get_width (priv->bg_child_surface) != alloc.width ||
+	     cairo_image_surface_get_height (priv->bg_child_surface) != alloc.height))
+	{
+		cairo_surface_destroy (priv->bg_child_surface);
+		priv->bg_child_surface = NULL;
+	}
 
-	child_surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, alloc.width, alloc.height);
-	child_cr = cairo_create (child_surface);
+	if (priv->bg_child_surface == NULL)
+		priv->bg_child_surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, alloc.width, alloc.height);
+
+	/* Only the exposed area needs to be rendered again */
+	child_cr = cairo_create (priv->bg_child_surface);
+	cdk_cairo_rectangle (child_cr, &clip_rect);
+	cairo_clip (child_cr);
+	cairo_set_operator (child_cr, CAIRO_OPERATOR_CLEAR);
+	cairo_paint (child_cr);
+	cairo_set_operator (child_cr, CAIRO_OPERATOR_OVER);
 
 	g_signal_handler_block (screen, priv->bg_image_callback_id);
 	ctk_widget_draw (widget, child_cr);
 	g_signal_handler_unblock (screen, priv->bg_image_callback_id);
 
-	cdk_cairo_set_source_pixbuf (cr, bg_image, 0, 0);
-	cairo_pattern_set_extend (cairo_get_source (cr), CAIRO_EXTEND_REPEAT);
+	cairo_destroy (child_cr);
 
-	cdk_cairo_rectangle (cr, &target_rect);
+	cairo_set_source_surface (cr, background_image_get_tiles (bg_image, cr, alloc.width, alloc.height), 0, 0);
+	cdk_cairo_rectangle (cr, &clip_rect);
 	cairo_fill (cr);
 
-	cairo_set_source_surface (cr, child_surface, 0, 0);
+	cairo_set_source_surface (cr, priv->bg_child_surface, 0, 0);
 	cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
-	cairo_paint (cr);
-
-	cairo_destroy (child_cr);
-	cairo_surface_destroy (child_surface);
+	cdk_cairo_rectangle (cr, &clip_rect);
+	cairo_fill (cr);
 
 	return TRUE;
 }
@@ -826,14 +1415,51 @@ terminal_screen_get_title_format (TerminalScreen *screen)
 		"%S"      /* TERMINAL_TITLE_IGNORE  */
 	};
 
-	return formats[terminal_profile_get_property_enum (priv->profile, TERMINAL_PROFILE_TITLE_MODE)];
+	return formats[terminal_profile_get_snapshot (priv->profile)->title_mode];
 }
 
-/**
- * terminal_screen_format_title::
- * @screen:
- * @raw_title: main ingredient
- * @titleptr <inout>: pointer of the current title string
+static void
+terminal_screen_parse_title_format (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	const char *arg;
+
+	priv->n_title_parts = 0;
+
+	for (arg = terminal_screen_get_title_format (screen); *arg; arg += 2)
+	{
+		TitlePart part;
+
+		g_assert (arg[0] == '%');
+		g_assert (priv->n_title_parts < TITLE_PARTS_MAX);
+
+		switch (arg[1])
+		{
+		case 'A':
+			part = TITLE_PART_DYNAMIC_OR_STATIC;
+			break;
+		case 'D':
+			part = TITLE_PART_DYNAMIC;
+			break;
+		case 'S':
+			part = TITLE_PART_STATIC;
+			break;
+		case '-':
+			part = TITLE_PART_SEPARATOR;
+			break;
+		default:
+			g_assert_not_reached ();
+		}
+
+		priv->title_parts[priv->n_title_parts++] = part;
+	}
+}
+
+/**
+ * terminal_screen_format_title::
+ * @screen:
+ * @raw_title: main ingredient
+ * @titleptr <inout>: pointer of the current title string
  *
  * Format title according @format, and stores it in <literal>*titleptr</literal>.
  * Always ensures that *titleptr will be non-NULL.
@@ -846,10 +1472,10 @@ terminal_screen_format_title (TerminalScreen *screen,
                               char **titleptr)
 {
 	TerminalScreenPrivate *priv = screen->priv;
-	const char *format, *arg;
 	const char *static_title = NULL;
 	GString *title;
 	gboolean add_sep = FALSE;
+	guint i;
 
 	g_assert (titleptr);
 
@@ -857,30 +1483,33 @@ terminal_screen_format_title (TerminalScreen *screen,
 	if (priv->override_title)
 		static_title = priv->override_title;
 	else
-		static_title = terminal_profile_get_property_string (priv->profile, TERMINAL_PROFILE_TITLE);
+		static_title = terminal_profile_get_snapshot (priv->profile)->title;
 
-	//title = g_string_sized_new (strlen (static_title) + strlen (raw_title) + 3 + 1);
-	title = g_string_sized_new (128);
+	if (priv->n_title_parts == 0)
+		terminal_screen_parse_title_format (screen);
 
-	format = terminal_screen_get_title_format (screen);
-	for (arg = format; *arg; arg += 2)
+	if (priv->title_buffer == NULL)
+		priv->title_buffer = g_string_sized_new (128);
+
+	title = priv->title_buffer;
+	g_string_truncate (title, 0);
+
+	for (i = 0; i < priv->n_title_parts; ++i)
 	{
 		const char *text_to_append = NULL;
 
-		g_assert (arg[0] == '%');
-
-		switch (arg[1])
+		switch (priv->title_parts[i])
 		{
-		case 'A':
+		case TITLE_PART_DYNAMIC_OR_STATIC:
 			text_to_append = raw_title ? raw_title : static_title;
 			break;
-		case 'D':
+		case TITLE_PART_DYNAMIC:
 			text_to_append = raw_title;
 			break;
-		case 'S':
+		case TITLE_PART_STATIC:
 			text_to_append = static_title;
 			break;
-		case '-':
+		case TITLE_PART_SEPARATOR:
 			text_to_append = NULL;
 			add_sep = TRUE;
 			break;
@@ -901,11 +1530,10 @@ terminal_screen_format_title (TerminalScreen *screen,
 	if (*titleptr == NULL || strcmp (title->str, *titleptr) != 0)
 	{
 		g_free (*titleptr);
-		*titleptr = g_string_free (title, FALSE);
+		*titleptr = g_strndup (title->str, title->len);
 		return TRUE;
 	}
 
-	g_string_free (title, TRUE);
 	return FALSE;
 }
 
@@ -927,290 +1555,390 @@ terminal_screen_cook_icon_title (TerminalScreen *screen)
 		g_object_notify (G_OBJECT (screen), "icon-title");
 }
 
+/* Applies the profile properties set in @dirty, or all of them if %NULL */
 static void
-terminal_screen_profile_notify_cb (TerminalProfile *profile,
-                                   GParamSpec *pspec,
-                                   TerminalScreen *screen)
+terminal_screen_apply_profile (TerminalScreen *screen,
+                               const guint32  *dirty)
 {
 	TerminalScreenPrivate *priv = screen->priv;
 	GObject *object = G_OBJECT (screen);
 	BteTerminal *bte_terminal = BTE_TERMINAL (screen);
-	const char *prop_name;
+	const TerminalProfileSnapshot *snapshot = terminal_profile_get_snapshot (priv->profile);
 	TerminalWindow *window;
 
-	if (pspec)
-		prop_name = pspec->name;
-	else
-		prop_name = NULL;
-
 	g_object_freeze_notify (object);
 
+	/* Before the geometry, which measures the scrollbar */
+	if (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_SCROLLBAR_POSITION))
+		_terminal_screen_update_scrollbar (screen);
+
 	if ((window = terminal_screen_get_window (screen)))
 	{
 		/* We need these in line for the set_size in
 		 * update_on_realize
 		 */
-		terminal_window_update_geometry (window);
+		if (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_SCROLLBAR_POSITION))
+			terminal_window_invalidate_geometry (window);
+
+		if (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_FONT) ||
+		    PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_USE_SYSTEM_FONT) ||
+		    PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_SCROLLBAR_POSITION))
+			terminal_window_update_geometry (window);
 
 		/* madars.vitolins@gmail.com 24/07/2014 -
 		 * update terminal window config
 		 * with the flag of copy selection to clipboard or not. */
-		terminal_window_update_copy_selection(screen, window);
+		if (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_COPY_SELECTION))
+			terminal_window_update_copy_selection(screen, window);
 	}
 
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_SCROLLBAR_POSITION))
-		_terminal_screen_update_scrollbar (screen);
+	/* A logger keeps the settings it was started with; start a new file */
+	if (priv->logger &&
+	    (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_LOG_DIRECTORY) ||
+	     PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_LOG_COMPRESS) ||
+	     PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_LOG_MAX_SIZE)))
+	{
+		terminal_screen_log_lines (screen, FALSE);
+		terminal_screen_stop_logging (screen);
+	}
+
+	if (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_LOG_OUTPUT) ||
+	    PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_LOG_DIRECTORY) ||
+	    PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_LOG_COMPRESS) ||
+	    PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_LOG_MAX_SIZE))
+		terminal_screen_update_logging (screen);
 
-	if (!prop_name ||
-	        prop_name == I_(TERMINAL_PROFILE_TITLE_MODE) ||
-	        prop_name == I_(TERMINAL_PROFILE_TITLE))
+	if (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_TITLE_MODE))
+		priv->n_title_parts = 0;
+
+	if (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_TITLE_MODE) ||
+	        PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_TITLE))
 	{
 		terminal_screen_cook_title (screen);
 		terminal_screen_cook_icon_title (screen);
 	}
 
 	if (ctk_widget_get_realized (CTK_WIDGET (screen)) &&
-	        (!prop_name ||
-	         prop_name == I_(TERMINAL_PROFILE_USE_SYSTEM_FONT) ||
-	         prop_name == I_(TERMINAL_PROFILE_FONT)))
+	        (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_USE_SYSTEM_FONT) ||
+	         PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_FONT)))
 		terminal_screen_change_font (screen);
 
-	if (!prop_name ||
-	        prop_name == I_(TERMINAL_PROFILE_USE_THEME_COLORS) ||
-	        prop_name == I_(TERMINAL_PROFILE_FOREGROUND_COLOR) ||
-	        prop_name == I_(TERMINAL_PROFILE_BACKGROUND_COLOR) ||
-	        prop_name == I_(TERMINAL_PROFILE_BACKGROUND_TYPE) ||
-	        prop_name == I_(TERMINAL_PROFILE_BACKGROUND_DARKNESS) ||
-	        prop_name == I_(TERMINAL_PROFILE_BACKGROUND_IMAGE) ||
-	        prop_name == I_(TERMINAL_PROFILE_BOLD_COLOR_SAME_AS_FG) ||
-	        prop_name == I_(TERMINAL_PROFILE_BOLD_COLOR) ||
-	        prop_name == I_(TERMINAL_PROFILE_PALETTE))
+	if (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_USE_THEME_COLORS) ||
+	        PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_FOREGROUND_COLOR) ||
+	        PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_BACKGROUND_COLOR) ||
+	        PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_BACKGROUND_TYPE) ||
+	        PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_BACKGROUND_DARKNESS) ||
+	        PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_BACKGROUND_IMAGE) ||
+	        PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_BOLD_COLOR_SAME_AS_FG) ||
+	        PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_BOLD_COLOR) ||
+	        PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_PALETTE))
 		update_color_scheme (screen);
 
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_SILENT_BELL))
-		bte_terminal_set_audible_bell (bte_terminal, !terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_SILENT_BELL));
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_WORD_CHARS))
+	if (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_SILENT_BELL))
+		bte_terminal_set_audible_bell (bte_terminal, !snapshot->silent_bell);
+	if (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_WORD_CHARS))
 		bte_terminal_set_word_char_exceptions (bte_terminal,
-		                                       terminal_profile_get_property_string (profile, TERMINAL_PROFILE_WORD_CHARS));
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_SCROLL_ON_KEYSTROKE))
+		                                       snapshot->word_chars);
+	if (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_SCROLL_ON_KEYSTROKE))
 		bte_terminal_set_scroll_on_keystroke (bte_terminal,
-		                                      terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_SCROLL_ON_KEYSTROKE));
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_SCROLL_ON_OUTPUT))
+		                                      snapshot->scroll_on_keystroke);
+	if (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_SCROLL_ON_OUTPUT))
 		bte_terminal_set_scroll_on_output (bte_terminal,
-		                                   terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_SCROLL_ON_OUTPUT));
-	if (!prop_name ||
-	        prop_name == I_(TERMINAL_PROFILE_SCROLLBACK_LINES) ||
-	        prop_name == I_(TERMINAL_PROFILE_SCROLLBACK_UNLIMITED))
-	{
-		glong lines = terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_SCROLLBACK_UNLIMITED) ?
-		              -1 : terminal_profile_get_property_int (profile, TERMINAL_PROFILE_SCROLLBACK_LINES);
-		bte_terminal_set_scrollback_lines (bte_terminal, lines);
-	}
+		                                   snapshot->scroll_on_output);
+	if (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_SCROLLBACK_LINES) ||
+	        PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_SCROLLBACK_UNLIMITED))
+		terminal_screen_apply_scrollback (screen);
 
 #ifdef ENABLE_SKEY
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_USE_SKEY))
+	if (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_USE_SKEY))
 	{
-		if (terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_USE_SKEY))
+		terminal_screen_skey_match_remove (screen);
+
+		if (snapshot->use_skey)
 		{
 			guint i;
 
 			for (i = 0; i < n_skey_regexes; ++i)
-			{
-				TagData *tag_data;
-
-				tag_data = g_slice_new (TagData);
-				tag_data->flavor = FLAVOR_SKEY;
-				tag_data->tag = bte_terminal_match_add_regex (bte_terminal, skey_regexes[i], 0);
-				bte_terminal_match_set_cursor_name (bte_terminal, tag_data->tag, "hand2");
-
-				priv->match_tags = g_slist_prepend (priv->match_tags, tag_data);
-			}
-		}
-		else
-		{
-			terminal_screen_skey_match_remove (screen);
+				terminal_screen_match_tag_add (screen,
+				                               bte_terminal_match_add_regex (bte_terminal, skey_regexes[i], 0),
+				                               MATCH_TAG_SKEY);
 		}
 	}
 #endif /* ENABLE_SKEY */
 
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_BACKSPACE_BINDING))
+	if (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_BACKSPACE_BINDING))
 		bte_terminal_set_backspace_binding (bte_terminal,
-		                                    terminal_profile_get_property_enum (profile, TERMINAL_PROFILE_BACKSPACE_BINDING));
+		                                    snapshot->backspace_binding);
 
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_DELETE_BINDING))
+	if (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_DELETE_BINDING))
 		bte_terminal_set_delete_binding (bte_terminal,
-		                                 terminal_profile_get_property_enum (profile, TERMINAL_PROFILE_DELETE_BINDING));
+		                                 snapshot->delete_binding);
 
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_ALLOW_BOLD))
+	if (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_ALLOW_BOLD))
 		bte_terminal_set_allow_bold (bte_terminal,
-		                             terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_ALLOW_BOLD));
+		                             snapshot->allow_bold);
 
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_CURSOR_BLINK_MODE))
+	if (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_CURSOR_BLINK_MODE))
 		bte_terminal_set_cursor_blink_mode (bte_terminal,
-		                                    terminal_profile_get_property_enum (priv->profile, TERMINAL_PROFILE_CURSOR_BLINK_MODE));
+		                                    snapshot->cursor_blink_mode);
 
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_CURSOR_SHAPE))
+	if (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_CURSOR_SHAPE))
 		bte_terminal_set_cursor_shape (bte_terminal,
-		                               terminal_profile_get_property_enum (priv->profile, TERMINAL_PROFILE_CURSOR_SHAPE));
+		                               snapshot->cursor_shape);
 
-	if (!prop_name || prop_name == I_(TERMINAL_PROFILE_USE_URLS))
+	if (PROFILE_PROP_DIRTY (dirty, TERMINAL_PROFILE_PROP_USE_URLS))
 	{
-		if (terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_USE_URLS))
-		{
-			guint i;
+		terminal_screen_url_match_remove (screen);
 
-			for (i = 0; i < n_url_regexes; ++i)
-			{
-				TagData *tag_data;
+		if (snapshot->use_urls && url_regex)
+			terminal_screen_match_tag_add (screen,
+			                               bte_terminal_match_add_regex (bte_terminal, url_regex, 0),
+			                               MATCH_TAG_URL);
+	}
+	g_object_thaw_notify (object);
+}
+
+static void
+terminal_screen_flush_profile_changes (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	guint32 dirty[PROFILE_DIRTY_WORDS];
 
-				tag_data = g_slice_new (TagData);
-				tag_data->flavor = url_regex_flavors[i];
-				tag_data->tag = bte_terminal_match_add_regex (bte_terminal, url_regexes[i], 0);
-				bte_terminal_match_set_cursor_name (bte_terminal, tag_data->tag, "hand2");
+	memcpy (dirty, priv->profile_dirty, sizeof (dirty));
+	memset (priv->profile_dirty, 0, sizeof (priv->profile_dirty));
 
-				priv->match_tags = g_slist_prepend (priv->match_tags, tag_data);
-			}
-		}
-		else
-		{
-			terminal_screen_url_match_remove (screen);
-		}
+	if (priv->profile)
+		terminal_screen_apply_profile (screen, dirty);
+}
+
+static gboolean
+terminal_screen_profile_tick_cb (CtkWidget      *widget G_GNUC_UNUSED,
+                                 CdkFrameClock  *frame_clock G_GNUC_UNUSED,
+                                 TerminalScreen *screen)
+{
+	screen->priv->profile_tick_id = 0;
+	terminal_screen_flush_profile_changes (screen);
+
+	return FALSE; /* don't run again */
+}
+
+static gboolean
+terminal_screen_profile_idle_cb (TerminalScreen *screen)
+{
+	screen->priv->profile_idle_id = 0;
+	terminal_screen_flush_profile_changes (screen);
+
+	return FALSE; /* don't run again */
+}
+
+static void
+terminal_screen_cancel_profile_changes (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+
+	if (priv->profile_tick_id != 0)
+	{
+		ctk_widget_remove_tick_callback (CTK_WIDGET (screen), priv->profile_tick_id);
+		priv->profile_tick_id = 0;
 	}
-	g_object_thaw_notify (object);
+	if (priv->profile_idle_id != 0)
+	{
+		g_source_remove (priv->profile_idle_id);
+		priv->profile_idle_id = 0;
+	}
+
+	memset (priv->profile_dirty, 0, sizeof (priv->profile_dirty));
 }
 
+/* Property changes are collected and applied together once per frame, so
+ * that dragging a slider in the profile editor doesn't redo the work for
+ * every motion event on every screen using the profile.
+ */
 static void
-update_color_scheme (TerminalScreen *screen)
+terminal_screen_profile_notify_cb (TerminalProfile *profile G_GNUC_UNUSED,
+                                   GParamSpec *pspec,
+                                   TerminalScreen *screen)
 {
 	TerminalScreenPrivate *priv = screen->priv;
-	TerminalProfile *profile = priv->profile;
-	CdkRGBA colors[TERMINAL_PALETTE_SIZE];
-	const CdkRGBA *bold_rgba;
-	TerminalBackgroundType bg_type;
-	const gchar *bg_image_file;
-	double bg_alpha = 1.0;
-	CdkRGBA fg, bg;
-	CdkRGBA *c;
-	guint n_colors;
+	guint prop_id;
+
+	n_profile_notifies++;
+
+	if (!pspec)
+	{
+		/* New profile, apply everything right away */
+		terminal_screen_cancel_profile_changes (screen);
+		terminal_screen_apply_profile (screen, NULL);
+		return;
+	}
+
+	prop_id = pspec->param_id;
+	if (prop_id >= TERMINAL_PROFILE_N_PROPS)
+		return;
+
+	priv->profile_dirty[prop_id / 32] |= 1u << (prop_id % 32);
+
+	if (priv->profile_tick_id != 0 || priv->profile_idle_id != 0)
+		return;
+
+	/* Unrealized screens have no frame clock to wait for */
+	if (ctk_widget_get_realized (CTK_WIDGET (screen)))
+		priv->profile_tick_id =
+			ctk_widget_add_tick_callback (CTK_WIDGET (screen),
+			                              (CtkTickCallback) terminal_screen_profile_tick_cb,
+			                              screen, NULL);
+	else
+		priv->profile_idle_id =
+			g_idle_add ((GSourceFunc) terminal_screen_profile_idle_cb, screen);
+}
+
+static void
+terminal_screen_theme_changed_cb (CtkSettings *settings G_GNUC_UNUSED,
+                                  GParamSpec  *pspec,
+                                  gpointer     user_data G_GNUC_UNUSED)
+{
+	theme_generation++;
+
+	_terminal_debug_print (TERMINAL_DEBUG_PROFILE,
+	                       "Theme changed (%s), generation %u\n",
+	                       pspec->name, theme_generation);
+}
+
+static void
+terminal_screen_get_theme_colors (TerminalScreen *screen,
+                                  CdkRGBA        *fg,
+                                  CdkRGBA        *bg)
+{
 	CtkStyleContext *context;
-	GError *error = NULL;
+	CdkRGBA *c;
 
 	context = ctk_widget_get_style_context (CTK_WIDGET (screen));
 	ctk_style_context_save (context);
 	ctk_style_context_set_state (context, CTK_STATE_FLAG_NORMAL);
-	ctk_style_context_get_color (context, CTK_STATE_FLAG_NORMAL, &fg);
+	ctk_style_context_get_color (context, CTK_STATE_FLAG_NORMAL, fg);
 
 	ctk_style_context_get (context, CTK_STATE_FLAG_NORMAL,
 			       CTK_STYLE_PROPERTY_BACKGROUND_COLOR,
 			       &c, NULL);
-	bg = *c;
+	*bg = *c;
 	cdk_rgba_free (c);
 
 	ctk_style_context_restore (context);
+}
 
-	bold_rgba = NULL;
+static void
+update_color_scheme (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	TerminalProfile *profile = priv->profile;
+	const TerminalProfileSnapshot *snapshot = terminal_profile_get_snapshot (profile);
+	const TerminalColorScheme *scheme;
+	TerminalBackgroundType bg_type;
+	const gchar *bg_image_file;
 
-	if (!terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_USE_THEME_COLORS))
+	/* Screens may be styled differently, so each reads its own */
+	if (priv->theme_colors_generation != theme_generation)
 	{
-		const CdkRGBA *fg_rgba, *bg_rgba;
-
-		fg_rgba = terminal_profile_get_property_boxed (profile, TERMINAL_PROFILE_FOREGROUND_COLOR);
-		bg_rgba = terminal_profile_get_property_boxed (profile, TERMINAL_PROFILE_BACKGROUND_COLOR);
-
-		if (!terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_BOLD_COLOR_SAME_AS_FG))
-			bold_rgba = terminal_profile_get_property_boxed (profile, TERMINAL_PROFILE_BOLD_COLOR);
-
-		if (fg_rgba)
-			fg = *fg_rgba;
-		if (bg_rgba)
-			bg = *bg_rgba;
+		terminal_screen_get_theme_colors (screen, &priv->theme_fg, &priv->theme_bg);
+		priv->theme_colors_generation = theme_generation;
 	}
 
-	n_colors = G_N_ELEMENTS (colors);
-	terminal_profile_get_palette (priv->profile, colors, &n_colors);
+	scheme = terminal_profile_get_color_scheme (profile, &priv->theme_fg, &priv->theme_bg);
+	if (scheme->serial == priv->applied_color_scheme)
+		return;
+	priv->applied_color_scheme = scheme->serial;
 
-	bg_type = terminal_profile_get_property_enum (profile, TERMINAL_PROFILE_BACKGROUND_TYPE);
-	bg_image_file = terminal_profile_get_property_string (profile, TERMINAL_PROFILE_BACKGROUND_IMAGE_FILE);
+	bg_type = snapshot->background_type;
+	bg_image_file = snapshot->background_image_file;
 
-	if (bg_type == TERMINAL_BACKGROUND_TRANSPARENT)
-		bg_alpha = terminal_profile_get_property_double (profile, TERMINAL_PROFILE_BACKGROUND_DARKNESS);
-	else if (bg_type == TERMINAL_BACKGROUND_IMAGE)
-	  bg_alpha = 0.0;
-	bg.alpha = bg_alpha;
+	priv->bg_placeholder = scheme->background;
+	priv->bg_placeholder.alpha = 1.0;
 
 	if (bg_type == TERMINAL_BACKGROUND_IMAGE)
 	{
 		if (!priv->bg_image_callback_id)
 			priv->bg_image_callback_id = g_signal_connect (screen, "draw", G_CALLBACK (terminal_screen_image_draw_cb), NULL);
 
-		g_clear_object (&priv->bg_image);
-		priv->bg_image = gdk_pixbuf_new_from_file (bg_image_file, &error);
-
-		if (error) {
-			g_printerr ("Failed to load background image: %s\n", error->message);
-			g_clear_error (&error);
+		if (bg_image_file != NULL)
+			terminal_screen_load_background_image (screen, bg_image_file);
+		else
+		{
+			terminal_screen_cancel_background_image (screen);
+			terminal_screen_set_background_image (screen, NULL);
 		}
-
-		ctk_widget_queue_draw (CTK_WIDGET (screen));
 	} else {
 		if (priv->bg_image_callback_id)
 		{
 			g_signal_handler_disconnect (screen, priv->bg_image_callback_id);
 			priv->bg_image_callback_id = 0;
 		}
+
+		terminal_screen_cancel_background_image (screen);
+		g_clear_object (&priv->bg_image);
+		if (priv->bg_child_surface)
+		{
+			cairo_surface_destroy (priv->bg_child_surface);
+			priv->bg_child_surface = NULL;
+		}
 	}
 
 	bte_terminal_set_colors (BTE_TERMINAL (screen),
-	                         &fg, &bg,
-	                         colors, n_colors);
-	if (bold_rgba)
+	                         &scheme->foreground, &scheme->background,
+	                         scheme->palette, scheme->n_palette);
+	if (scheme->has_bold)
 		bte_terminal_set_color_bold (BTE_TERMINAL (screen),
-		                             bold_rgba);
+		                             &scheme->bold);
 }
 
-void
+/* Returns whether the font of @screen changed */
+gboolean
 terminal_screen_set_font (TerminalScreen *screen)
 {
 	TerminalScreenPrivate *priv = screen->priv;
+	TerminalApp *app = terminal_app_get ();
 	TerminalProfile *profile;
-	PangoFontDescription *desc;
+	const PangoFontDescription *desc, *current;
 
 	profile = priv->profile;
 
-	if (terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_USE_SYSTEM_FONT))
-		g_object_get (terminal_app_get (), "system-font", &desc, NULL);
+	if (terminal_profile_get_snapshot (profile)->use_system_font)
+		desc = terminal_app_get_system_font (app);
 	else
-		g_object_get (profile, TERMINAL_PROFILE_FONT, &desc, NULL);
+		desc = terminal_profile_get_property_boxed (profile, TERMINAL_PROFILE_FONT);
 	g_assert (desc);
 
-	if (pango_font_description_get_size_is_absolute (desc))
-		pango_font_description_set_absolute_size (desc,
-		        priv->font_scale *
-		        pango_font_description_get_size (desc));
-	else
-		pango_font_description_set_size (desc,
-		                                 priv->font_scale *
-		                                 pango_font_description_get_size (desc));
+	desc = terminal_app_get_scaled_font (app, desc, priv->font_scale);
+
+	current = bte_terminal_get_font (BTE_TERMINAL (screen));
+	if (current != NULL && pango_font_description_equal (current, desc))
+		return FALSE;
 
 	bte_terminal_set_font (BTE_TERMINAL (screen), desc);
 
-	pango_font_description_free (desc);
+	return TRUE;
 }
 
-static void
-terminal_screen_system_font_notify_cb (TerminalApp    *app G_GNUC_UNUSED,
-				       GParamSpec     *pspec G_GNUC_UNUSED,
-				       TerminalScreen *screen)
+/**
+ * terminal_screen_update_system_font:
+ * @screen:
+ *
+ * Applies a change of the system font to @screen, if it uses it. The
+ * window isn't resized; the caller does that once for all its screens.
+ *
+ * Returns: %TRUE if the font of @screen changed
+ */
+gboolean
+terminal_screen_update_system_font (TerminalScreen *screen)
 {
 	TerminalScreenPrivate *priv = screen->priv;
 
 	if (!ctk_widget_get_realized (CTK_WIDGET (screen)))
-		return;
+		return FALSE;
 
-	if (!terminal_profile_get_property_boolean (priv->profile, TERMINAL_PROFILE_USE_SYSTEM_FONT))
-		return;
+	if (!terminal_profile_get_snapshot (priv->profile)->use_system_font)
+		return FALSE;
 
-	terminal_screen_change_font (screen);
+	return terminal_screen_set_font (screen);
 }
 
 static void
@@ -1344,61 +2072,19 @@ get_child_command (TerminalScreen *screen,
                    GError        **err)
 {
 	TerminalScreenPrivate *priv = screen->priv;
-	TerminalProfile *profile;
-	char **argv;
 
 	g_assert (spawn_flags_p != NULL && argv_p != NULL);
 
-	profile = priv->profile;
-
-	*argv_p = argv = NULL;
-
 	if (priv->override_command)
 	{
-		argv = g_strdupv (priv->override_command);
-
-		*spawn_flags_p |= G_SPAWN_SEARCH_PATH;
-	}
-	else if (terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_USE_CUSTOM_COMMAND))
-	{
-		if (!g_shell_parse_argv (terminal_profile_get_property_string (profile, TERMINAL_PROFILE_CUSTOM_COMMAND),
-		                         NULL, &argv,
-		                         err))
-			return FALSE;
-
+		*argv_p = g_strdupv (priv->override_command);
 		*spawn_flags_p |= G_SPAWN_SEARCH_PATH;
-	}
-	else
-	{
-		const char *only_name;
-		char *shell;
-		int argc = 0;
-
-		shell = egg_shell (shell_env);
-
-		only_name = strrchr (shell, '/');
-		if (only_name != NULL)
-			only_name++;
-		else
-			only_name = shell;
-
-		argv = g_new (char*, 3);
-
-		argv[argc++] = shell;
 
-		if (terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_LOGIN_SHELL))
-			argv[argc++] = g_strconcat ("-", only_name, NULL);
-		else
-			argv[argc++] = g_strdup (only_name);
-
-		argv[argc++] = NULL;
-
-		*spawn_flags_p |= G_SPAWN_FILE_AND_ARGV_ZERO;
+		return TRUE;
 	}
 
-	*argv_p = argv;
-
-	return TRUE;
+	return terminal_util_get_profile_command (priv->profile, shell_env,
+	                                          spawn_flags_p, argv_p, err);
 }
 
 static char**
@@ -1408,80 +2094,19 @@ get_child_environment (TerminalScreen *screen,
 	TerminalScreenPrivate *priv = screen->priv;
 	CtkWidget *term = CTK_WIDGET (screen);
 	CtkWidget *window;
-	CdkDisplay *display;
-	char **env;
-	char *e, *v;
-	GHashTable *env_table;
-	GHashTableIter iter;
-	GPtrArray *retval;
-	guint i;
-	gchar **list_schemas = NULL;
-	gboolean schema_exists;
+	CdkWindow *cdk_window;
 
 	window = ctk_widget_get_toplevel (term);
 	g_assert (window != NULL);
 	g_assert (ctk_widget_is_toplevel (window));
-	display = cdk_window_get_display (ctk_widget_get_window (window));
-
-	env_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
-
-	/* First take the factory's environment */
-	env = g_listenv ();
-	for (i = 0; env[i]; ++i)
-		g_hash_table_insert (env_table, env[i], g_strdup (g_getenv (env[i])));
-	g_free (env); /* the strings themselves are now owned by the hash table */
-
-	/* and then merge the child environment, if any */
-	env = priv->initial_env;
-	if (env)
-	{
-		for (i = 0; env[i]; ++i)
-		{
-			v = strchr (env[i], '=');
-			if (v)
-				g_hash_table_replace (env_table, g_strndup (env[i], v - env[i]), g_strdup (v + 1));
-			else
-				g_hash_table_replace (env_table, g_strdup (env[i]), NULL);
-		}
-	}
-
-	g_hash_table_remove (env_table, "COLUMNS");
-	g_hash_table_remove (env_table, "LINES");
-	g_hash_table_remove (env_table, "CAFE_DESKTOP_ICON");
-
-	g_hash_table_replace (env_table, g_strdup ("TERM"), g_strdup ("xterm-256color")); /* FIXME configurable later? */
-
-	/* FIXME: moving the tab between windows, or the window between displays will make the next two invalid... */
-	g_hash_table_replace (env_table, g_strdup ("WINDOWID"), g_strdup_printf ("%ld", CDK_WINDOW_XID (ctk_widget_get_window (window))));
-	g_hash_table_replace (env_table, g_strdup ("DISPLAY"), g_strdup (cdk_display_get_name (display)));
-
-	g_settings_schema_source_list_schemas (g_settings_schema_source_get_default (), TRUE, &list_schemas, NULL);
-
-	schema_exists = FALSE;
-	for (i = 0; list_schemas[i] != NULL; i++) {
-		if (g_strcmp0 (list_schemas[i], CONF_PROXY_SCHEMA) == 0)
-		{
-			schema_exists = TRUE;
-			break;
-		}
-	}
-
-	g_strfreev (list_schemas);
-
-	if (schema_exists == TRUE) {
-		terminal_util_add_proxy_env (env_table);
-	}
-
-	retval = g_ptr_array_sized_new (g_hash_table_size (env_table));
-	g_hash_table_iter_init (&iter, env_table);
-	while (g_hash_table_iter_next (&iter, (gpointer *) &e, (gpointer *) &v))
-		g_ptr_array_add (retval, g_strdup_printf ("%s=%s", e, v ? v : ""));
-	g_ptr_array_add (retval, NULL);
+	cdk_window = ctk_widget_get_window (window);
 
-	*shell = g_strdup (g_hash_table_lookup (env_table, "SHELL"));
-
-	g_hash_table_destroy (env_table);
-	return (char **) g_ptr_array_free (retval, FALSE);
+	/* FIXME: moving the tab between windows, or the window between displays will make WINDOWID and DISPLAY invalid... */
+	return terminal_app_get_child_environment (terminal_app_get (),
+	                                           priv->initial_env,
+	                                           cdk_window_get_display (cdk_window),
+	                                           CDK_WINDOW_XID (cdk_window),
+	                                           shell);
 }
 
 enum
@@ -1556,6 +2181,12 @@ static void term_spawn_callback (CtkWidget *terminal,
 	{
 		TerminalScreenPrivate *priv = screen->priv;
 		priv->child_pid = pid;
+
+		terminal_app_record_spawn_latency (terminal_app_get (),
+		                                   g_get_monotonic_time () - priv->launch_time);
+		terminal_screen_update_logging (screen);
+
+		_terminal_startup_mark (TERMINAL_STARTUP_CHILD_SPAWNED);
 	}
 }
 
@@ -1570,8 +2201,39 @@ terminal_screen_launch_child_cb (TerminalScreen *screen)
 	const char *working_dir;
 	BtePtyFlags pty_flags = BTE_PTY_DEFAULT;
 	GSpawnFlags spawn_flags = 0;
+	BtePty *pty;
+	GPid pid;
 
 	priv->launch_child_source_id = 0;
+	priv->launch_time = g_get_monotonic_time ();
+
+	if (priv->initial_working_directory)
+		working_dir = priv->initial_working_directory;
+	else
+		working_dir = g_get_home_dir ();
+
+	if (!priv->override_command &&
+	    terminal_app_take_pooled_child (terminal_app_get (), priv->profile,
+	                                    working_dir, priv->initial_env,
+	                                    &pty, &pid))
+	{
+		_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+		                       "[screen %p] adopting pooled child process %d\n",
+		                       screen, (int) pid);
+
+		bte_terminal_set_pty (terminal, pty);
+		bte_terminal_watch_child (terminal, pid);
+		g_object_unref (pty);
+
+		priv->child_pid = pid;
+
+		/* Not a spawn; counted as a shell pool hit instead */
+		terminal_screen_update_logging (screen);
+
+		_terminal_startup_mark (TERMINAL_STARTUP_CHILD_SPAWNED);
+
+		return FALSE; /* don't run again */
+	}
 
 	_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
 	                       "[screen %p] now launching the child process\n",
@@ -1579,11 +2241,6 @@ terminal_screen_launch_child_cb (TerminalScreen *screen)
 
 	env = get_child_environment (screen, &shell);
 
-	if (priv->initial_working_directory)
-		working_dir = priv->initial_working_directory;
-	else
-		working_dir = g_get_home_dir ();
-
 	if (!get_child_command (screen, shell, &spawn_flags, &argv, &err))
 	{
 		handle_error_child (screen, err);
@@ -1621,14 +2278,97 @@ terminal_screen_launch_child_on_idle (TerminalScreen *screen)
 {
 	TerminalScreenPrivate *priv = screen->priv;
 
-	if (priv->launch_child_source_id != 0)
+	if (priv->launch_child_source_id != 0)
+		return;
+
+	_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+	                       "[screen %p] scheduling launching the child process on idle\n",
+	                       screen);
+
+	priv->launch_child_source_id = g_idle_add ((GSourceFunc) terminal_screen_launch_child_cb, screen);
+}
+
+static gboolean
+terminal_screen_trickle_launch_cb (gpointer user_data G_GNUC_UNUSED)
+{
+	TerminalScreen *screen;
+
+	screen = g_queue_peek_head (&deferred_launches);
+	if (screen != NULL)
+		terminal_screen_launch_deferred_child (screen);
+
+	if (!g_queue_is_empty (&deferred_launches))
+		return TRUE; /* run again */
+
+	deferred_launch_source_id = 0;
+	return FALSE; /* don't run again */
+}
+
+/**
+ * terminal_screen_defer_launch_child:
+ * @screen:
+ * @trickle_interval: interval in milliseconds between launches of deferred
+ *   children in the background, or 0 to only launch them on demand
+ *
+ * Keeps @screen from launching its child until
+ * terminal_screen_launch_deferred_child() is called, e.g. when its tab is
+ * first selected. The title, working directory and profile are kept until
+ * then. If @trickle_interval is not 0, deferred children are also launched
+ * in the background, one at a time, in the order they were deferred.
+ */
+void
+terminal_screen_defer_launch_child (TerminalScreen *screen,
+                                    guint           trickle_interval)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+
+	g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+	/* Too late if it was launched already */
+	if (priv->launch_child_source_id == 0 || priv->launch_deferred)
+		return;
+
+	_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+	                       "[screen %p] deferring launching the child process\n",
+	                       screen);
+
+	g_source_remove (priv->launch_child_source_id);
+	priv->launch_child_source_id = 0;
+
+	priv->launch_deferred = TRUE;
+	g_queue_push_tail (&deferred_launches, screen);
+
+	if (trickle_interval > 0 && deferred_launch_source_id == 0)
+		deferred_launch_source_id = g_timeout_add_full (G_PRIORITY_LOW, trickle_interval,
+		                                                terminal_screen_trickle_launch_cb,
+		                                                NULL, NULL);
+}
+
+/**
+ * terminal_screen_launch_deferred_child:
+ * @screen:
+ *
+ * Launches the child of @screen if it was deferred with
+ * terminal_screen_defer_launch_child(); does nothing otherwise.
+ */
+void
+terminal_screen_launch_deferred_child (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+
+	g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+	if (!priv->launch_deferred)
 		return;
 
+	priv->launch_deferred = FALSE;
+	g_queue_remove (&deferred_launches, screen);
+
 	_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
-	                       "[screen %p] scheduling launching the child process on idle\n",
-	                       screen);
+	                       "[screen %p] launching deferred child process, %u still deferred\n",
+	                       screen, g_queue_get_length (&deferred_launches));
 
-	priv->launch_child_source_id = g_idle_add ((GSourceFunc) terminal_screen_launch_child_cb, screen);
+	terminal_screen_launch_child_on_idle (screen);
 }
 
 static TerminalScreenPopupInfo *
@@ -1825,13 +2565,120 @@ terminal_screen_get_dynamic_icon_title (TerminalScreen *screen)
 	return screen->priv->raw_icon_title;
 }
 
+/**
+ * terminal_screen_get_pid:
+ * @screen:
+ *
+ * Returns: the PID of the child process, or -1 if there is none
+ */
+GPid
+terminal_screen_get_pid (TerminalScreen *screen)
+{
+	return screen->priv->child_pid;
+}
+
+/**
+ * terminal_screen_get_output_events:
+ * @screen:
+ *
+ * Returns: the number of times the child's output has changed the
+ *   contents of @screen. BTE doesn't count the bytes it reads.
+ */
+guint64
+terminal_screen_get_output_events (TerminalScreen *screen)
+{
+	return screen->priv->output_events;
+}
+
+/* Returns the number of profile property changes delivered to screens */
+guint64
+_terminal_screen_get_n_profile_notifies (void)
+{
+	return n_profile_notifies;
+}
+
+/* Returns the number of title changes from children that were dropped
+ * because another one followed within the same frame
+ */
+guint64
+_terminal_screen_get_n_titles_suppressed (void)
+{
+	return n_titles_suppressed;
+}
+
+/**
+ * terminal_screen_set_scrollback_cap:
+ * @screen:
+ * @lines: the most scrollback lines to keep, or -1 for the profile's setting
+ *
+ * Limits the scrollback of @screen below what its profile allows, dropping
+ * the oldest lines. Used by the app's scrollback budget; the limit is
+ * lifted when @screen is next shown.
+ */
+void
+terminal_screen_set_scrollback_cap (TerminalScreen *screen,
+                                    glong           lines)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+
+	g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+	priv->scrollback_cap = lines;
+
+	if (priv->profile != NULL)
+		terminal_screen_apply_scrollback (screen);
+}
+
+/**
+ * terminal_screen_get_scrollback_usage:
+ * @screen:
+ * @n_lines: (allow-none): return location for the number of scrollback
+ *   lines held, not counting the screen, or %NULL
+ * @n_columns: (allow-none): return location for the width of the lines,
+ *   or %NULL
+ * @cap: (allow-none): return location for the limit set with
+ *   terminal_screen_set_scrollback_cap(), or %NULL
+ * @last_viewed: (allow-none): return location for the monotonic time
+ *   @screen was last shown, or %NULL; 0 if it is showing now
+ *
+ * Describes the scrollback of @screen, for estimating its memory use; BTE
+ * doesn't say how much it really uses. @n_lines can be compared with
+ * @cap, which is in scrollback lines too.
+ */
+void
+terminal_screen_get_scrollback_usage (TerminalScreen *screen,
+                                      glong          *n_lines,
+                                      glong          *n_columns,
+                                      glong          *cap,
+                                      gint64         *last_viewed)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	BteTerminal *bte_terminal = BTE_TERMINAL (screen);
+	CtkAdjustment *adjustment;
+
+	if (n_lines)
+	{
+		adjustment = ctk_scrollable_get_vadjustment (CTK_SCROLLABLE (screen));
+		*n_lines = (glong) (ctk_adjustment_get_upper (adjustment) - ctk_adjustment_get_lower (adjustment)) -
+		           bte_terminal_get_row_count (bte_terminal);
+		*n_lines = MAX (*n_lines, 0);
+	}
+	if (n_columns)
+		*n_columns = bte_terminal_get_column_count (bte_terminal);
+	if (cap)
+		*cap = priv->scrollback_cap;
+	if (last_viewed)
+		*last_viewed = ctk_widget_get_mapped (CTK_WIDGET (screen)) ? 0 : priv->last_viewed;
+}
+
 /**
  * terminal_screen_get_current_dir:
  * @screen:
  *
- * Tries to determine the current working directory of the foreground process
- * in @screen's PTY, falling back to the current working directory of the
- * primary child.
+ * Returns the working directory last reported by the shell with OSC 7 if
+ * it is on this host. Otherwise tries to determine the current working
+ * directory of the foreground process in @screen's PTY, falling back to the
+ * current working directory of the primary child.
  *
  * Returns: a newly allocated string containing the current working directory,
  *   or %NULL on failure
@@ -1845,8 +2692,14 @@ terminal_screen_get_current_dir (TerminalScreen *screen)
 	pty = bte_terminal_get_pty (BTE_TERMINAL (screen));
 	if (pty != NULL)
 	{
+		const char *reported_cwd;
 		char *cwd;
 
+		/* Use what the shell reported, if it does and is local */
+		reported_cwd = terminal_screen_get_local_reported_cwd (screen);
+		if (reported_cwd != NULL)
+			return g_strdup (reported_cwd);
+
 #if 0
 		/* Get the foreground process ID */
 		cwd = cwd_of_pid (tcgetpgrp (priv->pty_fd));
@@ -1918,46 +2771,335 @@ terminal_screen_get_font_scale (TerminalScreen *screen)
 }
 
 static void
-terminal_screen_window_title_changed (BteTerminal *bte_terminal,
+terminal_screen_flush_titles (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	BteTerminal *bte_terminal = BTE_TERMINAL (screen);
+
+	if (priv->window_title_pending)
+	{
+		priv->window_title_pending = FALSE;
+		terminal_screen_set_dynamic_title (screen,
+		                                   bte_terminal_get_window_title (bte_terminal),
+		                                   FALSE);
+	}
+
+	if (priv->icon_title_pending)
+	{
+		priv->icon_title_pending = FALSE;
+		terminal_screen_set_dynamic_icon_title (screen,
+		                                        bte_terminal_get_icon_title (bte_terminal),
+		                                        FALSE);
+	}
+}
+
+static gboolean
+terminal_screen_title_tick_cb (CtkWidget      *widget G_GNUC_UNUSED,
+                               CdkFrameClock  *frame_clock G_GNUC_UNUSED,
+                               TerminalScreen *screen)
+{
+	screen->priv->title_tick_id = 0;
+	terminal_screen_flush_titles (screen);
+
+	return FALSE; /* don't run again */
+}
+
+static gboolean
+terminal_screen_title_idle_cb (TerminalScreen *screen)
+{
+	screen->priv->title_idle_id = 0;
+	terminal_screen_flush_titles (screen);
+
+	return FALSE; /* don't run again */
+}
+
+/* Programs may set the title many times a second; only the last title
+ * set before the next frame is used.
+ */
+static void
+terminal_screen_queue_titles (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+
+	if (priv->title_tick_id != 0 || priv->title_idle_id != 0)
+		return;
+
+	if (ctk_widget_get_realized (CTK_WIDGET (screen)))
+		priv->title_tick_id =
+			ctk_widget_add_tick_callback (CTK_WIDGET (screen),
+			                              (CtkTickCallback) terminal_screen_title_tick_cb,
+			                              screen, NULL);
+	else
+		priv->title_idle_id =
+			g_idle_add ((GSourceFunc) terminal_screen_title_idle_cb, screen);
+}
+
+static void
+terminal_screen_cancel_titles (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+
+	if (priv->title_tick_id != 0)
+	{
+		ctk_widget_remove_tick_callback (CTK_WIDGET (screen), priv->title_tick_id);
+		priv->title_tick_id = 0;
+	}
+	if (priv->title_idle_id != 0)
+	{
+		g_source_remove (priv->title_idle_id);
+		priv->title_idle_id = 0;
+	}
+
+	priv->window_title_pending = FALSE;
+	priv->icon_title_pending = FALSE;
+}
+
+static void
+terminal_screen_window_title_changed (BteTerminal *bte_terminal G_GNUC_UNUSED,
                                       TerminalScreen *screen)
 {
-	terminal_screen_set_dynamic_title (screen,
-	                                   bte_terminal_get_window_title (bte_terminal),
-	                                   FALSE);
+	TerminalScreenPrivate *priv = screen->priv;
+
+	if (priv->window_title_pending)
+		n_titles_suppressed++;
+
+	priv->window_title_pending = TRUE;
+	terminal_screen_queue_titles (screen);
 }
 
 static void
-terminal_screen_icon_title_changed (BteTerminal *bte_terminal,
+terminal_screen_icon_title_changed (BteTerminal *bte_terminal G_GNUC_UNUSED,
                                     TerminalScreen *screen)
 {
-	terminal_screen_set_dynamic_icon_title (screen,
-	                                        bte_terminal_get_icon_title (bte_terminal),
-	                                        FALSE);
+	TerminalScreenPrivate *priv = screen->priv;
+
+	if (priv->icon_title_pending)
+		n_titles_suppressed++;
+
+	priv->icon_title_pending = TRUE;
+	terminal_screen_queue_titles (screen);
 }
 
 static void
-terminal_screen_text_inserted (BteTerminal    *bte_terminal G_GNUC_UNUSED,
-			       TerminalScreen *screen)
+terminal_screen_clear_reported_cwd (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+
+	g_clear_pointer (&priv->reported_cwd, g_free);
+	g_clear_pointer (&priv->reported_host, g_free);
+}
+
+static void
+terminal_screen_current_directory_uri_changed (BteTerminal    *bte_terminal,
+                                               TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	const char *uri;
+
+	terminal_screen_clear_reported_cwd (screen);
+
+	/* Reported by the shell with OSC 7, as file://host/path */
+	uri = bte_terminal_get_current_directory_uri (bte_terminal);
+	if (uri == NULL)
+		return;
+
+	priv->reported_cwd = g_filename_from_uri (uri, &priv->reported_host, NULL);
+
+	_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+	                       "[screen %p] shell reported directory %s on host %s\n",
+	                       screen,
+	                       priv->reported_cwd ? priv->reported_cwd : "(invalid)",
+	                       priv->reported_host ? priv->reported_host : "(none)");
+}
+
+/* Logs the rows the cursor has left behind since the last call, or up to
+ * and including the cursor row if @to_cursor. Output is logged as the
+ * text it leaves on screen; BTE doesn't give access to the raw stream.
+ */
+static void
+terminal_screen_log_lines (TerminalScreen *screen,
+                           gboolean        to_cursor)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	BteTerminal *bte_terminal = BTE_TERMINAL (screen);
+	CtkAdjustment *adjustment;
+	glong column, row, first_row, last_row;
+	char *text;
+
+	bte_terminal_get_cursor_position (bte_terminal, &column, &row);
+
+	/* Reset, or the cursor moved back up over rows already logged */
+	if (row < priv->log_row)
+	{
+		priv->log_row = row;
+		return;
+	}
+
+	adjustment = ctk_scrollable_get_vadjustment (CTK_SCROLLABLE (screen));
+	first_row = MAX (priv->log_row, (glong) ctk_adjustment_get_lower (adjustment));
+	last_row = to_cursor ? row : row - 1;
+	if (last_row < first_row)
+		return;
+
+	text = bte_terminal_get_text_range (bte_terminal,
+	                                    first_row, 0,
+	                                    last_row, bte_terminal_get_column_count (bte_terminal) - 1,
+	                                    NULL, NULL, NULL);
+	if (text)
+	{
+		terminal_logger_append (priv->logger, text, -1);
+		g_free (text);
+	}
+
+	priv->log_row = last_row + 1;
+}
+
+static void
+terminal_screen_log_contents_changed_cb (BteTerminal    *bte_terminal G_GNUC_UNUSED,
+                                         TerminalScreen *screen)
 {
-	if (g_settings_get_boolean (settings_global, "notifications") == FALSE)
+	terminal_screen_log_lines (screen, FALSE);
+}
+
+static void
+terminal_screen_stop_logging (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+
+	_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+	                       "[screen %p] stopped logging, %u lines dropped\n",
+	                       screen, terminal_logger_get_dropped (priv->logger));
+
+	g_signal_handler_disconnect (screen, priv->log_contents_changed_id);
+	priv->log_contents_changed_id = 0;
+
+	/* Returns right away, the writer thread finishes on its own */
+	terminal_logger_close (priv->logger);
+	priv->logger = NULL;
+}
+
+/* Starts or stops logging the output of the child to follow the profile */
+static void
+terminal_screen_update_logging (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	const TerminalProfileSnapshot *snapshot;
+
+	if (!priv->profile)
 		return;
 
-	if ((ctk_window_is_active (CTK_WINDOW (terminal_screen_get_window (screen))) == FALSE) &&
-	    (terminal_screen_has_foreground_process (screen) == FALSE))
+	snapshot = terminal_profile_get_snapshot (priv->profile);
+
+	if (!snapshot->log_output || priv->child_pid == -1)
 	{
-		notify_init ("cafe-terminal");
-		NotifyNotification *notification;
+		if (priv->logger)
+			terminal_screen_stop_logging (screen);
+		return;
+	}
 
-		notification = notify_notification_new ("CAFE Terminal",
-                                                        _("Process completed"),
-                                                        "utilities-terminal");
+	if (!priv->logger)
+	{
+		char *directory, *stamp, *name;
+		GDateTime *now;
+		glong column;
 
-		notify_notification_show (notification, NULL);
-		g_object_unref (G_OBJECT (notification));
-		notify_uninit();
+		if (snapshot->log_directory && snapshot->log_directory[0])
+			directory = g_strdup (snapshot->log_directory);
+		else
+			directory = g_build_filename (g_get_user_data_dir (), "cafe-terminal", "logs", NULL);
+
+		now = g_date_time_new_now_local ();
+		stamp = g_date_time_format (now, "%Y%m%d-%H%M%S");
+		name = g_strdup_printf ("%s-%d", stamp, (int) priv->child_pid);
+		g_free (stamp);
+		g_date_time_unref (now);
+
+		priv->logger = terminal_logger_new (directory, name,
+		                                    snapshot->log_compress,
+		                                    (guint64) snapshot->log_max_size * 1024 * 1024);
+		g_free (directory);
+		g_free (name);
+
+		/* Only log what comes from now on */
+		bte_terminal_get_cursor_position (BTE_TERMINAL (screen), &column, &priv->log_row);
+
+		priv->log_contents_changed_id =
+			g_signal_connect (screen, "contents-changed",
+			                  G_CALLBACK (terminal_screen_log_contents_changed_cb),
+			                  screen);
+
+		_terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+		                       "[screen %p] logging output\n", screen);
 	}
 }
 
+/* Returns the directory reported by the shell if it is on this host */
+static const char *
+terminal_screen_get_local_reported_cwd (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+
+	if (priv->reported_cwd == NULL)
+		return NULL;
+
+	if (priv->reported_host == NULL ||
+	    priv->reported_host[0] == '\0' ||
+	    strcmp (priv->reported_host, "localhost") == 0 ||
+	    g_ascii_strcasecmp (priv->reported_host, g_get_host_name ()) == 0)
+		return priv->reported_cwd;
+
+	/* A remote shell, e.g. over ssh; its directory means nothing here */
+	return NULL;
+}
+
+static void
+terminal_screen_apply_scrollback (TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+	const TerminalProfileSnapshot *snapshot;
+	glong lines;
+
+	snapshot = terminal_profile_get_snapshot (priv->profile);
+	lines = snapshot->scrollback_unlimited ? -1 : snapshot->scrollback_lines;
+
+	if (priv->scrollback_cap >= 0 && (lines < 0 || lines > priv->scrollback_cap))
+		lines = priv->scrollback_cap;
+
+	bte_terminal_set_scrollback_lines (BTE_TERMINAL (screen), lines);
+}
+
+static void
+terminal_screen_map_cb (CtkWidget      *widget G_GNUC_UNUSED,
+                        TerminalScreen *screen)
+{
+	TerminalScreenPrivate *priv = screen->priv;
+
+	priv->last_viewed = g_get_monotonic_time ();
+
+	/* Viewed again, so let it grow back to what the profile allows */
+	if (priv->scrollback_cap >= 0)
+		terminal_screen_set_scrollback_cap (screen, -1);
+}
+
+static void
+terminal_screen_unmap_cb (CtkWidget      *widget G_GNUC_UNUSED,
+                          TerminalScreen *screen)
+{
+	screen->priv->last_viewed = g_get_monotonic_time ();
+}
+
+static void
+terminal_screen_text_inserted (BteTerminal    *bte_terminal G_GNUC_UNUSED,
+			       TerminalScreen *screen)
+{
+	_terminal_startup_mark (TERMINAL_STARTUP_FIRST_OUTPUT);
+
+	screen->priv->output_events++;
+
+	/* The foreground process may have changed; the app looks once output settles */
+	terminal_app_queue_foreground_check (terminal_app_get (), screen);
+}
+
 static void
 terminal_screen_child_exited (BteTerminal *terminal, int status)
 {
@@ -1973,6 +3115,16 @@ terminal_screen_child_exited (BteTerminal *terminal, int status)
 
 	priv->child_pid = -1;
 
+	/* A restarted child has to report its directory anew */
+	terminal_screen_clear_reported_cwd (screen);
+
+	/* Finish this child's log; a restarted one gets its own */
+	if (priv->logger)
+	{
+		terminal_screen_log_lines (screen, TRUE);
+		terminal_screen_stop_logging (screen);
+	}
+
 	action = terminal_profile_get_property_enum (priv->profile, TERMINAL_PROFILE_EXIT_ACTION);
 
 	switch (action)
@@ -2287,7 +3439,7 @@ _terminal_screen_update_scrollbar (TerminalScreen *screen)
 	if (container == NULL)
 		return;
 
-	switch (terminal_profile_get_property_enum (priv->profile, TERMINAL_PROFILE_SCROLLBAR_POSITION))
+	switch (terminal_profile_get_snapshot (priv->profile)->scrollbar_position)
 	{
 	case TERMINAL_SCROLLBAR_HIDDEN:
 		policy = CTK_POLICY_NEVER;
@@ -2335,48 +3487,14 @@ terminal_screen_get_cell_size (TerminalScreen *screen,
 static void
 terminal_screen_skey_match_remove (TerminalScreen *screen)
 {
-	TerminalScreenPrivate *priv = screen->priv;
-	GSList *l, *next;
-
-	l = priv->match_tags;
-	while (l != NULL)
-	{
-		TagData *tag_data = (TagData *) l->data;
-
-		next = l->next;
-		if (tag_data->flavor == FLAVOR_SKEY)
-		{
-			bte_terminal_match_remove (BTE_TERMINAL (screen), tag_data->tag);
-			priv->match_tags = g_slist_delete_link (priv->match_tags, l);
-		}
-
-		l = next;
-	}
+	terminal_screen_match_tags_remove (screen, MATCH_TAG_SKEY);
 }
 #endif /* ENABLE_SKEY */
 
 static void
 terminal_screen_url_match_remove (TerminalScreen *screen)
 {
-	TerminalScreenPrivate *priv = screen->priv;
-	GSList *l, *next;
-
-	l = priv->match_tags;
-	while (l != NULL)
-	{
-		TagData *tag_data = (TagData *) l->data;
-
-		next = l->next;
-#ifdef ENABLE_SKEY
-		if (tag_data->flavor != FLAVOR_SKEY)
-#endif
-		{
-			bte_terminal_match_remove (BTE_TERMINAL (screen), tag_data->tag);
-			priv->match_tags = g_slist_delete_link (priv->match_tags, l);
-		}
-
-		l = next;
-	}
+	terminal_screen_match_tags_remove (screen, MATCH_TAG_URL);
 }
 
 static char*
@@ -2385,20 +3503,30 @@ terminal_screen_check_match (TerminalScreen *screen,
                              int       *flavor)
 {
 	TerminalScreenPrivate *priv = screen->priv;
-	GSList *tags;
+	MatchTagType type = MATCH_TAG_NONE;
 	int tag;
 	char *match;
 
 	match = bte_terminal_match_check_event (BTE_TERMINAL (screen), event, &tag);
-	for (tags = priv->match_tags; tags != NULL; tags = tags->next)
+	if (!match)
+		return NULL;
+
+	if (tag >= 0 && (guint) tag < priv->match_tags->len)
+		type = g_array_index (priv->match_tags, MatchTagType, tag);
+
+	switch (type)
 	{
-		TagData *tag_data = (TagData*) tags->data;
-		if (tag_data->tag == tag)
-		{
-			if (flavor)
-				*flavor = tag_data->flavor;
-			return match;
-		}
+	case MATCH_TAG_URL:
+		if (flavor)
+			*flavor = terminal_screen_get_url_flavor (match);
+		return match;
+	case MATCH_TAG_SKEY:
+		if (flavor)
+			*flavor = FLAVOR_SKEY;
+		return match;
+	case MATCH_TAG_NONE:
+	default:
+		break;
 	}
 
 	g_free (match);
@@ -2445,12 +3573,33 @@ terminal_screen_save_config (TerminalScreen *screen,
  * @screen:
  *
  * Checks whether there's a foreground process running in
- * this terminal.
+ * this terminal. This samples it now rather than going by the app's
+ * cached state.
  *
  * Returns: %TRUE iff there's a foreground process running in @screen
  */
 gboolean
 terminal_screen_has_foreground_process (TerminalScreen *screen)
+{
+	TerminalApp *app = terminal_app_get ();
+
+	terminal_app_check_foreground (app, screen);
+
+	return terminal_app_get_foreground_process (app, screen, NULL, NULL) != -1;
+}
+
+/**
+ * _terminal_screen_probe_foreground_pgid:
+ * @screen:
+ *
+ * Asks the PTY of @screen for its foreground process group. This is for
+ * the app's process monitor; use terminal_app_get_foreground_process()
+ * to get the cached result.
+ *
+ * Returns: the foreground process group if it is not the child's own, or -1
+ */
+GPid
+_terminal_screen_probe_foreground_pgid (TerminalScreen *screen)
 {
 	TerminalScreenPrivate *priv = screen->priv;
 	BtePty *pty;
@@ -2459,40 +3608,15 @@ terminal_screen_has_foreground_process (TerminalScreen *screen)
 
 	pty = bte_terminal_get_pty (BTE_TERMINAL (screen));
 	if (pty == NULL)
-		return FALSE;
+		return -1;
 
 	fd = bte_pty_get_fd (pty);
 	if (fd == -1)
-		return FALSE;
+		return -1;
 
 	fgpid = tcgetpgrp (fd);
 	if (fgpid == -1 || fgpid == priv->child_pid)
-		return FALSE;
-
-	return TRUE;
-
-#if 0
-	char *cmdline, *basename, *name;
-	gsize len;
-	char filename[64];
-
-	g_snprintf (filename, sizeof (filename), "/proc/%d/cmdline", fgpid);
-	if (!g_file_get_contents (filename, &cmdline, &len, NULL))
-		return TRUE;
-
-	basename = g_path_get_basename (cmdline);
-	g_free (cmdline);
-	if (!basename)
-		return TRUE;
-
-	name = g_filename_to_utf8 (basename, -1, NULL, NULL, NULL);
-	g_free (basename);
-	if (!name)
-		return TRUE;
-
-	if (process_name)
-		*process_name = name;
+		return -1;
 
-	return TRUE;
-#endif
+	return fgpid;
 }
@@ -71,6 +71,7 @@ struct _TerminalScreenClass
 	                             int flavour,
 	                             guint state);
 	void (* close_screen)       (TerminalScreen *screen);
+	void (* foreground_changed) (TerminalScreen *screen);
 };
 
 GType terminal_screen_get_type (void) G_GNUC_CONST;
@@ -108,10 +109,33 @@ void        terminal_screen_set_override_title     (TerminalScreen *screen,
 const char *terminal_screen_get_dynamic_title      (TerminalScreen *screen);
 const char *terminal_screen_get_dynamic_icon_title (TerminalScreen *screen);
 
+void terminal_screen_defer_launch_child (TerminalScreen *screen,
+                                         guint           trickle_interval);
+
+void terminal_screen_launch_deferred_child (TerminalScreen *screen);
+
+GPid terminal_screen_get_pid (TerminalScreen *screen);
+
+guint64 terminal_screen_get_output_events (TerminalScreen *screen);
+
+guint64 _terminal_screen_get_n_profile_notifies (void);
+
+guint64 _terminal_screen_get_n_titles_suppressed (void);
+
+void terminal_screen_set_scrollback_cap (TerminalScreen *screen,
+                                         glong           lines);
+
+void terminal_screen_get_scrollback_usage (TerminalScreen *screen,
+                                           glong          *n_lines,
+                                           glong          *n_columns,
+                                           glong          *cap,
+                                           gint64         *last_viewed);
+
 char *terminal_screen_get_current_dir (TerminalScreen *screen);
 char *terminal_screen_get_current_dir_with_fallback (TerminalScreen *screen);
 
-void        terminal_screen_set_font (TerminalScreen *screen);
+gboolean    terminal_screen_set_font (TerminalScreen *screen);
+gboolean    terminal_screen_update_system_font (TerminalScreen *screen);
 void        terminal_screen_set_font_scale    (TerminalScreen *screen,
         double          factor);
 double      terminal_screen_get_font_scale    (TerminalScreen *screen);
@@ -131,6 +155,8 @@ void terminal_screen_save_config (TerminalScreen *screen,
 
 gboolean terminal_screen_has_foreground_process (TerminalScreen *screen);
 
+GPid _terminal_screen_probe_foreground_pgid (TerminalScreen *screen);
+
 /* Allow scales a bit smaller and a bit larger than the usual pango ranges */
 #define TERMINAL_SCALE_XXX_SMALL   (PANGO_SCALE_XX_SMALL/1.2)
 #define TERMINAL_SCALE_XXXX_SMALL  (TERMINAL_SCALE_XXX_SMALL/1.2)
@@ -22,6 +22,7 @@
 
 #include <string.h>
 
+#include "terminal-intl.h"
 #include "terminal-search-dialog.h"
 #include "terminal-util.h"
 
@@ -31,6 +32,18 @@
 #define HISTORY_MIN_ITEM_LEN 3
 #define HISTORY_LENGTH 10
 
+/* Number of compiled search patterns to keep around */
+#define REGEX_CACHE_SIZE 16
+
+/* Delay between the last keystroke and the incremental search, in ms */
+#define INCREMENTAL_SEARCH_DELAY 150
+
+/* How often the match counter checks for cancellation */
+#define MATCH_COUNT_CHECK_INTERVAL 1024
+
+/* Rows of scrollback copied for the match counter per main loop iteration */
+#define SNAPSHOT_CHUNK_ROWS 2000
+
 static GQuark
 get_quark (void)
 {
@@ -58,15 +71,47 @@ typedef struct _TerminalSearchDialogPrivate
 	CtkWidget *regex_checkbutton;
 	CtkWidget *backwards_checkbutton;
 	CtkWidget *wrap_around_checkbutton;
+	CtkWidget *match_count_label;
 
 	CtkListStore *store;
 	CtkEntryCompletion *completion;
 
-	/* Cached regex */
-	BteRegex *regex;
-	guint32 regex_compile_flags;
+	/* Compiled regexes, most recently used first */
+	GQueue regex_lru;
+	GHashTable *regex_cache; /* key -> GList link in regex_lru */
+
+	guint incremental_source_id;
+
+	/* Match counter state for the terminal last searched */
+	BteTerminal *terminal;
+	gulong terminal_contents_changed_id;
+	GBytes *snapshot; /* kept, though stale, while output arrives */
+	gboolean snapshot_stale;
+	GString *snapshot_next; /* being taken, a few rows at a time */
+	glong snapshot_row; /* next row to copy into @snapshot_next */
+	glong snapshot_last_row;
+	guint snapshot_source_id;
+	BteRegex *count_regex;
+	GCancellable *count_cancellable;
+	gssize match_count; /* -1 while unknown */
+	gint match_index; /* 1-based; negative counts from the end; 0 if unknown */
 } TerminalSearchDialogPrivate;
 
+typedef struct
+{
+	char *key;
+	char *pattern;
+	guint32 compile_flags;
+	BteRegex *regex; /* NULL if the pattern doesn't compile */
+	GRegex *count_regex; /* compiled on first use by the match counter */
+} RegexCacheEntry;
+
+typedef struct
+{
+	GRegex *regex;
+	GBytes *text;
+} MatchCountData;
+
 
 static void update_sensitivity (void *unused,
                                 CtkWidget *dialog);
@@ -74,6 +119,9 @@ static void response_handler (CtkWidget *dialog,
                               gint       response_id,
                               gpointer   data);
 static void terminal_search_dialog_private_destroy (TerminalSearchDialogPrivate *priv);
+static void terminal_search_dialog_set_terminal (TerminalSearchDialogPrivate *priv,
+                                                 BteTerminal *terminal);
+static void update_match_count_label (TerminalSearchDialogPrivate *priv);
 
 
 CtkWidget *
@@ -95,12 +143,17 @@ terminal_search_dialog_new (CtkWindow   *parent)
 	                                      "regex-checkbutton", &priv->regex_checkbutton,
 	                                      "search-backwards-checkbutton", &priv->backwards_checkbutton,
 	                                      "wrap-around-checkbutton", &priv->wrap_around_checkbutton,
+	                                      "match-count-label", &priv->match_count_label,
 	                                      NULL))
 	{
 		g_free (priv);
 		return NULL;
 	}
 
+	g_queue_init (&priv->regex_lru);
+	priv->regex_cache = g_hash_table_new (g_str_hash, g_str_equal);
+	priv->match_count = -1;
+
 	g_object_set_qdata_full (G_OBJECT (dialog), get_quark (), priv,
 	                         (GDestroyNotify) terminal_search_dialog_private_destroy);
 
@@ -128,6 +181,8 @@ terminal_search_dialog_new (CtkWindow   *parent)
 	ctk_entry_set_activates_default (CTK_ENTRY (priv->search_text_entry), TRUE);
 	g_signal_connect (priv->search_text_entry, "changed", G_CALLBACK (update_sensitivity), dialog);
 	g_signal_connect (priv->regex_checkbutton, "toggled", G_CALLBACK (update_sensitivity), dialog);
+	g_signal_connect (priv->match_case_checkbutton, "toggled", G_CALLBACK (update_sensitivity), dialog);
+	g_signal_connect (priv->entire_word_checkbutton, "toggled", G_CALLBACK (update_sensitivity), dialog);
 
 	g_signal_connect (dialog, "response", G_CALLBACK (response_handler), NULL);
 
@@ -151,12 +206,39 @@ terminal_search_dialog_present (CtkWidget *dialog)
 	ctk_widget_grab_focus (priv->search_text_entry);
 }
 
+static void
+regex_cache_entry_free (RegexCacheEntry *entry)
+{
+	if (entry->regex)
+		bte_regex_unref (entry->regex);
+	if (entry->count_regex)
+		g_regex_unref (entry->count_regex);
+
+	g_free (entry->key);
+	g_free (entry->pattern);
+	g_slice_free (RegexCacheEntry, entry);
+}
+
 static void
 terminal_search_dialog_private_destroy (TerminalSearchDialogPrivate *priv)
 {
+	if (priv->incremental_source_id != 0)
+		g_source_remove (priv->incremental_source_id);
 
-	if (priv->regex)
-		bte_regex_unref (priv->regex);
+	if (priv->count_cancellable)
+	{
+		g_cancellable_cancel (priv->count_cancellable);
+		g_object_unref (priv->count_cancellable);
+	}
+
+	terminal_search_dialog_set_terminal (priv, NULL);
+
+	if (priv->count_regex)
+		bte_regex_unref (priv->count_regex);
+
+	g_hash_table_destroy (priv->regex_cache);
+	g_queue_foreach (&priv->regex_lru, (GFunc) regex_cache_entry_free, NULL);
+	g_queue_clear (&priv->regex_lru);
 
 	g_object_unref (priv->store);
 	g_object_unref (priv->completion);
@@ -164,6 +246,89 @@ terminal_search_dialog_private_destroy (TerminalSearchDialogPrivate *priv)
 	g_free (priv);
 }
 
+/* Looks up the compiled regex for @pattern and @compile_flags, compiling
+ * and caching it on a miss. Invalid patterns are cached too, so that the
+ * same bad pattern isn't recompiled over and over while typing.
+ */
+static RegexCacheEntry *
+regex_cache_lookup (TerminalSearchDialogPrivate *priv,
+                    const char                  *pattern,
+                    guint32                      compile_flags)
+{
+	RegexCacheEntry *entry;
+	GList *link;
+	GError *error = NULL;
+	char *key;
+
+	key = g_strdup_printf ("%08x:%s", compile_flags, pattern);
+
+	link = g_hash_table_lookup (priv->regex_cache, key);
+	if (link)
+	{
+		g_free (key);
+
+		g_queue_unlink (&priv->regex_lru, link);
+		g_queue_push_head_link (&priv->regex_lru, link);
+
+		return link->data;
+	}
+
+	entry = g_slice_new0 (RegexCacheEntry);
+	entry->key = key;
+	entry->pattern = g_strdup (pattern);
+	entry->compile_flags = compile_flags;
+	entry->regex = bte_regex_new_for_search (pattern, -1, compile_flags, &error);
+
+	/* Cached all the same, so that this is reported once per pattern */
+	if (!entry->regex)
+	{
+		g_warning ("Failed to compile the search pattern \"%s\": %s",
+		           pattern, error->message);
+		g_error_free (error);
+	}
+
+	g_queue_push_head (&priv->regex_lru, entry);
+	g_hash_table_insert (priv->regex_cache, entry->key, priv->regex_lru.head);
+
+	if (g_queue_get_length (&priv->regex_lru) > REGEX_CACHE_SIZE)
+	{
+		RegexCacheEntry *old = g_queue_pop_tail (&priv->regex_lru);
+
+		g_hash_table_remove (priv->regex_cache, old->key);
+		regex_cache_entry_free (old);
+	}
+
+	return entry;
+}
+
+static RegexCacheEntry *
+regex_cache_find_regex (TerminalSearchDialogPrivate *priv,
+                        BteRegex                    *regex)
+{
+	GList *l;
+
+	for (l = priv->regex_lru.head; l != NULL; l = l->next)
+	{
+		RegexCacheEntry *entry = l->data;
+
+		if (entry->regex == regex)
+			return entry;
+	}
+
+	return NULL;
+}
+
+static gboolean
+incremental_search_timeout_cb (CtkWidget *dialog)
+{
+	TerminalSearchDialogPrivate *priv = TERMINAL_SEARCH_DIALOG_GET_PRIVATE (dialog);
+
+	priv->incremental_source_id = 0;
+
+	ctk_dialog_response (CTK_DIALOG (dialog), TERMINAL_SEARCH_DIALOG_RESPONSE_INCREMENTAL);
+
+	return FALSE; /* don't run again */
+}
 
 static void
 update_sensitivity (void      *unused G_GNUC_UNUSED,
@@ -173,25 +338,33 @@ update_sensitivity (void      *unused G_GNUC_UNUSED,
 	const gchar *search_string;
 	gboolean valid;
 
-	if (priv->regex)
-	{
-		bte_regex_unref (priv->regex);
-		priv->regex = NULL;
-	}
-
 	search_string = ctk_entry_get_text (CTK_ENTRY (priv->search_text_entry));
 	g_return_if_fail (search_string != NULL);
 
 	valid = *search_string != '\0';
 
-	if (valid && GET_FLAG (regex_checkbutton))
+	if (valid)
 	{
-		/* Check that the regex is valid */
+		/* Check that the regex is valid; this also compiles it
+		 * ahead of the incremental search.
+		 */
 		valid = NULL != terminal_search_dialog_get_regex (dialog);
 		/* TODO show the error message somewhere */
 	}
 
 	ctk_dialog_set_response_sensitive (CTK_DIALOG (dialog), CTK_RESPONSE_ACCEPT, valid);
+
+	if (priv->incremental_source_id != 0)
+	{
+		g_source_remove (priv->incremental_source_id);
+		priv->incremental_source_id = 0;
+	}
+
+	if (valid && ctk_widget_get_visible (dialog))
+		priv->incremental_source_id =
+			g_timeout_add (INCREMENTAL_SEARCH_DELAY,
+			               (GSourceFunc) incremental_search_timeout_cb,
+			               dialog);
 }
 
 static gboolean
@@ -274,14 +447,23 @@ response_handler (CtkWidget *dialog,
 	TerminalSearchDialogPrivate *priv;
 	const gchar *str;
 
+	if (response_id == TERMINAL_SEARCH_DIALOG_RESPONSE_INCREMENTAL)
+		return;
+
+	priv = TERMINAL_SEARCH_DIALOG_GET_PRIVATE (dialog);
+
+	if (priv->incremental_source_id != 0)
+	{
+		g_source_remove (priv->incremental_source_id);
+		priv->incremental_source_id = 0;
+	}
+
 	if (response_id != CTK_RESPONSE_ACCEPT)
 	{
 		ctk_widget_hide (dialog);
 		return;
 	}
 
-	priv = TERMINAL_SEARCH_DIALOG_GET_PRIVATE (dialog);
-
 	str = ctk_entry_get_text (CTK_ENTRY (priv->search_text_entry));
 	if (*str != '\0')
 		history_entry_insert (priv->store, str);
@@ -344,6 +526,7 @@ BteRegex *
 terminal_search_dialog_get_regex (CtkWidget *dialog)
 {
 	TerminalSearchDialogPrivate *priv;
+	RegexCacheEntry *entry;
 	guint32 compile_flags;
 	const char *text, *pattern;
 
@@ -372,21 +555,391 @@ terminal_search_dialog_get_regex (CtkWidget *dialog)
 			g_free ((char *) old_pattern);
 	}
 
-	if (!priv->regex || priv->regex_compile_flags != compile_flags)
+	entry = regex_cache_lookup (priv, pattern, compile_flags);
+
+	if (pattern != text)
+		g_free ((char *) pattern);
+
+	return entry->regex;
+}
+
+static void
+terminal_contents_changed_cb (BteTerminal                 *terminal G_GNUC_UNUSED,
+                              TerminalSearchDialogPrivate *priv)
+{
+	/* The snapshot is retaken the next time a count is needed; until
+	 * then it still gives a count that is nearly right.
+	 */
+	priv->snapshot_stale = TRUE;
+}
+
+static void
+terminal_search_dialog_cancel_snapshot (TerminalSearchDialogPrivate *priv)
+{
+	if (priv->snapshot_source_id != 0)
+	{
+		g_source_remove (priv->snapshot_source_id);
+		priv->snapshot_source_id = 0;
+	}
+
+	if (priv->snapshot_next)
+	{
+		g_string_free (priv->snapshot_next, TRUE);
+		priv->snapshot_next = NULL;
+	}
+}
+
+static void
+terminal_search_dialog_set_terminal (TerminalSearchDialogPrivate *priv,
+                                     BteTerminal                 *terminal)
+{
+	if (priv->terminal == terminal)
+		return;
+
+	if (priv->terminal)
 	{
-		priv->regex_compile_flags = compile_flags;
-		if (priv->regex)
-			bte_regex_unref (priv->regex);
+		g_signal_handler_disconnect (priv->terminal, priv->terminal_contents_changed_id);
+		g_object_remove_weak_pointer (G_OBJECT (priv->terminal), (gpointer *) &priv->terminal);
+		priv->terminal_contents_changed_id = 0;
+	}
 
-		/* TODO Error handling */
-		priv->regex = bte_regex_new_for_search(pattern, -1,
-						       compile_flags, NULL);
+	terminal_search_dialog_cancel_snapshot (priv);
+	if (priv->snapshot)
+	{
+		g_bytes_unref (priv->snapshot);
+		priv->snapshot = NULL;
+	}
+	priv->snapshot_stale = FALSE;
 
+	priv->terminal = terminal;
+
+	if (terminal)
+	{
+		g_object_add_weak_pointer (G_OBJECT (terminal), (gpointer *) &priv->terminal);
+		priv->terminal_contents_changed_id =
+			g_signal_connect (terminal, "contents-changed",
+			                  G_CALLBACK (terminal_contents_changed_cb), priv);
 	}
+}
 
-	if (pattern != text)
-		g_free ((char *) pattern);
+static void terminal_search_dialog_count_matches (CtkWidget *dialog);
+
+static gboolean
+terminal_search_dialog_snapshot_cb (CtkWidget *dialog)
+{
+	TerminalSearchDialogPrivate *priv = TERMINAL_SEARCH_DIALOG_GET_PRIVATE (dialog);
+	CtkAdjustment *adjustment;
+	glong last_row;
+
+	if (!priv->terminal)
+	{
+		priv->snapshot_source_id = 0;
+		terminal_search_dialog_cancel_snapshot (priv);
+		return FALSE; /* don't run again */
+	}
+
+	/* Rows that scrolled out of the buffer meanwhile are gone */
+	adjustment = ctk_scrollable_get_vadjustment (CTK_SCROLLABLE (priv->terminal));
+	priv->snapshot_row = MAX (priv->snapshot_row, (glong) ctk_adjustment_get_lower (adjustment));
+
+	last_row = MIN (priv->snapshot_row + SNAPSHOT_CHUNK_ROWS - 1, priv->snapshot_last_row);
+	if (priv->snapshot_row <= last_row)
+	{
+		char *text;
+
+		text = bte_terminal_get_text_range (priv->terminal,
+		                                    priv->snapshot_row, 0,
+		                                    last_row, bte_terminal_get_column_count (priv->terminal) - 1,
+		                                    NULL, NULL, NULL);
+		/* Each row ends with a newline unless it is soft-wrapped, so
+		 * the chunks join up without splitting wrapped lines */
+		if (text)
+		{
+			g_string_append (priv->snapshot_next, text);
+			g_free (text);
+		}
+
+		priv->snapshot_row = last_row + 1;
+	}
+
+	if (priv->snapshot_row <= priv->snapshot_last_row)
+		return TRUE; /* run again */
+
+	priv->snapshot_source_id = 0;
+
+	if (priv->snapshot)
+		g_bytes_unref (priv->snapshot);
+	priv->snapshot = g_string_free_to_bytes (priv->snapshot_next);
+	priv->snapshot_next = NULL;
+
+	/* Replace the count taken from the stale snapshot, if any */
+	terminal_search_dialog_count_matches (dialog);
+
+	return FALSE; /* don't run again */
+}
+
+/* Copies the whole scrollback of the current terminal as text, for the
+ * match counter. This has to happen on the main thread, so it is done a
+ * chunk of rows at a time, and the snapshot is kept until the terminal
+ * contents change and shared between successive counts.
+ */
+static void
+terminal_search_dialog_take_snapshot (CtkWidget *dialog)
+{
+	TerminalSearchDialogPrivate *priv = TERMINAL_SEARCH_DIALOG_GET_PRIVATE (dialog);
+	CtkAdjustment *adjustment;
+
+	if (priv->snapshot_source_id != 0 || !priv->terminal)
+		return;
+
+	adjustment = ctk_scrollable_get_vadjustment (CTK_SCROLLABLE (priv->terminal));
+	priv->snapshot_row = (glong) ctk_adjustment_get_lower (adjustment);
+	priv->snapshot_last_row = (glong) ctk_adjustment_get_upper (adjustment) - 1;
+	priv->snapshot_next = g_string_new (NULL);
+
+	/* Output arriving from now on makes the new snapshot stale again */
+	priv->snapshot_stale = FALSE;
+
+	priv->snapshot_source_id =
+		g_idle_add ((GSourceFunc) terminal_search_dialog_snapshot_cb, dialog);
+}
+
+static void
+match_count_data_free (MatchCountData *data)
+{
+	g_regex_unref (data->regex);
+	g_bytes_unref (data->text);
+	g_slice_free (MatchCountData, data);
+}
+
+static void
+match_count_thread (GTask        *task,
+                    gpointer      source_object G_GNUC_UNUSED,
+                    gpointer      task_data,
+                    GCancellable *cancellable)
+{
+	MatchCountData *data = task_data;
+	GMatchInfo *match_info;
+	const char *text;
+	gsize length;
+	gssize count = 0;
+
+	text = g_bytes_get_data (data->text, &length);
+
+	if (length > 0)
+	{
+		g_regex_match_full (data->regex, text, length, 0, 0, &match_info, NULL);
+		while (g_match_info_matches (match_info))
+		{
+			if (++count % MATCH_COUNT_CHECK_INTERVAL == 0 &&
+			    g_cancellable_is_cancelled (cancellable))
+				break;
+
+			g_match_info_next (match_info, NULL);
+		}
+		g_match_info_free (match_info);
+	}
+
+	if (!g_task_return_error_if_cancelled (task))
+		g_task_return_int (task, count);
+}
+
+static void
+match_count_ready_cb (GObject      *source_object,
+                      GAsyncResult *result,
+                      gpointer      user_data G_GNUC_UNUSED)
+{
+	TerminalSearchDialogPrivate *priv = TERMINAL_SEARCH_DIALOG_GET_PRIVATE (source_object);
+	GError *error = NULL;
+	gssize count;
+
+	count = g_task_propagate_int (G_TASK (result), &error);
+	if (error)
+	{
+		/* Superseded by a newer count */
+		g_error_free (error);
+		return;
+	}
+
+	g_clear_object (&priv->count_cancellable);
+
+	priv->match_count = count;
+	update_match_count_label (priv);
+}
+
+/* Counts the matches in the snapshot as it is; see
+ * terminal_search_dialog_start_match_count()
+ */
+static void
+terminal_search_dialog_count_matches (CtkWidget *dialog)
+{
+	TerminalSearchDialogPrivate *priv = TERMINAL_SEARCH_DIALOG_GET_PRIVATE (dialog);
+	RegexCacheEntry *entry;
+	MatchCountData *data;
+	GTask *task;
+
+	if (priv->count_cancellable)
+	{
+		g_cancellable_cancel (priv->count_cancellable);
+		g_clear_object (&priv->count_cancellable);
+	}
+
+	priv->match_count = -1;
+
+	/* Counted when the snapshot is complete */
+	if (!priv->count_regex || !priv->snapshot)
+		return;
+
+	entry = regex_cache_find_regex (priv, priv->count_regex);
+	if (!entry)
+		return;
+
+	if (!entry->count_regex)
+	{
+		GRegexCompileFlags flags = G_REGEX_MULTILINE | G_REGEX_OPTIMIZE;
+
+		if (entry->compile_flags & PCRE2_CASELESS)
+			flags |= G_REGEX_CASELESS;
+
+		entry->count_regex = g_regex_new (entry->pattern, flags, 0, NULL);
+		if (!entry->count_regex)
+			return;
+	}
+
+	data = g_slice_new (MatchCountData);
+	data->regex = g_regex_ref (entry->count_regex);
+	data->text = g_bytes_ref (priv->snapshot);
+
+	priv->count_cancellable = g_cancellable_new ();
+
+	task = g_task_new (dialog, priv->count_cancellable, match_count_ready_cb, NULL);
+	g_task_set_task_data (task, data, (GDestroyNotify) match_count_data_free);
+	g_task_run_in_thread (task, match_count_thread);
+	g_object_unref (task);
+}
+
+static void
+terminal_search_dialog_start_match_count (CtkWidget *dialog)
+{
+	TerminalSearchDialogPrivate *priv = TERMINAL_SEARCH_DIALOG_GET_PRIVATE (dialog);
+
+	/* While output arrives, count in the stale snapshot right away and
+	 * again once the new one is taken, rather than copying the whole
+	 * buffer for every pattern change.
+	 */
+	if (priv->count_regex && (!priv->snapshot || priv->snapshot_stale))
+		terminal_search_dialog_take_snapshot (dialog);
+
+	terminal_search_dialog_count_matches (dialog);
+}
+
+static void
+update_match_count_label (TerminalSearchDialogPrivate *priv)
+{
+	char *text;
+	gint index;
+
+	if (priv->match_count < 0)
+	{
+		ctk_label_set_text (CTK_LABEL (priv->match_count_label), "");
+		return;
+	}
+
+	if (priv->match_count == 0)
+	{
+		ctk_label_set_text (CTK_LABEL (priv->match_count_label), _("No matches"));
+		return;
+	}
+
+	index = priv->match_index;
+	if (index < 0)
+		index += priv->match_count + 1;
+
+	if (index > 0 && index <= priv->match_count)
+		text = g_strdup_printf (ngettext ("%d of %d match", "%d of %d matches",
+		                                  priv->match_count),
+		                        index, (int) priv->match_count);
+	else
+		text = g_strdup_printf (ngettext ("%d match", "%d matches",
+		                                  priv->match_count),
+		                        (int) priv->match_count);
+
+	ctk_label_set_text (CTK_LABEL (priv->match_count_label), text);
+	g_free (text);
+}
+
+/**
+ * terminal_search_dialog_set_search_result:
+ * @dialog: the search dialog
+ * @terminal: the terminal that was searched
+ * @restarted: whether the search started over from the end of the buffer
+ * @backwards: the direction of the search
+ * @found: whether a match was found
+ *
+ * Updates the "N of M matches" counter after a search in @terminal. The
+ * total is counted in a worker thread over a snapshot of the scrollback;
+ * the position is tracked from the searches themselves.
+ */
+void
+terminal_search_dialog_set_search_result (CtkWidget   *dialog,
+                                          BteTerminal *terminal,
+                                          gboolean     restarted,
+                                          gboolean     backwards,
+                                          gboolean     found)
+{
+	TerminalSearchDialogPrivate *priv;
+	BteRegex *regex;
+
+	g_return_if_fail (CTK_IS_DIALOG (dialog));
+	g_return_if_fail (BTE_IS_TERMINAL (terminal));
+
+	priv = TERMINAL_SEARCH_DIALOG_GET_PRIVATE (dialog);
+	g_return_if_fail (priv);
+
+	regex = bte_terminal_search_get_regex (terminal);
+
+	if (terminal != priv->terminal || regex != priv->count_regex)
+	{
+		terminal_search_dialog_set_terminal (priv, terminal);
+
+		if (priv->count_regex)
+			bte_regex_unref (priv->count_regex);
+		priv->count_regex = regex ? bte_regex_ref (regex) : NULL;
+
+		priv->match_index = 0;
+		terminal_search_dialog_start_match_count (dialog);
+	}
+
+	if (!found)
+		priv->match_index = 0;
+	else if (restarted)
+		priv->match_index = backwards ? -1 : 1;
+	else if (priv->match_index != 0 && priv->match_count > 0)
+	{
+		gint index = priv->match_index;
+
+		if (index < 0)
+			index += priv->match_count + 1;
+
+		index += backwards ? -1 : 1;
+		if (index < 1)
+			index = priv->match_count;
+		else if (index > priv->match_count)
+			index = 1;
+
+		priv->match_index = index;
+	}
+	else if (priv->match_index != 0)
+	{
+		/* The total isn't known yet; step in the signed index
+		 * space, wrapping around between the first and the last match.
+		 */
+		if (backwards)
+			priv->match_index = priv->match_index == 1 ? -1 : priv->match_index - 1;
+		else
+			priv->match_index = priv->match_index == -1 ? 1 : priv->match_index + 1;
+	}
 
-	return priv->regex;
+	update_match_count_label (priv);
 }
 
@@ -32,6 +32,9 @@ typedef enum _TerminalSearchFlags
     TERMINAL_SEARCH_FLAG_WRAP_AROUND	= 1 << 1
 } TerminalSearchFlags;
 
+/* Emitted as a dialog response while the search text is being typed */
+#define TERMINAL_SEARCH_DIALOG_RESPONSE_INCREMENTAL 1
+
 
 CtkWidget	*terminal_search_dialog_new		(CtkWindow   *parent);
 
@@ -46,6 +49,12 @@ TerminalSearchFlags
 terminal_search_dialog_get_search_flags(CtkWidget   *dialog);
 BteRegex	*terminal_search_dialog_get_regex	(CtkWidget   *dialog);
 
+void		 terminal_search_dialog_set_search_result (CtkWidget   *dialog,
+        BteTerminal *terminal,
+        gboolean     restarted,
+        gboolean     backwards,
+        gboolean     found);
+
 G_END_DECLS
 
 #endif /* TERMINAL_SEARCH_DIALOG_H */
@@ -22,6 +22,7 @@
 #include <ctk/ctk.h>
 
 #include "terminal-intl.h"
+#include "terminal-app.h"
 #include "terminal-tab-label.h"
 #include "terminal-close-button.h"
 
@@ -60,6 +61,28 @@ close_button_clicked_cb (CtkWidget        *widget G_GNUC_UNUSED,
 	g_signal_emit (tab_label, signals[CLOSE_BUTTON_CLICKED], 0);
 }
 
+static void
+sync_tab_tooltip (TerminalScreen *screen,
+		  CtkWidget      *hbox)
+{
+	const char *title, *process_name;
+
+	title = terminal_screen_get_title (screen);
+
+	/* Show the running command, as last seen by the app's process monitor */
+	if (terminal_app_get_foreground_process (terminal_app_get (), screen, &process_name, NULL) != -1 &&
+	    process_name != NULL)
+	{
+		char *tooltip;
+
+		tooltip = g_strdup_printf ("%s (%s)", title, process_name);
+		ctk_widget_set_tooltip_text (hbox, tooltip);
+		g_free (tooltip);
+	}
+	else
+		ctk_widget_set_tooltip_text (hbox, title);
+}
+
 static void
 sync_tab_label (TerminalScreen *screen,
 		GParamSpec     *pspec G_GNUC_UNUSED,
@@ -73,7 +96,14 @@ sync_tab_label (TerminalScreen *screen,
 
 	ctk_label_set_text (CTK_LABEL (label), title);
 
-	ctk_widget_set_tooltip_text (hbox, title);
+	sync_tab_tooltip (screen, hbox);
+}
+
+static void
+foreground_changed_cb (TerminalScreen   *screen,
+		       TerminalTabLabel *tab_label)
+{
+	sync_tab_tooltip (screen, CTK_WIDGET (tab_label));
 }
 
 /* public functions */
@@ -134,6 +164,8 @@ terminal_tab_label_constructor (GType type,
 	sync_tab_label (priv->screen, NULL, label);
 	g_signal_connect (priv->screen, "notify::title",
 	                  G_CALLBACK (sync_tab_label), label);
+	g_signal_connect (priv->screen, "foreground-changed",
+	                  G_CALLBACK (foreground_changed_cb), tab_label);
 
 	g_signal_connect (close_button, "clicked",
 	                  G_CALLBACK (close_button_clicked_cb), tab_label);
@@ -150,6 +182,9 @@ terminal_tab_label_dispose (GObject *object)
 	TerminalTabLabelPrivate *priv = tab_label->priv;
 
 	if (priv->screen != NULL) {
+		g_signal_handlers_disconnect_by_func (priv->screen,
+		                                      G_CALLBACK (foreground_changed_cb),
+		                                      tab_label);
 		g_signal_handlers_disconnect_by_func (priv->screen,
 		                                      G_CALLBACK (sync_tab_label),
 		                                      priv->label);
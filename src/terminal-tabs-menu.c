@@ -41,6 +41,7 @@
 #define ACCEL_PATH_FORMAT		"<Actions>/Main/TabsSwitch%u"
 #define ACCEL_PATH_FORMAT_LENGTH	strlen (ACCEL_PATH_FORMAT) + 14 + 1
 #define DATA_KEY			"TerminalTabsMenu::Action"
+#define MERGE_ID_DATA_KEY		"TerminalTabsMenu::MergeId"
 
 #define UI_PATH                         "/menubar/Tabs"
 
@@ -49,7 +50,7 @@ struct _TerminalTabsMenuPrivate
 	TerminalWindow *window;
 	CtkActionGroup *action_group;
 	CtkAction *anchor_action;
-	guint ui_id;
+	GPtrArray *actions; /* CtkAction, in notebook order */
 };
 
 enum
@@ -58,10 +59,17 @@ enum
     PROP_WINDOW
 };
 
-static void	terminal_tabs_menu_update		(TerminalTabsMenu *menu);
-
-/* FIXME: this can be severely optimised */
-static GByteArray *tabs_id_array = NULL;
+static void	terminal_tabs_menu_add_item		(TerminalTabsMenu *menu,
+							 CtkAction        *action,
+							 guint             position);
+static void	terminal_tabs_menu_remove_item		(TerminalTabsMenu *menu,
+							 CtkAction        *action);
+static void	terminal_tabs_menu_update_accels	(TerminalTabsMenu *menu,
+							 guint             first);
+
+/* Tab IDs released by closed tabs, reused most recent first */
+static GArray *free_tab_ids = NULL;
+static guint next_tab_id = 0;
 static guint n_tabs = 0;
 
 G_DEFINE_TYPE_WITH_PRIVATE (TerminalTabsMenu, terminal_tabs_menu, G_TYPE_OBJECT)
@@ -74,45 +82,23 @@ G_DEFINE_TYPE_WITH_PRIVATE (TerminalTabsMenu, terminal_tabs_menu, G_TYPE_OBJECT)
 static guint
 allocate_tab_id (void)
 {
-	int bit;
-	guint b, len;
-	guint8 *data;
-	guint8 byte, mask;
-
 	if (n_tabs++ == 0)
 	{
-		g_assert (tabs_id_array == NULL);
-		tabs_id_array = g_byte_array_sized_new (16);
+		g_assert (free_tab_ids == NULL);
+		free_tab_ids = g_array_sized_new (FALSE, FALSE, sizeof (guint), 16);
+		next_tab_id = 0;
 	}
 
-	/* Find a free ID */
-	len = tabs_id_array->len;
-	data = tabs_id_array->data;
-	for (b = 0; b < len; ++b)
+	/* Reuse a released ID if there is one, so IDs stay small */
+	if (free_tab_ids->len > 0)
 	{
-		if (data[b] != 0xff)
-			break;
-	}
+		guint id = g_array_index (free_tab_ids, guint, free_tab_ids->len - 1);
 
-	/* Need to append a new byte */
-	if (b == len)
-	{
-		guint8 bytes[] = { 0 };
-		g_byte_array_append (tabs_id_array, bytes, G_N_ELEMENTS (bytes));
-		g_assert (tabs_id_array->len > b);
+		g_array_set_size (free_tab_ids, free_tab_ids->len - 1);
+		return id;
 	}
 
-	data = tabs_id_array->data + b;
-	byte = 0xff ^ *data;
-	/* Now find the first free bit */
-	bit = g_bit_nth_lsf (byte, -1);
-	mask = 1 << bit;
-	g_assert (bit >= 0 && bit <= 7);
-	g_assert ((*data & mask) == 0);
-	/* And mark it as allocated */
-	*data |= mask;
-
-	return b * 8 + bit;
+	return next_tab_id++;
 }
 
 static void
@@ -120,26 +106,22 @@ free_tab_id (CtkAction *action)
 {
 	const char *name;
 	guint id;
-	guint8 *data;
-	guint b, bit;
 
 	name = ctk_action_get_name (action);
 	id = g_ascii_strtoull (name + ACTION_VERB_FORMAT_PREFIX_LEN, NULL,
 	                       ACTION_VERB_FORMAT_BASE);
-	g_assert (id < tabs_id_array->len * 8);
-
-	b = id >> 3;
-	bit = id & 0x7;
-	data = tabs_id_array->data + b;
-	*data &= ~(1 << bit);
+	g_assert (id < next_tab_id);
 
 	g_assert (n_tabs > 0);
 	if (--n_tabs == 0)
 	{
-		g_assert (tabs_id_array != NULL);
-		g_byte_array_free (tabs_id_array, TRUE);
-		tabs_id_array = NULL;
+		g_assert (free_tab_ids != NULL);
+		g_array_free (free_tab_ids, TRUE);
+		free_tab_ids = NULL;
+		return;
 	}
+
+	g_array_append_val (free_tab_ids, id);
 }
 
 static void
@@ -178,7 +160,7 @@ sync_tab_title (TerminalScreen *screen,
 static void
 notebook_page_added_cb (CtkNotebook             *notebook G_GNUC_UNUSED,
 			TerminalScreenContainer *container,
-			guint                    position G_GNUC_UNUSED,
+			guint                    position,
 			TerminalTabsMenu        *menu)
 {
 	TerminalTabsMenuPrivate *priv = menu->priv;
@@ -218,9 +200,9 @@ notebook_page_added_cb (CtkNotebook             *notebook G_GNUC_UNUSED,
 	g_signal_connect (action, "activate",
 	                  G_CALLBACK (tab_action_activate_cb), menu);
 
-	g_object_unref (action);
+	terminal_tabs_menu_add_item (menu, action, position);
 
-	terminal_tabs_menu_update (menu);
+	g_object_unref (action);
 }
 
 static void
@@ -238,6 +220,8 @@ notebook_page_removed_cb (CtkNotebook             *notebook G_GNUC_UNUSED,
 	action = g_object_get_data (G_OBJECT (screen), DATA_KEY);
 	g_return_if_fail (action != NULL);
 
+	terminal_tabs_menu_remove_item (menu, action);
+
 	free_tab_id (action);
 
 	g_signal_handlers_disconnect_by_func
@@ -248,17 +232,26 @@ notebook_page_removed_cb (CtkNotebook             *notebook G_GNUC_UNUSED,
 
 	g_object_set_data (G_OBJECT (screen), DATA_KEY, NULL);
 	ctk_action_group_remove_action (priv->action_group, action);
-
-	terminal_tabs_menu_update (menu);
 }
 
 static void
 notebook_page_reordered_cb (CtkNotebook      *notebook G_GNUC_UNUSED,
-			    CtkBin           *bin G_GNUC_UNUSED,
-			    guint             position G_GNUC_UNUSED,
+			    CtkBin           *bin,
+			    guint             position,
 			    TerminalTabsMenu *menu)
 {
-	terminal_tabs_menu_update (menu);
+	TerminalScreen *screen;
+	CtkAction *action;
+
+	screen = terminal_screen_container_get_screen (TERMINAL_SCREEN_CONTAINER (bin));
+
+	action = g_object_get_data (G_OBJECT (screen), DATA_KEY);
+	g_return_if_fail (action != NULL);
+
+	g_object_ref (action);
+	terminal_tabs_menu_remove_item (menu, action);
+	terminal_tabs_menu_add_item (menu, action, position);
+	g_object_unref (action);
 }
 
 static void
@@ -362,11 +355,22 @@ terminal_tabs_menu_get_property (GObject    *object G_GNUC_UNUSED,
 	g_return_if_reached ();
 }
 
+static void
+terminal_tabs_menu_finalize (GObject *object)
+{
+	TerminalTabsMenu *menu = TERMINAL_TABS_MENU (object);
+
+	g_ptr_array_free (menu->priv->actions, TRUE);
+
+	G_OBJECT_CLASS (terminal_tabs_menu_parent_class)->finalize (object);
+}
+
 static void
 terminal_tabs_menu_class_init (TerminalTabsMenuClass *klass)
 {
 	GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
+	object_class->finalize = terminal_tabs_menu_finalize;
 	object_class->set_property = terminal_tabs_menu_set_property;
 	object_class->get_property = terminal_tabs_menu_get_property;
 
@@ -385,20 +389,8 @@ static void
 terminal_tabs_menu_init (TerminalTabsMenu *menu)
 {
 	menu->priv = terminal_tabs_menu_get_instance_private (menu);
-}
-
-static void
-terminal_tabs_menu_clean (TerminalTabsMenu *menu)
-{
-	TerminalTabsMenuPrivate *p = menu->priv;
-	CtkUIManager *manager = CTK_UI_MANAGER (terminal_window_get_ui_manager (p->window));
 
-	if (p->ui_id != 0)
-	{
-		ctk_ui_manager_remove_ui (manager, p->ui_id);
-		ctk_ui_manager_ensure_update (manager);
-		p->ui_id = 0;
-	}
+	menu->priv->actions = g_ptr_array_new ();
 }
 
 TerminalTabsMenu *
@@ -430,47 +422,113 @@ tab_set_action_accelerator (CtkActionGroup *action_group G_GNUC_UNUSED,
 	}
 }
 
+/* Sets the accelerators of the items from @first on; only the first
+ * TERMINAL_ACCELS_N_TABS_SWITCH positions have one.
+ */
 static void
-terminal_tabs_menu_update (TerminalTabsMenu *menu)
+terminal_tabs_menu_update_accels (TerminalTabsMenu *menu,
+                                  guint             first)
 {
 	TerminalTabsMenuPrivate *p = menu->priv;
-	CtkUIManager *manager;
-	GList *tabs = NULL, *l;
-	guint i = 0, n;
+	guint i, n;
 	gboolean is_single_tab;
 
-	terminal_tabs_menu_clean (menu);
+	n = p->actions->len;
+	is_single_tab = (n == 1);
 
-	tabs = terminal_window_list_screen_containers (p->window);
+	/* The first item loses or regains its accel with the second tab */
+	if (n <= 2)
+		first = 0;
 
-	n = g_list_length (tabs);
-	if (n == 0) return;
+	for (i = first; i < n && i <= TERMINAL_ACCELS_N_TABS_SWITCH; ++i)
+		tab_set_action_accelerator (p->action_group,
+		                            g_ptr_array_index (p->actions, i),
+		                            i, is_single_tab);
+}
 
-	is_single_tab = (n == 1);
+/* Adds the menu item for @action at @position, with its own merge id so
+ * that it can later be removed on its own.
+ */
+static void
+terminal_tabs_menu_add_item (TerminalTabsMenu *menu,
+                             CtkAction        *action,
+                             guint             position)
+{
+	TerminalTabsMenuPrivate *p = menu->priv;
+	CtkUIManager *manager;
+	const char *verb;
+	char *path;
+	guint merge_id;
+	gboolean top;
+
+	manager = CTK_UI_MANAGER (terminal_window_get_ui_manager (p->window));
 
-	manager =  CTK_UI_MANAGER (terminal_window_get_ui_manager (p->window));
-	p->ui_id = ctk_ui_manager_new_merge_id (manager);
+	position = MIN (position, p->actions->len);
 
-	for (l = tabs; l != NULL; l = l->next)
+	/* Place the item right after the one for the previous tab, or right
+	 * before the one for the next tab if it becomes the first.
+	 */
+	if (position > 0)
+	{
+		path = g_strconcat (UI_PATH "/",
+		                    ctk_action_get_name (g_ptr_array_index (p->actions, position - 1)),
+		                    NULL);
+		top = FALSE;
+	}
+	else if (p->actions->len > 0)
 	{
-		const char *verb;
-		CtkAction *action;
+		path = g_strconcat (UI_PATH "/",
+		                    ctk_action_get_name (g_ptr_array_index (p->actions, 0)),
+		                    NULL);
+		top = TRUE;
+	}
+	else
+	{
+		path = g_strdup (UI_PATH);
+		top = FALSE;
+	}
 
-		TerminalScreenContainer *container = TERMINAL_SCREEN_CONTAINER (l->data);
-		GObject *screen = G_OBJECT (terminal_screen_container_get_screen (container));
+	verb = ctk_action_get_name (action);
+	merge_id = ctk_ui_manager_new_merge_id (manager);
+	ctk_ui_manager_add_ui (manager, merge_id,
+	                       path,
+	                       verb, verb,
+	                       CTK_UI_MANAGER_MENUITEM, top);
+	g_free (path);
+
+	g_object_set_data (G_OBJECT (action), MERGE_ID_DATA_KEY, GUINT_TO_POINTER (merge_id));
+
+	g_ptr_array_insert (p->actions, position, action);
+
+	terminal_tabs_menu_update_accels (menu, position);
+}
 
-		action = g_object_get_data (screen, DATA_KEY);
-		g_return_if_fail (action != NULL);
+static void
+terminal_tabs_menu_remove_item (TerminalTabsMenu *menu,
+                                CtkAction        *action)
+{
+	TerminalTabsMenuPrivate *p = menu->priv;
+	CtkUIManager *manager;
+	guint merge_id, position;
 
-		verb = ctk_action_get_name (action);
+	for (position = 0; position < p->actions->len; ++position)
+		if (g_ptr_array_index (p->actions, position) == action)
+			break;
+	g_return_if_fail (position < p->actions->len);
 
-		tab_set_action_accelerator (p->action_group, action, i++, is_single_tab);
+	manager = CTK_UI_MANAGER (terminal_window_get_ui_manager (p->window));
 
-		ctk_ui_manager_add_ui (manager, p->ui_id,
-		                       UI_PATH,
-		                       verb, verb,
-		                       CTK_UI_MANAGER_MENUITEM, FALSE);
+	merge_id = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (action), MERGE_ID_DATA_KEY));
+	if (merge_id != 0)
+	{
+		ctk_ui_manager_remove_ui (manager, merge_id);
+		/* Flush the removal, so the item can be added again right away */
+		ctk_ui_manager_ensure_update (manager);
 	}
+	g_object_set_data (G_OBJECT (action), MERGE_ID_DATA_KEY, NULL);
+
+	g_ptr_array_remove_index (p->actions, position);
 
-	g_list_free (tabs);
+	tab_set_action_accelerator (p->action_group, action, 0, TRUE);
+	terminal_tabs_menu_update_accels (menu, position);
 }
@@ -43,6 +43,8 @@
 #include "terminal-util.h"
 #include "terminal-window.h"
 
+#include "eggshell.h"
+
 void
 terminal_util_set_unique_role (CtkWindow *window, const char *prefix)
 {
@@ -672,42 +674,141 @@ setup_autoconfig_proxy_env (GHashTable *env_table G_GNUC_UNUSED,
 }
 
 /**
- * terminal_util_add_proxy_env:
- * @env_table: a #GHashTable
+ * terminal_util_get_proxy_env:
+ * @settings: a #GSettings for %CONF_PROXY_SCHEMA
+ * @settings_http: a #GSettings for %CONF_HTTP_PROXY_SCHEMA
+ * @settings_https: a #GSettings for %CONF_HTTPS_PROXY_SCHEMA
+ * @settings_ftp: a #GSettings for %CONF_FTP_PROXY_SCHEMA
+ * @settings_socks: a #GSettings for %CONF_SOCKS_PROXY_SCHEMA
+ *
+ * Resolves the proxy env variables from the system proxy settings.
  *
- * Adds the proxy env variables to @env_table.
+ * Returns: a new #GHashTable to be used with terminal_util_merge_proxy_env()
  */
-void
-terminal_util_add_proxy_env (GHashTable *env_table)
+GHashTable *
+terminal_util_get_proxy_env (GSettings *settings,
+                             GSettings *settings_http,
+                             GSettings *settings_https,
+                             GSettings *settings_ftp,
+                             GSettings *settings_socks)
 {
+	GHashTable *proxy_env;
 	char *proxymode;
-	GSettings *settings = g_settings_new (CONF_PROXY_SCHEMA);
-	GSettings *settings_http = g_settings_new (CONF_HTTP_PROXY_SCHEMA);
-	GSettings *settings_https = g_settings_new (CONF_HTTPS_PROXY_SCHEMA);
-	GSettings *settings_ftp = g_settings_new (CONF_FTP_PROXY_SCHEMA);
-	GSettings *settings_socks = g_settings_new (CONF_SOCKS_PROXY_SCHEMA);
+
+	proxy_env = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
 
 	/* If mode is not manual, nothing to set */
 	proxymode = gsettings_get_string (settings, "mode");
 	if (proxymode && 0 == strcmp (proxymode, "manual"))
 	{
-		setup_http_proxy_env (env_table, settings_http);
-		setup_ignore_host_env (env_table, settings);
-		setup_https_proxy_env (env_table, settings_https);
-		setup_ftp_proxy_env (env_table, settings_ftp);
-		setup_socks_proxy_env (env_table, settings_socks);
+		setup_http_proxy_env (proxy_env, settings_http);
+		setup_ignore_host_env (proxy_env, settings);
+		setup_https_proxy_env (proxy_env, settings_https);
+		setup_ftp_proxy_env (proxy_env, settings_ftp);
+		setup_socks_proxy_env (proxy_env, settings_socks);
 	}
 	else if (proxymode && 0 == strcmp (proxymode, "auto"))
 	{
-		setup_autoconfig_proxy_env (env_table, settings);
+		setup_autoconfig_proxy_env (proxy_env, settings);
 	}
 
 	g_free (proxymode);
-	g_object_unref (settings);
-	g_object_unref (settings_http);
-	g_object_unref (settings_https);
-	g_object_unref (settings_ftp);
-	g_object_unref (settings_socks);
+
+	return proxy_env;
+}
+
+/**
+ * terminal_util_merge_proxy_env:
+ * @env_table: a #GHashTable
+ * @proxy_env: a #GHashTable from terminal_util_get_proxy_env()
+ *
+ * Adds the proxy env variables from @proxy_env to @env_table, never
+ * overwriting a value already present in @env_table.
+ */
+void
+terminal_util_merge_proxy_env (GHashTable *env_table,
+                               GHashTable *proxy_env)
+{
+	GHashTableIter iter;
+	const char *key, *value;
+
+	g_hash_table_iter_init (&iter, proxy_env);
+	while (g_hash_table_iter_next (&iter, (gpointer *) &key, (gpointer *) &value))
+	{
+		/* set_proxy_env() takes care of the upper-case variant */
+		if (!g_ascii_islower (key[0]))
+			continue;
+
+		set_proxy_env (env_table, key, g_strdup (value));
+	}
+}
+
+/**
+ * terminal_util_get_profile_command:
+ * @profile: a #TerminalProfile
+ * @shell_env: the value of SHELL in the child environment, or %NULL
+ * @spawn_flags_p: spawn flags to add the needed flags to
+ * @argv_p: return location for the command line
+ * @err: return location for a #GError
+ *
+ * Builds the command line for a child process using @profile: either its
+ * custom command, or the user's shell.
+ *
+ * Returns: %TRUE on success, %FALSE with @err set otherwise
+ */
+gboolean
+terminal_util_get_profile_command (TerminalProfile *profile,
+                                   const char      *shell_env,
+                                   GSpawnFlags     *spawn_flags_p,
+                                   char          ***argv_p,
+                                   GError         **err)
+{
+	char **argv;
+
+	g_assert (spawn_flags_p != NULL && argv_p != NULL);
+
+	*argv_p = argv = NULL;
+
+	if (terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_USE_CUSTOM_COMMAND))
+	{
+		if (!g_shell_parse_argv (terminal_profile_get_property_string (profile, TERMINAL_PROFILE_CUSTOM_COMMAND),
+		                         NULL, &argv,
+		                         err))
+			return FALSE;
+
+		*spawn_flags_p |= G_SPAWN_SEARCH_PATH;
+	}
+	else
+	{
+		const char *only_name;
+		char *shell;
+		int argc = 0;
+
+		shell = egg_shell (shell_env);
+
+		only_name = strrchr (shell, '/');
+		if (only_name != NULL)
+			only_name++;
+		else
+			only_name = shell;
+
+		argv = g_new (char*, 3);
+
+		argv[argc++] = shell;
+
+		if (terminal_profile_get_property_boolean (profile, TERMINAL_PROFILE_LOGIN_SHELL))
+			argv[argc++] = g_strconcat ("-", only_name, NULL);
+		else
+			argv[argc++] = g_strdup (only_name);
+
+		argv[argc++] = NULL;
+
+		*spawn_flags_p |= G_SPAWN_FILE_AND_ARGV_ZERO;
+	}
+
+	*argv_p = argv;
+
+	return TRUE;
 }
 
 /* Bidirectional object/widget binding */
@@ -979,6 +1080,150 @@ terminal_util_bind_object_property_to_widget (GObject *object,
 	change->object_notify_id = g_signal_connect_swapped (object, notify_signal_name, G_CALLBACK (object_change_notify_cb), change);
 }
 
+/* Background image loading */
+
+/* The size of the image file, set on images that were cropped */
+#define IMAGE_SOURCE_WIDTH_DATA_KEY "terminal-image-source-width"
+#define IMAGE_SOURCE_HEIGHT_DATA_KEY "terminal-image-source-height"
+
+typedef struct
+{
+	char *path;
+	int max_width;
+	int max_height;
+} ImageLoadData;
+
+static void
+image_load_data_free (ImageLoadData *data)
+{
+	g_free (data->path);
+	g_slice_free (ImageLoadData, data);
+}
+
+static void
+image_load_thread (GTask        *task,
+                   gpointer      source_object G_GNUC_UNUSED,
+                   gpointer      task_data,
+                   GCancellable *cancellable G_GNUC_UNUSED)
+{
+	ImageLoadData *data = task_data;
+	GdkPixbuf *pixbuf;
+	GError *error = NULL;
+	int width, height;
+
+	/* It may have waited for a thread for a while */
+	if (g_task_return_error_if_cancelled (task))
+		return;
+
+	pixbuf = gdk_pixbuf_new_from_file (data->path, &error);
+	if (!pixbuf)
+	{
+		g_task_return_error (task, error);
+		return;
+	}
+
+	/* The image is tiled from the top left corner, so nothing beyond
+	 * the largest window is ever shown; don't keep it around.
+	 */
+	width = gdk_pixbuf_get_width (pixbuf);
+	height = gdk_pixbuf_get_height (pixbuf);
+	if (data->max_width > 0 && data->max_height > 0 &&
+	    (width > data->max_width || height > data->max_height))
+	{
+		GdkPixbuf *sub, *cropped;
+
+		sub = gdk_pixbuf_new_subpixbuf (pixbuf, 0, 0,
+		                                MIN (width, data->max_width),
+		                                MIN (height, data->max_height));
+		cropped = gdk_pixbuf_copy (sub);
+		g_object_unref (sub);
+		g_object_unref (pixbuf);
+
+		pixbuf = cropped;
+		g_object_set_data (G_OBJECT (pixbuf), IMAGE_SOURCE_WIDTH_DATA_KEY, GINT_TO_POINTER (width));
+		g_object_set_data (G_OBJECT (pixbuf), IMAGE_SOURCE_HEIGHT_DATA_KEY, GINT_TO_POINTER (height));
+	}
+
+	if (!g_task_return_error_if_cancelled (task))
+		g_task_return_pointer (task, pixbuf, g_object_unref);
+	else
+		g_object_unref (pixbuf);
+}
+
+/**
+ * terminal_util_load_image_async:
+ * @path: the image file, in the GLib filename encoding
+ * @max_width: the width beyond which the image is cropped, or 0
+ * @max_height: the height beyond which the image is cropped, or 0
+ * @cancellable: (allow-none): a #GCancellable
+ * @callback: called in the main thread when the image is loaded
+ * @user_data: data for @callback
+ *
+ * Decodes @path in a worker thread, so that a large image, or one on
+ * a slow file system, doesn't block the UI.
+ */
+void
+terminal_util_load_image_async (const char          *path,
+                                int                  max_width,
+                                int                  max_height,
+                                GCancellable        *cancellable,
+                                GAsyncReadyCallback  callback,
+                                gpointer             user_data)
+{
+	ImageLoadData *data;
+	GTask *task;
+
+	data = g_slice_new (ImageLoadData);
+	data->path = g_strdup (path);
+	data->max_width = max_width;
+	data->max_height = max_height;
+
+	task = g_task_new (NULL, cancellable, callback, user_data);
+	g_task_set_task_data (task, data, (GDestroyNotify) image_load_data_free);
+	g_task_run_in_thread (task, image_load_thread);
+	g_object_unref (task);
+}
+
+/**
+ * terminal_util_load_image_finish:
+ * @result: the #GAsyncResult passed to the callback
+ * @error: return location for a #GError
+ *
+ * Returns: (transfer full): the image, or %NULL with @error set
+ */
+GdkPixbuf *
+terminal_util_load_image_finish (GAsyncResult  *result,
+                                 GError       **error)
+{
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/**
+ * terminal_util_image_covers:
+ * @pixbuf: an image from terminal_util_load_image_finish()
+ * @width: the width of the area to cover
+ * @height: the height of the area to cover
+ *
+ * Returns: %FALSE if @pixbuf was cropped, and the image file has more to
+ *   show in a @width by @height area
+ */
+gboolean
+terminal_util_image_covers (GdkPixbuf *pixbuf,
+                            int        width,
+                            int        height)
+{
+	int source_width, source_height;
+
+	source_width = GPOINTER_TO_INT (g_object_get_data (G_OBJECT (pixbuf), IMAGE_SOURCE_WIDTH_DATA_KEY));
+	source_height = GPOINTER_TO_INT (g_object_get_data (G_OBJECT (pixbuf), IMAGE_SOURCE_HEIGHT_DATA_KEY));
+	if (source_width == 0 || source_height == 0)
+		return TRUE; /* not cropped */
+
+	/* A dimension that wasn't cropped has nothing more to show */
+	return (gdk_pixbuf_get_width (pixbuf) >= MIN (width, source_width) &&
+	        gdk_pixbuf_get_height (pixbuf) >= MIN (height, source_height));
+}
+
 #ifdef CDK_WINDOWING_X11
 
 /* Asks the window manager to turn off the "demands attention" state on the window.
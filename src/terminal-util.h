@@ -89,7 +89,20 @@ char **terminal_util_key_file_get_argv    (GKeyFile *key_file,
         int *argc,
         GError **error);
 
-void terminal_util_add_proxy_env (GHashTable *env_table);
+GHashTable *terminal_util_get_proxy_env (GSettings *settings,
+                                         GSettings *settings_http,
+                                         GSettings *settings_https,
+                                         GSettings *settings_ftp,
+                                         GSettings *settings_socks);
+
+void terminal_util_merge_proxy_env (GHashTable *env_table,
+                                    GHashTable *proxy_env);
+
+gboolean terminal_util_get_profile_command (TerminalProfile *profile,
+                                            const char      *shell_env,
+                                            GSpawnFlags     *spawn_flags_p,
+                                            char          ***argv_p,
+                                            GError         **err);
 
 typedef enum
 {
@@ -103,6 +116,20 @@ void terminal_util_bind_object_property_to_widget (GObject *object,
 
 void terminal_util_x11_clear_demands_attention (CdkWindow *window);
 
+void terminal_util_load_image_async (const char          *path,
+                                     int                  max_width,
+                                     int                  max_height,
+                                     GCancellable        *cancellable,
+                                     GAsyncReadyCallback  callback,
+                                     gpointer             user_data);
+
+GdkPixbuf *terminal_util_load_image_finish (GAsyncResult  *result,
+                                            GError       **error);
+
+gboolean terminal_util_image_covers (GdkPixbuf *pixbuf,
+                                     int        width,
+                                     int        height);
+
 G_END_DECLS
 
 #endif /* TERMINAL_UTIL_H */
@@ -52,20 +52,17 @@ struct _TerminalWindowPrivate
     CtkUIManager *ui_manager;
     guint ui_id;
 
-    CtkActionGroup *profiles_action_group;
     guint profiles_ui_id;
-
-    CtkActionGroup *encodings_action_group;
+    guint new_terminal_ui_id;
     guint encodings_ui_id;
+    guint n_profile_slots_merged;
+    guint n_encoding_slots_merged;
 
     TerminalTabsMenu *tabs_menu;
 
     TerminalScreenPopupInfo *popup_info;
     guint remove_popup_info_idle;
 
-    CtkActionGroup *new_terminal_action_group;
-    guint new_terminal_ui_id;
-
     CtkWidget *menubar;
     CtkWidget *notebook;
     CtkWidget *main_vbox;
@@ -88,6 +85,11 @@ struct _TerminalWindowPrivate
 
     void *old_geometry_widget; /* only used for pointer value as it may be freed */
 
+    /* Bumped whenever the chrome may have changed; the metrics above are
+     * only measured again when it differs from old_geometry_generation. */
+    guint geometry_generation;
+    guint old_geometry_generation;
+
     CtkWidget *confirm_close_dialog;
     CtkWidget *search_find_dialog;
 
@@ -635,372 +637,531 @@ disconnect_profiles_from_actions_in_group (CtkActionGroup *action_group)
 }
 
 static void
-terminal_window_update_set_profile_menu_active_profile (TerminalWindow *window)
+terminal_set_encoding_callback (CtkToggleAction *action,
+                                TerminalWindow *window)
 {
     TerminalWindowPrivate *priv = window->priv;
-    TerminalProfile *new_active_profile;
-    GList *actions, *l;
+    TerminalEncoding *encoding;
 
-    if (!priv->profiles_action_group)
+    if (!ctk_toggle_action_get_active (action))
         return;
 
-    if (!priv->active_screen)
+    if (priv->active_screen == NULL)
         return;
 
-    new_active_profile = terminal_screen_get_profile (priv->active_screen);
+    encoding = g_object_get_data (G_OBJECT (action), ENCODING_DATA_KEY);
+    g_assert (encoding);
 
-    actions = ctk_action_group_list_actions (priv->profiles_action_group);
-    for (l = actions; l != NULL; l = l->next)
-    {
-        GObject *action = G_OBJECT (l->data);
-        TerminalProfile *profile;
+    bte_terminal_set_encoding (BTE_TERMINAL (priv->active_screen),
+                               terminal_encoding_get_charset (encoding), NULL);
+}
 
-        profile = g_object_get_data (action, PROFILE_DATA_KEY);
-        if (profile != new_active_profile)
-            continue;
+/* The actions of the profile, new terminal and encoding menus are shared
+ * by all windows, so that a change to the profile or encoding list updates
+ * them once rather than once per window. They live in slots that are only
+ * ever added, and slots not in use are hidden; each window merges the slots
+ * into its own UI manager when its menus can next be shown. The actions act
+ * on the window that was last synced with them, i.e. the focused one.
+ */
+typedef struct
+{
+    guint n_windows;
+    TerminalWindow *window;
 
-        g_signal_handlers_block_by_func (action, G_CALLBACK (terminal_set_profile_toggled_callback), window);
-        ctk_toggle_action_set_active (CTK_TOGGLE_ACTION (action), TRUE);
-        g_signal_handlers_unblock_by_func (action, G_CALLBACK (terminal_set_profile_toggled_callback), window);
+    CtkActionGroup *profiles_action_group;
+    CtkActionGroup *new_terminal_action_group;
+    guint n_profile_slots;
+    guint n_profiles;
 
-        break;
-    }
-    g_list_free (actions);
+    CtkActionGroup *encodings_action_group;
+    GPtrArray *encoding_actions;
+    guint n_encodings;
+} TerminalWindowSharedActions;
+
+static TerminalWindowSharedActions *shared_actions = NULL;
+
+static void terminal_window_sync_shared_actions (TerminalWindow *window);
+
+static void
+shared_profile_toggled_cb (CtkToggleAction *action,
+                           gpointer         user_data G_GNUC_UNUSED)
+{
+    if (shared_actions->window != NULL)
+        terminal_set_profile_toggled_callback (action, shared_actions->window);
 }
 
 static void
-terminal_window_update_set_profile_menu (TerminalWindow *window)
+shared_new_tab_activate_cb (CtkAction *action,
+                            gpointer   user_data G_GNUC_UNUSED)
 {
-    TerminalWindowPrivate *priv = window->priv;
-    TerminalProfile *active_profile;
-    CtkActionGroup *action_group;
-    CtkAction *action;
-    GList *profiles, *p;
-    GSList *group;
-    guint n;
-    gboolean single_profile;
+    if (shared_actions->window != NULL)
+        file_new_tab_callback (action, shared_actions->window);
+}
 
-    /* Remove the old UI */
-    if (priv->profiles_ui_id != 0)
-    {
-        ctk_ui_manager_remove_ui (priv->ui_manager, priv->profiles_ui_id);
-        priv->profiles_ui_id = 0;
-    }
+static void
+shared_new_window_activate_cb (CtkAction *action,
+                               gpointer   user_data G_GNUC_UNUSED)
+{
+    if (shared_actions->window != NULL)
+        file_new_window_callback (action, shared_actions->window);
+}
+
+static void
+shared_encoding_toggled_cb (CtkToggleAction *action,
+                            gpointer         user_data G_GNUC_UNUSED)
+{
+    if (shared_actions->window != NULL)
+        terminal_set_encoding_callback (action, shared_actions->window);
+}
+
+static CtkAction *
+shared_actions_get_slot_action (CtkActionGroup *action_group,
+                                const char     *format,
+                                guint           slot)
+{
+    char name[32];
+
+    g_snprintf (name, sizeof (name), format, slot);
+    return ctk_action_group_get_action (action_group, name);
+}
+
+static void
+shared_actions_set_slot_profile (CtkAction       *action,
+                                 TerminalProfile *profile,
+                                 gboolean         visible)
+{
+    TerminalProfile *old_profile;
+
+    ctk_action_set_visible (action, profile != NULL && visible);
+
+    old_profile = g_object_get_data (G_OBJECT (action), PROFILE_DATA_KEY);
+    if (old_profile == profile)
+        return;
+
+    if (old_profile != NULL)
+        g_signal_handlers_disconnect_by_func (old_profile, G_CALLBACK (profile_visible_name_notify_cb), action);
 
-    if (priv->profiles_action_group != NULL)
+    if (profile == NULL)
     {
-        disconnect_profiles_from_actions_in_group (priv->profiles_action_group);
-        ctk_ui_manager_remove_action_group (priv->ui_manager,
-                                            priv->profiles_action_group);
-        priv->profiles_action_group = NULL;
+        g_object_set_data (G_OBJECT (action), PROFILE_DATA_KEY, NULL);
+        return;
     }
 
-    profiles = terminal_app_get_profile_list (terminal_app_get ());
+    g_object_set_data_full (G_OBJECT (action),
+                            PROFILE_DATA_KEY,
+                            g_object_ref (profile),
+                            (GDestroyNotify) g_object_unref);
+    profile_visible_name_notify_cb (profile, NULL, action);
+    g_signal_connect (profile, "notify::" TERMINAL_PROFILE_VISIBLE_NAME,
+                      G_CALLBACK (profile_visible_name_notify_cb), action);
+}
 
-    action = ctk_action_group_get_action (priv->action_group, "TerminalProfiles");
-    single_profile = !profiles || profiles->next == NULL; /* list length <= 1 */
-    ctk_action_set_sensitive (action, !single_profile);
-    if (profiles == NULL)
-        return;
+static void
+shared_actions_add_profile_slot (void)
+{
+    TerminalWindowSharedActions *shared = shared_actions;
+    CtkRadioAction *profile_action;
+    CtkAction *action;
+    GSList *group = NULL;
+    char name[32];
+    guint slot;
 
-    if (priv->active_screen)
-        active_profile = terminal_screen_get_profile (priv->active_screen);
-    else
-        active_profile = NULL;
+    slot = shared->n_profile_slots++;
 
-    action_group = priv->profiles_action_group = ctk_action_group_new ("Profiles");
-    ctk_ui_manager_insert_action_group (priv->ui_manager, action_group, -1);
-    g_object_unref (action_group);
+    if (slot > 0)
+        group = ctk_radio_action_get_group (CTK_RADIO_ACTION (shared_actions_get_slot_action (shared->profiles_action_group,
+                                            "TerminalSetProfile%u", 0)));
 
-    priv->profiles_ui_id = ctk_ui_manager_new_merge_id (priv->ui_manager);
+    g_snprintf (name, sizeof (name), "TerminalSetProfile%u", slot);
+    profile_action = ctk_radio_action_new (name, NULL, NULL, NULL, slot + 1);
+    ctk_radio_action_set_group (profile_action, group);
+    g_signal_connect (profile_action, "toggled",
+                      G_CALLBACK (shared_profile_toggled_cb), NULL);
+    ctk_action_group_add_action (shared->profiles_action_group, CTK_ACTION (profile_action));
+    g_object_unref (profile_action);
 
-    group = NULL;
-    n = 0;
-    for (p = profiles; p != NULL; p = p->next)
-    {
-        TerminalProfile *profile = (TerminalProfile *) p->data;
-        CtkRadioAction *profile_action;
-        char name[32];
+    g_snprintf (name, sizeof (name), "FileNewTab.%u", slot);
+    action = ctk_action_new (name, NULL, NULL, NULL);
+    g_signal_connect (action, "activate",
+                      G_CALLBACK (shared_new_tab_activate_cb), NULL);
+    ctk_action_group_add_action (shared->new_terminal_action_group, action);
+    g_object_unref (action);
 
-        g_snprintf (name, sizeof (name), "TerminalSetProfile%u", n++);
+    g_snprintf (name, sizeof (name), "FileNewWindow.%u", slot);
+    action = ctk_action_new (name, NULL, NULL, NULL);
+    g_signal_connect (action, "activate",
+                      G_CALLBACK (shared_new_window_activate_cb), NULL);
+    ctk_action_group_add_action (shared->new_terminal_action_group, action);
+    g_object_unref (action);
+}
 
-        profile_action = ctk_radio_action_new (name,
-                                               NULL,
-                                               NULL,
-                                               NULL,
-                                               n);
+static void
+shared_actions_update_profiles (void)
+{
+    TerminalWindowSharedActions *shared = shared_actions;
+    GList *profiles, *p;
+    gboolean single_profile;
+    guint slot;
 
-        ctk_radio_action_set_group (profile_action, group);
-        group = ctk_radio_action_get_group (profile_action);
+    profiles = terminal_app_get_profile_list (terminal_app_get ());
+    shared->n_profiles = g_list_length (profiles);
+    single_profile = shared->n_profiles <= 1;
 
-        if (profile == active_profile)
-            ctk_toggle_action_set_active (CTK_TOGGLE_ACTION (profile_action), TRUE);
+    while (shared->n_profile_slots < shared->n_profiles)
+        shared_actions_add_profile_slot ();
 
-        g_object_set_data_full (G_OBJECT (profile_action),
-                                PROFILE_DATA_KEY,
-                                g_object_ref (profile),
-                                (GDestroyNotify) g_object_unref);
-        profile_visible_name_notify_cb (profile, NULL, CTK_ACTION (profile_action));
-        g_signal_connect (profile, "notify::" TERMINAL_PROFILE_VISIBLE_NAME,
-                          G_CALLBACK (profile_visible_name_notify_cb), profile_action);
-        g_signal_connect (profile_action, "toggled",
-                          G_CALLBACK (terminal_set_profile_toggled_callback), window);
+    p = profiles;
+    for (slot = 0; slot < shared->n_profile_slots; ++slot)
+    {
+        TerminalProfile *profile = NULL;
 
-        ctk_action_group_add_action (action_group, CTK_ACTION (profile_action));
-        g_object_unref (profile_action);
+        if (p != NULL)
+        {
+            profile = (TerminalProfile *) p->data;
+            p = p->next;
+        }
 
-        ctk_ui_manager_add_ui (priv->ui_manager, priv->profiles_ui_id,
-                               PROFILES_UI_PATH,
-                               name, name,
-                               CTK_UI_MANAGER_MENUITEM, FALSE);
-        ctk_ui_manager_add_ui (priv->ui_manager, priv->profiles_ui_id,
-                               PROFILES_POPUP_UI_PATH,
-                               name, name,
-                               CTK_UI_MANAGER_MENUITEM, FALSE);
+        shared_actions_set_slot_profile (shared_actions_get_slot_action (shared->profiles_action_group,
+                                         "TerminalSetProfile%u", slot),
+                                         profile, TRUE);
+        shared_actions_set_slot_profile (shared_actions_get_slot_action (shared->new_terminal_action_group,
+                                         "FileNewTab.%u", slot),
+                                         profile, !single_profile);
+        shared_actions_set_slot_profile (shared_actions_get_slot_action (shared->new_terminal_action_group,
+                                         "FileNewWindow.%u", slot),
+                                         profile, !single_profile);
     }
 
     g_list_free (profiles);
 }
 
 static void
-terminal_window_create_new_terminal_action (TerminalWindow  *window,
-					    TerminalProfile *profile,
-					    const char      *name,
-					    guint            num G_GNUC_UNUSED,
-					    GCallback        callback)
+shared_actions_set_slot_encoding (guint             slot,
+                                  TerminalEncoding *encoding)
 {
-    TerminalWindowPrivate *priv = window->priv;
     CtkAction *action;
+    char *display_name;
 
-    action = ctk_action_new (name, NULL, NULL, NULL);
+    action = g_ptr_array_index (shared_actions->encoding_actions, slot);
 
-    g_object_set_data_full (G_OBJECT (action),
-                            PROFILE_DATA_KEY,
-                            g_object_ref (profile),
-                            (GDestroyNotify) g_object_unref);
-    profile_visible_name_notify_cb (profile, NULL, action);
-    g_signal_connect (profile, "notify::" TERMINAL_PROFILE_VISIBLE_NAME,
-                      G_CALLBACK (profile_visible_name_notify_cb), action);
-    g_signal_connect (action, "activate", callback, window);
+    ctk_action_set_visible (action, encoding != NULL);
 
-    ctk_action_group_add_action (priv->new_terminal_action_group, action);
-    g_object_unref (action);
+    if (g_object_get_data (G_OBJECT (action), ENCODING_DATA_KEY) == encoding)
+        return;
+
+    if (encoding == NULL)
+    {
+        g_object_set_data (G_OBJECT (action), ENCODING_DATA_KEY, NULL);
+        return;
+    }
+
+    display_name = g_strdup_printf ("%s (%s)", encoding->name, terminal_encoding_get_charset (encoding));
+    g_object_set (action, "label", display_name, NULL);
+    g_free (display_name);
+
+    g_object_set_data_full (G_OBJECT (action), ENCODING_DATA_KEY,
+                            terminal_encoding_ref (encoding),
+                            (GDestroyNotify) terminal_encoding_unref);
+}
+
+static void
+shared_actions_add_encoding_slot (void)
+{
+    TerminalWindowSharedActions *shared = shared_actions;
+    CtkRadioAction *encoding_action;
+    GSList *group = NULL;
+    char name[32];
+    guint slot;
+
+    slot = shared->encoding_actions->len;
+
+    if (slot > 0)
+        group = ctk_radio_action_get_group (CTK_RADIO_ACTION (g_ptr_array_index (shared->encoding_actions, 0)));
+
+    g_snprintf (name, sizeof (name), SET_ENCODING_ACTION_NAME_PREFIX "%u", slot);
+    encoding_action = ctk_radio_action_new (name, NULL, NULL, NULL, slot);
+    ctk_radio_action_set_group (encoding_action, group);
+    g_signal_connect (encoding_action, "toggled",
+                      G_CALLBACK (shared_encoding_toggled_cb), NULL);
+    ctk_action_group_add_action (shared->encodings_action_group, CTK_ACTION (encoding_action));
+    g_ptr_array_add (shared->encoding_actions, encoding_action);
+    g_object_unref (encoding_action);
 }
 
 static void
-terminal_window_update_new_terminal_menus (TerminalWindow *window)
+shared_actions_update_encodings (void)
 {
-    TerminalWindowPrivate *priv = window->priv;
-    CtkActionGroup *action_group;
-    CtkAction *action;
-    GList *profiles, *p;
-    guint n;
-    gboolean have_single_profile;
+    TerminalWindowSharedActions *shared = shared_actions;
+    GSList *encodings, *l;
+    guint slot;
 
-    /* Remove the old UI */
-    if (priv->new_terminal_ui_id != 0)
-    {
-        ctk_ui_manager_remove_ui (priv->ui_manager, priv->new_terminal_ui_id);
-        priv->new_terminal_ui_id = 0;
-    }
+    encodings = terminal_app_get_active_encodings (terminal_app_get ());
+    shared->n_encodings = g_slist_length (encodings);
+
+    /* One more slot for the encoding of the active terminal, in case
+     * it is not in the list.
+     */
+    while (shared->encoding_actions->len < shared->n_encodings + 1)
+        shared_actions_add_encoding_slot ();
 
-    if (priv->new_terminal_action_group != NULL)
+    l = encodings;
+    for (slot = 0; slot < shared->encoding_actions->len; ++slot)
     {
-        disconnect_profiles_from_actions_in_group (priv->new_terminal_action_group);
-        ctk_ui_manager_remove_action_group (priv->ui_manager,
-                                            priv->new_terminal_action_group);
-        priv->new_terminal_action_group = NULL;
+        TerminalEncoding *encoding = NULL;
+
+        if (l != NULL)
+        {
+            encoding = (TerminalEncoding *) l->data;
+            l = l->next;
+        }
+
+        shared_actions_set_slot_encoding (slot, encoding);
     }
 
-    profiles = terminal_app_get_profile_list (terminal_app_get ());
-    have_single_profile = !profiles || !profiles->next;
+    g_slist_foreach (encodings, (GFunc) terminal_encoding_unref, NULL);
+    g_slist_free (encodings);
+}
 
-    action = ctk_action_group_get_action (priv->action_group, "FileNewTab");
-    ctk_action_set_visible (action, have_single_profile);
-    action = ctk_action_group_get_action (priv->action_group, "FileNewWindow");
-    ctk_action_set_visible (action, have_single_profile);
+static void
+shared_actions_profile_list_changed_cb (TerminalApp *app G_GNUC_UNUSED,
+                                        gpointer     user_data G_GNUC_UNUSED)
+{
+    shared_actions_update_profiles ();
+
+    if (shared_actions->window != NULL)
+        terminal_window_sync_shared_actions (shared_actions->window);
+}
+
+static void
+shared_actions_encoding_list_changed_cb (TerminalApp *app G_GNUC_UNUSED,
+                                         gpointer     user_data G_GNUC_UNUSED)
+{
+    shared_actions_update_encodings ();
+
+    if (shared_actions->window != NULL)
+        terminal_window_sync_shared_actions (shared_actions->window);
+}
 
-    if (have_single_profile)
+static void
+terminal_window_shared_actions_ref (void)
+{
+    TerminalWindowSharedActions *shared;
+    TerminalApp *app;
+
+    if (shared_actions != NULL)
     {
-        g_list_free (profiles);
+        shared_actions->n_windows++;
         return;
     }
 
-    /* Now build the submenus */
+    shared = shared_actions = g_new0 (TerminalWindowSharedActions, 1);
+    shared->n_windows = 1;
 
-    action_group = priv->new_terminal_action_group = ctk_action_group_new ("NewTerminal");
-    ctk_ui_manager_insert_action_group (priv->ui_manager, action_group, -1);
-    g_object_unref (action_group);
+    shared->profiles_action_group = ctk_action_group_new ("Profiles");
+    shared->new_terminal_action_group = ctk_action_group_new ("NewTerminal");
+    shared->encodings_action_group = ctk_action_group_new ("Encodings");
+    shared->encoding_actions = g_ptr_array_new ();
 
-    priv->new_terminal_ui_id = ctk_ui_manager_new_merge_id (priv->ui_manager);
+    shared_actions_update_profiles ();
+    shared_actions_update_encodings ();
 
-    n = 0;
-    for (p = profiles; p != NULL; p = p->next)
-    {
-        TerminalProfile *profile = (TerminalProfile *) p->data;
-        char name[32];
+    app = terminal_app_get ();
+    g_signal_connect (app, "profile-list-changed",
+                      G_CALLBACK (shared_actions_profile_list_changed_cb), NULL);
+    g_signal_connect (app, "encoding-list-changed",
+                      G_CALLBACK (shared_actions_encoding_list_changed_cb), NULL);
+}
 
-        g_snprintf (name, sizeof (name), "FileNewTab.%u", n);
-        terminal_window_create_new_terminal_action (window,
-                profile,
-                name,
-                n,
-                G_CALLBACK (file_new_tab_callback));
+static void
+terminal_window_shared_actions_unref (TerminalWindow *window)
+{
+    TerminalWindowSharedActions *shared = shared_actions;
+    TerminalApp *app;
 
-        ctk_ui_manager_add_ui (priv->ui_manager, priv->new_terminal_ui_id,
-                               FILE_NEW_TERMINAL_TAB_UI_PATH,
-                               name, name,
-                               CTK_UI_MANAGER_MENUITEM, FALSE);
+    g_assert (shared != NULL);
 
-        g_snprintf (name, sizeof (name), "FileNewWindow.%u", n);
-        terminal_window_create_new_terminal_action (window,
-                profile,
-                name,
-                n,
-                G_CALLBACK (file_new_window_callback));
+    if (shared->window == window)
+        shared->window = NULL;
 
-        ctk_ui_manager_add_ui (priv->ui_manager, priv->new_terminal_ui_id,
-                               FILE_NEW_TERMINAL_WINDOW_UI_PATH,
-                               name, name,
-                               CTK_UI_MANAGER_MENUITEM, FALSE);
+    if (--shared->n_windows > 0)
+        return;
 
-        ++n;
-    }
+    app = terminal_app_get ();
+    g_signal_handlers_disconnect_by_func (app,
+                                          G_CALLBACK (shared_actions_profile_list_changed_cb),
+                                          NULL);
+    g_signal_handlers_disconnect_by_func (app,
+                                          G_CALLBACK (shared_actions_encoding_list_changed_cb),
+                                          NULL);
 
-    g_list_free (profiles);
+    disconnect_profiles_from_actions_in_group (shared->profiles_action_group);
+    disconnect_profiles_from_actions_in_group (shared->new_terminal_action_group);
+
+    g_ptr_array_free (shared->encoding_actions, TRUE);
+    g_object_unref (shared->profiles_action_group);
+    g_object_unref (shared->new_terminal_action_group);
+    g_object_unref (shared->encodings_action_group);
+
+    g_free (shared);
+    shared_actions = NULL;
 }
 
 static void
-terminal_set_encoding_callback (CtkToggleAction *action,
-                                TerminalWindow *window)
+terminal_window_update_set_profile_menu_active_profile (TerminalWindow *window)
 {
     TerminalWindowPrivate *priv = window->priv;
-    TerminalEncoding *encoding;
+    TerminalWindowSharedActions *shared = shared_actions;
+    TerminalProfile *new_active_profile;
+    guint slot;
 
-    if (!ctk_toggle_action_get_active (action))
+    if (shared == NULL || shared->window != window)
         return;
 
-    if (priv->active_screen == NULL)
+    if (!priv->active_screen)
         return;
 
-    encoding = g_object_get_data (G_OBJECT (action), ENCODING_DATA_KEY);
-    g_assert (encoding);
+    new_active_profile = terminal_screen_get_profile (priv->active_screen);
 
-    bte_terminal_set_encoding (BTE_TERMINAL (priv->active_screen),
-                               terminal_encoding_get_charset (encoding), NULL);
+    for (slot = 0; slot < shared->n_profiles; ++slot)
+    {
+        CtkAction *action;
+
+        action = shared_actions_get_slot_action (shared->profiles_action_group,
+                                                 "TerminalSetProfile%u", slot);
+        if (g_object_get_data (G_OBJECT (action), PROFILE_DATA_KEY) != new_active_profile)
+            continue;
+
+        g_signal_handlers_block_by_func (action, G_CALLBACK (shared_profile_toggled_cb), NULL);
+        ctk_toggle_action_set_active (CTK_TOGGLE_ACTION (action), TRUE);
+        g_signal_handlers_unblock_by_func (action, G_CALLBACK (shared_profile_toggled_cb), NULL);
+
+        break;
+    }
 }
 
 static void
-terminal_window_update_encoding_menu (TerminalWindow *window)
+terminal_window_update_encoding_menu_active_encoding (TerminalWindow *window)
 {
     TerminalWindowPrivate *priv = window->priv;
-    TerminalApp *app;
-    CtkActionGroup *action_group;
-    GSList *group;
-    guint n;
-    GSList *encodings, *l;
+    TerminalWindowSharedActions *shared = shared_actions;
+    CtkAction *action = NULL;
     const char *charset;
-    TerminalEncoding *active_encoding;
+    guint slot;
+
+    if (shared == NULL || shared->window != window)
+        return;
+
+    if (!priv->active_screen)
+        return;
+
+    charset = bte_terminal_get_encoding (BTE_TERMINAL (priv->active_screen));
+    if (charset == NULL)
+        return;
 
-    /* Remove the old UI */
-    if (priv->encodings_ui_id != 0)
+    for (slot = 0; slot < shared->n_encodings; ++slot)
     {
-        ctk_ui_manager_remove_ui (priv->ui_manager, priv->encodings_ui_id);
-        priv->encodings_ui_id = 0;
+        TerminalEncoding *encoding;
+
+        encoding = g_object_get_data (G_OBJECT (g_ptr_array_index (shared->encoding_actions, slot)),
+                                      ENCODING_DATA_KEY);
+        if (encoding != NULL && strcmp (terminal_encoding_get_id (encoding), charset) == 0)
+        {
+            action = g_ptr_array_index (shared->encoding_actions, slot);
+            break;
+        }
     }
 
-    if (priv->encodings_action_group != NULL)
+    /* Not in the list; use the spare slot */
+    if (action == NULL)
     {
-        ctk_ui_manager_remove_action_group (priv->ui_manager,
-                                            priv->encodings_action_group);
-        priv->encodings_action_group = NULL;
+        shared_actions_set_slot_encoding (shared->n_encodings,
+                                          terminal_app_ensure_encoding (terminal_app_get (), charset));
+        action = g_ptr_array_index (shared->encoding_actions, shared->n_encodings);
     }
-
-    action_group = priv->encodings_action_group = ctk_action_group_new ("Encodings");
-    ctk_ui_manager_insert_action_group (priv->ui_manager, action_group, -1);
-    g_object_unref (action_group);
-
-    priv->encodings_ui_id = ctk_ui_manager_new_merge_id (priv->ui_manager);
-
-    if (priv->active_screen)
-        charset = bte_terminal_get_encoding (BTE_TERMINAL (priv->active_screen));
     else
-        charset = "current";
+        shared_actions_set_slot_encoding (shared->n_encodings, NULL);
 
-    app = terminal_app_get ();
-    active_encoding = terminal_app_ensure_encoding (app, charset);
+    g_signal_handlers_block_by_func (action, G_CALLBACK (shared_encoding_toggled_cb), NULL);
+    ctk_toggle_action_set_active (CTK_TOGGLE_ACTION (action), TRUE);
+    g_signal_handlers_unblock_by_func (action, G_CALLBACK (shared_encoding_toggled_cb), NULL);
+}
 
-    encodings = terminal_app_get_active_encodings (app);
+/* Makes the shared actions act on @window, and merges the slots added
+ * since it was last synced into its menus.
+ */
+static void
+terminal_window_sync_shared_actions (TerminalWindow *window)
+{
+    TerminalWindowPrivate *priv = window->priv;
+    TerminalWindowSharedActions *shared = shared_actions;
+    CtkAction *action;
+    gboolean single_profile;
+    char name[32];
+    guint slot;
 
-    if (g_slist_find (encodings, active_encoding) == NULL)
-        encodings = g_slist_append (encodings, terminal_encoding_ref (active_encoding));
+    shared->window = window;
 
-    group = NULL;
-    n = 0;
-    for (l = encodings; l != NULL; l = l->next)
+    for (slot = priv->n_profile_slots_merged; slot < shared->n_profile_slots; ++slot)
     {
-        TerminalEncoding *e = (TerminalEncoding *) l->data;
-        CtkRadioAction *encoding_action;
-        char name[128];
-        char *display_name;
-
-        g_snprintf (name, sizeof (name), SET_ENCODING_ACTION_NAME_PREFIX "%s", terminal_encoding_get_id (e));
-        display_name = g_strdup_printf ("%s (%s)", e->name, terminal_encoding_get_charset (e));
-
-        encoding_action = ctk_radio_action_new (name,
-                                                display_name,
-                                                NULL,
-                                                NULL,
-                                                n);
-        g_free (display_name);
-
-        ctk_radio_action_set_group (encoding_action, group);
-        group = ctk_radio_action_get_group (encoding_action);
-
-        if (charset && strcmp (terminal_encoding_get_id (e), charset) == 0)
-            ctk_toggle_action_set_active (CTK_TOGGLE_ACTION (encoding_action), TRUE);
+        g_snprintf (name, sizeof (name), "TerminalSetProfile%u", slot);
+        ctk_ui_manager_add_ui (priv->ui_manager, priv->profiles_ui_id,
+                               PROFILES_UI_PATH,
+                               name, name,
+                               CTK_UI_MANAGER_MENUITEM, FALSE);
+        ctk_ui_manager_add_ui (priv->ui_manager, priv->profiles_ui_id,
+                               PROFILES_POPUP_UI_PATH,
+                               name, name,
+                               CTK_UI_MANAGER_MENUITEM, FALSE);
 
-        g_signal_connect (encoding_action, "toggled",
-                          G_CALLBACK (terminal_set_encoding_callback), window);
+        g_snprintf (name, sizeof (name), "FileNewTab.%u", slot);
+        ctk_ui_manager_add_ui (priv->ui_manager, priv->new_terminal_ui_id,
+                               FILE_NEW_TERMINAL_TAB_UI_PATH,
+                               name, name,
+                               CTK_UI_MANAGER_MENUITEM, FALSE);
 
-        g_object_set_data_full (G_OBJECT (encoding_action), ENCODING_DATA_KEY,
-                                terminal_encoding_ref (e),
-                                (GDestroyNotify) terminal_encoding_unref);
+        g_snprintf (name, sizeof (name), "FileNewWindow.%u", slot);
+        ctk_ui_manager_add_ui (priv->ui_manager, priv->new_terminal_ui_id,
+                               FILE_NEW_TERMINAL_WINDOW_UI_PATH,
+                               name, name,
+                               CTK_UI_MANAGER_MENUITEM, FALSE);
+    }
+    priv->n_profile_slots_merged = shared->n_profile_slots;
 
-        ctk_action_group_add_action (action_group, CTK_ACTION (encoding_action));
-        g_object_unref (encoding_action);
+    for (slot = priv->n_encoding_slots_merged; slot < shared->encoding_actions->len; ++slot)
+    {
+        const char *action_name;
 
+        action_name = ctk_action_get_name (g_ptr_array_index (shared->encoding_actions, slot));
         ctk_ui_manager_add_ui (priv->ui_manager, priv->encodings_ui_id,
                                SET_ENCODING_UI_PATH,
-                               name, name,
+                               action_name, action_name,
                                CTK_UI_MANAGER_MENUITEM, FALSE);
     }
+    priv->n_encoding_slots_merged = shared->encoding_actions->len;
 
-    g_slist_foreach (encodings, (GFunc) terminal_encoding_unref, NULL);
-    g_slist_free (encodings);
+    single_profile = shared->n_profiles <= 1;
+
+    action = ctk_action_group_get_action (priv->action_group, "TerminalProfiles");
+    ctk_action_set_sensitive (action, !single_profile);
+    action = ctk_action_group_get_action (priv->action_group, "FileNewTab");
+    ctk_action_set_visible (action, single_profile);
+    action = ctk_action_group_get_action (priv->action_group, "FileNewWindow");
+    ctk_action_set_visible (action, single_profile);
+
+    terminal_window_update_set_profile_menu_active_profile (window);
+    terminal_window_update_encoding_menu_active_encoding (window);
 }
 
 static void
-terminal_window_update_encoding_menu_active_encoding (TerminalWindow *window)
+terminal_window_is_active_notify_cb (TerminalWindow *window,
+                                     GParamSpec     *pspec G_GNUC_UNUSED,
+                                     gpointer        user_data G_GNUC_UNUSED)
 {
-    TerminalWindowPrivate *priv = window->priv;
-    CtkAction *action;
-    char name[128];
-
-    if (!priv->active_screen)
-        return;
-    if (!priv->encodings_action_group)
+    if (window->priv->disposed)
         return;
 
-    g_snprintf (name, sizeof (name), SET_ENCODING_ACTION_NAME_PREFIX "%s",
-                bte_terminal_get_encoding (BTE_TERMINAL (priv->active_screen)));
-    action = ctk_action_group_get_action (priv->encodings_action_group, name);
-    if (!action)
-        return;
-
-    g_signal_handlers_block_by_func (action, G_CALLBACK (terminal_set_encoding_callback), window);
-    ctk_toggle_action_set_active (CTK_TOGGLE_ACTION (action), TRUE);
-    g_signal_handlers_unblock_by_func (action, G_CALLBACK (terminal_set_encoding_callback), window);
+    if (ctk_window_is_active (CTK_WINDOW (window)))
+        terminal_window_sync_shared_actions (window);
 }
 
 static void
@@ -1262,7 +1423,11 @@ update_tab_visibility (TerminalWindow *window,
     num = ctk_notebook_get_n_pages (CTK_NOTEBOOK (priv->notebook));
 
     show_tabs = (num + change) > 1;
+    if (show_tabs == ctk_notebook_get_show_tabs (CTK_NOTEBOOK (priv->notebook)))
+        return;
+
     ctk_notebook_set_show_tabs (CTK_NOTEBOOK (priv->notebook), show_tabs);
+    terminal_window_invalidate_geometry (window);
 }
 
 static CtkNotebook *
@@ -1418,6 +1583,8 @@ popup_clipboard_targets_received_cb (CtkClipboard            *clipboard G_GNUC_U
     /* Now we know that the screen is realized, we know that the window is still alive */
     remove_popup_info (window);
 
+    terminal_window_sync_shared_actions (window);
+
     priv->popup_info = info; /* adopt the ref added when requesting the clipboard */
 
     n_pages = ctk_notebook_get_n_pages (CTK_NOTEBOOK (priv->notebook));
@@ -1635,6 +1802,10 @@ terminal_window_realize (CtkWidget *widget)
 
     CTK_WIDGET_CLASS (terminal_window_parent_class)->realize (widget);
 
+    _terminal_startup_mark (TERMINAL_STARTUP_WINDOW_REALIZED);
+
+    terminal_window_invalidate_geometry (window);
+
     /* Need to do this now since this requires the window to be realized */
     if (priv->active_screen != NULL)
         sync_screen_icon_title (priv->active_screen, NULL, window);
@@ -1776,24 +1947,10 @@ terminal_window_screen_changed (CtkWidget *widget,
     if (!screen)
         return;
 
+    terminal_window_invalidate_geometry (window);
     terminal_window_screen_update (window, screen);
 }
 
-static void
-terminal_window_profile_list_changed_cb (TerminalApp    *app G_GNUC_UNUSED,
-					 TerminalWindow *window)
-{
-    terminal_window_update_set_profile_menu (window);
-    terminal_window_update_new_terminal_menus (window);
-}
-
-static void
-terminal_window_encoding_list_changed_cb (TerminalApp    *app G_GNUC_UNUSED,
-					  TerminalWindow *window)
-{
-    terminal_window_update_encoding_menu (window);
-}
-
 static void
 terminal_window_init (TerminalWindow *window)
 {
@@ -2099,7 +2256,6 @@ terminal_window_init (TerminalWindow *window)
         }
     };
     TerminalWindowPrivate *priv;
-    TerminalApp *app;
     CtkActionGroup *action_group;
     CtkAction *action;
     CtkUIManager *manager;
@@ -2179,6 +2335,9 @@ terminal_window_init (TerminalWindow *window)
 
     priv->old_geometry_widget = NULL;
 
+    priv->geometry_generation = 1;
+    priv->old_geometry_generation = 0;
+
     /* Create the UI manager */
     manager = priv->ui_manager = ctk_ui_manager_new ();
 
@@ -2224,14 +2383,17 @@ terminal_window_init (TerminalWindow *window)
     /* Add tabs menu */
     priv->tabs_menu = terminal_tabs_menu_new (window);
 
-    app = terminal_app_get ();
-    terminal_window_profile_list_changed_cb (app, window);
-    g_signal_connect (app, "profile-list-changed",
-                      G_CALLBACK (terminal_window_profile_list_changed_cb), window);
-
-    terminal_window_encoding_list_changed_cb (app, window);
-    g_signal_connect (app, "encoding-list-changed",
-                      G_CALLBACK (terminal_window_encoding_list_changed_cb), window);
+    /* Add the profile, new terminal and encoding menus */
+    terminal_window_shared_actions_ref ();
+    ctk_ui_manager_insert_action_group (manager, shared_actions->profiles_action_group, -1);
+    ctk_ui_manager_insert_action_group (manager, shared_actions->new_terminal_action_group, -1);
+    ctk_ui_manager_insert_action_group (manager, shared_actions->encodings_action_group, -1);
+    priv->profiles_ui_id = ctk_ui_manager_new_merge_id (manager);
+    priv->new_terminal_ui_id = ctk_ui_manager_new_merge_id (manager);
+    priv->encodings_ui_id = ctk_ui_manager_new_merge_id (manager);
+    terminal_window_sync_shared_actions (window);
+    g_signal_connect (window, "notify::is-active",
+                      G_CALLBACK (terminal_window_is_active_notify_cb), NULL);
 
     terminal_window_set_menubar_visible (window, TRUE);
     priv->use_default_menubar_visibility = TRUE;
@@ -2271,7 +2433,6 @@ terminal_window_dispose (GObject *object)
 {
     TerminalWindow *window = TERMINAL_WINDOW (object);
     TerminalWindowPrivate *priv = window->priv;
-    TerminalApp *app;
     CtkClipboard *clipboard;
 #ifdef CDK_WINDOWING_X11
     CdkScreen *screen;
@@ -2279,6 +2440,9 @@ terminal_window_dispose (GObject *object)
 
     remove_popup_info (window);
 
+    if (!priv->disposed)
+        terminal_window_shared_actions_unref (window);
+
     priv->disposed = TRUE;
 
     if (priv->tabs_menu)
@@ -2287,18 +2451,6 @@ terminal_window_dispose (GObject *object)
         priv->tabs_menu = NULL;
     }
 
-    if (priv->profiles_action_group != NULL)
-        disconnect_profiles_from_actions_in_group (priv->profiles_action_group);
-    if (priv->new_terminal_action_group != NULL)
-        disconnect_profiles_from_actions_in_group (priv->new_terminal_action_group);
-
-    app = terminal_app_get ();
-    g_signal_handlers_disconnect_by_func (app,
-                                          G_CALLBACK (terminal_window_profile_list_changed_cb),
-                                          window);
-    g_signal_handlers_disconnect_by_func (app,
-                                          G_CALLBACK (terminal_window_encoding_list_changed_cb),
-                                          window);
     clipboard = ctk_widget_get_clipboard (CTK_WIDGET (window), CDK_SELECTION_CLIPBOARD);
     g_signal_handlers_disconnect_by_func (clipboard,
                                           G_CALLBACK (update_edit_menu),
@@ -2652,6 +2804,7 @@ terminal_window_set_menubar_visible (TerminalWindow *window,
     ctk_toggle_action_set_active (CTK_TOGGLE_ACTION (action), setting);
 
     g_object_set (priv->menubar, "visible", setting, NULL);
+    terminal_window_invalidate_geometry (window);
 
     /* FIXMEchpe: use ctk_widget_get_realized instead? */
     if (priv->active_screen)
@@ -3010,6 +3163,9 @@ notebook_page_selected_callback (CtkWidget      *notebook G_GNUC_UNUSED,
                            "[window %p] MDI: setting active tab to screen %p (old active screen %p)\n",
                            window, screen, priv->active_screen);
 
+    /* Background tabs of a lazily restored session launch on first view */
+    terminal_screen_launch_deferred_child (screen);
+
     if (priv->active_screen == screen)
         return;
 
@@ -3206,8 +3362,7 @@ terminal_window_update_copy_selection (TerminalScreen *screen,
 {
     TerminalWindowPrivate *priv = window->priv;
     priv->copy_selection =
-        terminal_profile_get_property_boolean (terminal_screen_get_profile (screen),
-            TERMINAL_PROFILE_COPY_SELECTION);
+        terminal_profile_get_snapshot (terminal_screen_get_profile (screen))->copy_selection;
 }
 
 static gboolean
@@ -3296,6 +3451,19 @@ terminal_window_update_geometry (TerminalWindow *window)
      */
     terminal_screen_get_cell_size (priv->active_screen, &char_width, &char_height);
 
+    /* The chrome doesn't depend on the grid size, so unless it or the
+     * cell size changed, the hints and metrics are still current. */
+    if (priv->old_geometry_generation == priv->geometry_generation &&
+        widget == CTK_WIDGET (priv->old_geometry_widget) &&
+        char_width == priv->old_char_width &&
+        char_height == priv->old_char_height)
+    {
+        _terminal_debug_print (TERMINAL_DEBUG_GEOMETRY,
+                               "[window %p] chrome unchanged, not measuring\n",
+                               window);
+        return;
+    }
+
     terminal_screen_get_size (priv->active_screen, &grid_width, &grid_height);
     _terminal_debug_print (TERMINAL_DEBUG_GEOMETRY, "%dx%d cells of %dx%d px = %dx%d px\n",
                            grid_width, grid_height, char_width, char_height,
@@ -3381,6 +3549,21 @@ terminal_window_update_geometry (TerminalWindow *window)
     priv->old_chrome_height = chrome_height;
     priv->old_padding_width = padding.left + padding.right;
     priv->old_padding_height = padding.top + padding.bottom;
+    priv->old_geometry_generation = priv->geometry_generation;
+}
+
+/**
+ * terminal_window_invalidate_geometry:
+ * @window:
+ *
+ * Makes the next terminal_window_update_geometry() measure the window
+ * chrome again. Call this after anything that changes the size of what
+ * surrounds the terminal grid, other than the cell size or active screen.
+ */
+void
+terminal_window_invalidate_geometry (TerminalWindow *window)
+{
+    window->priv->geometry_generation++;
 }
 
 static void
@@ -3573,11 +3756,8 @@ file_close_window_callback (CtkAction      *action G_GNUC_UNUSED,
 static void
 save_contents_dialog_on_response (CtkDialog *dialog, gint response_id, gpointer terminal)
 {
-    CtkWindow *parent;
     gchar *filename_uri = NULL;
     GFile *file;
-    GOutputStream *stream;
-    GError *error = NULL;
 
     if (response_id != CTK_RESPONSE_ACCEPT)
     {
@@ -3585,7 +3765,6 @@ save_contents_dialog_on_response (CtkDialog *dialog, gint response_id, gpointer
         return;
     }
 
-    parent = (CtkWindow*) ctk_widget_get_ancestor (CTK_WIDGET (terminal), CTK_TYPE_WINDOW);
     filename_uri = ctk_file_chooser_get_uri (CTK_FILE_CHOOSER (dialog));
 
     ctk_widget_destroy (CTK_WIDGET (dialog));
@@ -3594,25 +3773,8 @@ save_contents_dialog_on_response (CtkDialog *dialog, gint response_id, gpointer
         return;
 
     file = g_file_new_for_uri (filename_uri);
-    stream = G_OUTPUT_STREAM (g_file_replace (file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error));
-
-    if (stream)
-    {
-        /* FIXME
-         * Should be replaced with the async version when bte implements that.
-         */
-        bte_terminal_write_contents_sync (terminal, stream,
-                                          BTE_WRITE_DEFAULT,
-                                          NULL, &error);
-        g_object_unref (stream);
-    }
-
-    if (error)
-    {
-        terminal_util_show_error_dialog (parent, NULL, error,
-                                         "%s", _("Could not save contents"));
-        g_error_free (error);
-    }
+    terminal_screen_container_save_contents (terminal_screen_container_get_from_screen (TERMINAL_SCREEN (terminal)),
+                                             file);
 
     g_object_unref(file);
     g_free(filename_uri);
@@ -3957,28 +4119,52 @@ search_find_response_callback (CtkWidget *dialog,
 {
     TerminalWindow *window = TERMINAL_WINDOW (user_data);
     TerminalWindowPrivate *priv = window->priv;
+    BteTerminal *terminal;
     TerminalSearchFlags flags;
     BteRegex *regex;
+    gboolean restart, backwards, found;
 
-    if (response != CTK_RESPONSE_ACCEPT)
+    if (response != CTK_RESPONSE_ACCEPT &&
+        response != TERMINAL_SEARCH_DIALOG_RESPONSE_INCREMENTAL)
         return;
 
     if (G_UNLIKELY (!priv->active_screen))
         return;
 
+    terminal = BTE_TERMINAL (priv->active_screen);
+
     regex = terminal_search_dialog_get_regex (dialog);
     g_return_if_fail (regex != NULL);
 
     flags = terminal_search_dialog_get_search_flags (dialog);
+    backwards = (flags & TERMINAL_SEARCH_FLAG_BACKWARDS) != 0;
+
+    /* A new pattern starts over from the end of the buffer, so the first
+     * match found while typing is the one nearest to the latest output.
+     */
+    restart = bte_terminal_search_get_regex (terminal) != regex;
+    if (restart)
+    {
+        CtkAdjustment *adjustment;
 
-    bte_terminal_search_set_regex (BTE_TERMINAL (priv->active_screen), regex, 0);
-    bte_terminal_search_set_wrap_around (BTE_TERMINAL (priv->active_screen),
+        bte_terminal_unselect_all (terminal);
+
+        adjustment = ctk_scrollable_get_vadjustment (CTK_SCROLLABLE (terminal));
+        ctk_adjustment_set_value (adjustment,
+                                  ctk_adjustment_get_upper (adjustment) -
+                                  ctk_adjustment_get_page_size (adjustment));
+    }
+
+    bte_terminal_search_set_regex (terminal, regex, 0);
+    bte_terminal_search_set_wrap_around (terminal,
                                          (flags & TERMINAL_SEARCH_FLAG_WRAP_AROUND));
 
-    if (flags & TERMINAL_SEARCH_FLAG_BACKWARDS)
-        bte_terminal_search_find_previous (BTE_TERMINAL (priv->active_screen));
+    if (backwards)
+        found = bte_terminal_search_find_previous (terminal);
     else
-        bte_terminal_search_find_next (BTE_TERMINAL (priv->active_screen));
+        found = bte_terminal_search_find_next (terminal);
+
+    terminal_search_dialog_set_search_result (dialog, terminal, restart, backwards, found);
 
     terminal_window_update_search_sensitivity (priv->active_screen, window);
 }
@@ -4019,20 +4205,36 @@ static void
 search_find_next_callback (CtkAction      *action G_GNUC_UNUSED,
 			   TerminalWindow *window)
 {
-    if (G_UNLIKELY (!window->priv->active_screen))
+    TerminalWindowPrivate *priv = window->priv;
+    gboolean found;
+
+    if (G_UNLIKELY (!priv->active_screen))
         return;
 
-    bte_terminal_search_find_next (BTE_TERMINAL (window->priv->active_screen));
+    found = bte_terminal_search_find_next (BTE_TERMINAL (priv->active_screen));
+
+    if (priv->search_find_dialog)
+        terminal_search_dialog_set_search_result (priv->search_find_dialog,
+                                                  BTE_TERMINAL (priv->active_screen),
+                                                  FALSE, FALSE, found);
 }
 
 static void
 search_find_prev_callback (CtkAction      *action G_GNUC_UNUSED,
 			   TerminalWindow *window)
 {
-    if (G_UNLIKELY (!window->priv->active_screen))
+    TerminalWindowPrivate *priv = window->priv;
+    gboolean found;
+
+    if (G_UNLIKELY (!priv->active_screen))
         return;
 
-    bte_terminal_search_find_previous (BTE_TERMINAL (window->priv->active_screen));
+    found = bte_terminal_search_find_previous (BTE_TERMINAL (priv->active_screen));
+
+    if (priv->search_find_dialog)
+        terminal_search_dialog_set_search_result (priv->search_find_dialog,
+                                                  BTE_TERMINAL (priv->active_screen),
+                                                  FALSE, TRUE, found);
 }
 
 static void
@@ -84,6 +84,8 @@ TerminalScreen* terminal_window_get_active (TerminalWindow *window);
 GList* terminal_window_list_screen_containers (TerminalWindow *window);
 
 void terminal_window_update_geometry  (TerminalWindow *window);
+
+void terminal_window_invalidate_geometry (TerminalWindow *window);
 void
 terminal_window_update_size (TerminalWindow *window,
                              TerminalScreen *screen,
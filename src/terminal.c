@@ -215,6 +215,35 @@ out:
 			g_error_free (error);
 		}
 	}
+	else if (g_strcmp0 (method_name, "GetStartupTimeline") == 0)
+	{
+		g_dbus_method_invocation_return_value (invocation,
+		                                       g_variant_new ("(@a(sx))", _terminal_startup_get_timeline ()));
+	}
+	else if (g_strcmp0 (method_name, "GetScrollbackUsage") == 0)
+	{
+		g_dbus_method_invocation_return_value (invocation,
+		                                       terminal_app_get_scrollback_report (terminal_app_get ()));
+	}
+}
+
+static GVariant *
+stats_get_property_cb (GDBusConnection *connection G_GNUC_UNUSED,
+                       const char      *sender G_GNUC_UNUSED,
+                       const char      *object_path G_GNUC_UNUSED,
+                       const char      *interface_name G_GNUC_UNUSED,
+                       const char      *property_name,
+                       GError         **error,
+                       gpointer         user_data G_GNUC_UNUSED)
+{
+	GVariant *value;
+
+	value = terminal_app_get_stat (terminal_app_get (), property_name);
+	if (value == NULL)
+		g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+		             "No such property %s", property_name);
+
+	return value;
 }
 
 static void
@@ -233,6 +262,29 @@ bus_acquired_cb (GDBusConnection *connection,
 	    "<arg type='i' name='workspace' direction='in' />"
 	    "<arg type='ay' name='arguments' direction='in' />"
 	    "</method>"
+	    "<method name='GetStartupTimeline'>"
+	    "<arg type='a(sx)' name='timeline' direction='out' />"
+	    "</method>"
+	    "<method name='GetScrollbackUsage'>"
+	    "<arg type='t' name='budget' direction='out' />"
+	    "<arg type='t' name='total' direction='out' />"
+	    "<arg type='t' name='trims' direction='out' />"
+	    "<arg type='a(stxx)' name='terminals' direction='out' />"
+	    "</method>"
+	    "</interface>"
+	    "<interface name='org.cafe.Terminal.Stats'>"
+	    "<property type='u' name='Windows' access='read' />"
+	    "<property type='u' name='Screens' access='read' />"
+	    "<property type='a(sittx)' name='ScreenStats' access='read' />"
+	    "<property type='a(xu)' name='SpawnLatency' access='read' />"
+	    "<property type='u' name='NotificationsShown' access='read' />"
+	    "<property type='u' name='NotificationsSuppressed' access='read' />"
+	    "<property type='t' name='ProfileNotifies' access='read' />"
+	    "<property type='t' name='TitlesSuppressed' access='read' />"
+	    "<property type='(uuu)' name='ShellPool' access='read' />"
+	    "<property type='(uu)' name='FontCache' access='read' />"
+	    "<property type='(uu)' name='EnvironmentTemplate' access='read' />"
+	    "<property type='u' name='LogLinesDropped' access='read' />"
 	    "</interface>"
 	    "</node>";
 
@@ -244,9 +296,18 @@ bus_acquired_cb (GDBusConnection *connection,
 		{ NULL }
 	};
 
+	/* Values are computed when read; no change notifications */
+	static const GDBusInterfaceVTable stats_interface_vtable =
+	{
+		NULL,
+		stats_get_property_cb,
+		NULL,
+		{ NULL }
+	};
+
 	OwnData *data = (OwnData *) user_data;
 	GDBusNodeInfo *introspection_data;
-	guint registration_id;
+	guint registration_id, stats_registration_id;
 	GError *error = NULL;
 
 	_terminal_debug_print (TERMINAL_DEBUG_FACTORY,
@@ -261,15 +322,30 @@ bus_acquired_cb (GDBusConnection *connection,
 	                  &interface_vtable,
 	                  NULL, NULL,
 	                  &error);
-	g_dbus_node_info_unref (introspection_data);
-
 	if (registration_id == 0)
 	{
 		g_printerr ("Failed to register object: %s\n", error->message);
 		g_error_free (error);
+		g_dbus_node_info_unref (introspection_data);
 		data->exit_code = EXIT_FAILURE;
 		ctk_main_quit ();
+		return;
+	}
+
+	/* Only for diagnostics; the factory works without it */
+	stats_registration_id = g_dbus_connection_register_object (connection,
+	                        TERMINAL_FACTORY_SERVICE_PATH,
+	                        introspection_data->interfaces[1],
+	                        &stats_interface_vtable,
+	                        NULL, NULL,
+	                        &error);
+	if (stats_registration_id == 0)
+	{
+		g_warning ("Failed to register the stats interface: %s", error->message);
+		g_error_free (error);
 	}
+
+	g_dbus_node_info_unref (introspection_data);
 }
 
 static void
@@ -280,6 +356,8 @@ name_acquired_cb (GDBusConnection *connection G_GNUC_UNUSED,
 	OwnData *data = (OwnData *) user_data;
 	GError *error = NULL;
 
+	_terminal_startup_mark (TERMINAL_STARTUP_BUS_NAME_ACQUIRED);
+
 	_terminal_debug_print (TERMINAL_DEBUG_FACTORY,
 	                       "Acquired the name %s on the session bus\n", name);
 
@@ -537,6 +615,8 @@ main (int argc, char **argv)
 	char *working_directory;
 	int ret = EXIT_SUCCESS;
 
+	_terminal_startup_mark (TERMINAL_STARTUP_MAIN);
+
 	setlocale (LC_ALL, "");
 
 	bindtextdomain (GETTEXT_PACKAGE, TERM_LOCALEDIR);
@@ -581,6 +661,8 @@ main (int argc, char **argv)
 
 	g_free (working_directory);
 
+	_terminal_startup_mark (TERMINAL_STARTUP_OPTIONS_PARSED);
+
 	if (options == NULL)
 	{
 		g_printerr (_("Failed to parse arguments: %s\n"), error->message);
@@ -627,6 +709,7 @@ main (int argc, char **argv)
 		data->argc = argc_copy;
 
 		ctk_init(&argc, &argv);
+		_terminal_startup_mark (TERMINAL_STARTUP_CTK_INIT);
 		options->initial_workspace = get_initial_workspace ();
 
 		owner_id = g_bus_own_name (G_BUS_TYPE_SESSION,